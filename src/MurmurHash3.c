@@ -178,6 +178,114 @@ void MurmurHash3_x86_32 ( const void * key, int len,
   *(uint32_t*)out = h1;
 } 
 
+/*-----------------------------------------------------------------------------
+// Streaming MurmurHash3_x86_32. Whole blocks are mixed as they arrive; up to
+// 3 trailing bytes are held back until more input, or finalization.
+*/
+
+static uint32_t mix_block_32 ( uint32_t h1, uint32_t k1 )
+{
+  k1 *= 0xcc9e2d51;
+  k1 = ROTL32(k1,15);
+  k1 *= 0x1b873593;
+
+  h1 ^= k1;
+  h1 = ROTL32(h1,13);
+  return h1*5+0xe6546b64;
+}
+
+#ifdef __cplusplus
+extern "C"
+#endif
+void MurmurHash3_x86_32_init ( MurmurHash3_x86_32_state * state,
+                               uint32_t seed )
+{
+  state->h1 = seed;
+  state->len = 0;
+  state->tail.block = 0;
+  state->tail_len = 0;
+}
+
+#ifdef __cplusplus
+extern "C"
+#endif
+void MurmurHash3_x86_32_update ( MurmurHash3_x86_32_state * state,
+                                 const void * key, int len )
+{
+  int i;
+  const uint8_t * data = (const uint8_t*)key;
+  const uint32_t * blocks;
+  int nblocks;
+
+  state->len += len;
+
+  /*----------
+  // complete a block held back by the previous call
+  */
+
+  while(state->tail_len && len)
+  {
+    state->tail.bytes[state->tail_len++] = *data++;
+    len--;
+
+    if(state->tail_len == 4)
+    {
+      state->h1 = mix_block_32(state->h1, state->tail.block);
+      state->tail_len = 0;
+    }
+  }
+
+  /*----------
+  // body
+  */
+
+  nblocks = len / 4;
+  blocks = (const uint32_t *)data;
+
+  for(i = 0; i < nblocks; i++)
+  {
+    state->h1 = mix_block_32(state->h1, getblock_32(blocks,i));
+  }
+
+  /*----------
+  // hold back tail
+  */
+
+  data += nblocks*4;
+  for(i = 0; i < (len & 3); i++)
+  {
+    state->tail.bytes[state->tail_len++] = data[i];
+  }
+}
+
+#ifdef __cplusplus
+extern "C"
+#endif
+void MurmurHash3_x86_32_final ( MurmurHash3_x86_32_state * state,
+                                void * out )
+{
+  const uint8_t * tail = state->tail.bytes;
+  uint32_t h1 = state->h1;
+  uint32_t k1 = 0;
+
+  const uint32_t c1 = 0xcc9e2d51;
+  const uint32_t c2 = 0x1b873593;
+
+  switch(state->tail_len)
+  {
+  case 3: k1 ^= tail[2] << 16;
+  case 2: k1 ^= tail[1] << 8;
+  case 1: k1 ^= tail[0];
+          k1 *= c1; k1 = ROTL32(k1,15); k1 *= c2; h1 ^= k1;
+  };
+
+  h1 ^= state->len;
+
+  h1 = fmix_32(h1);
+
+  *(uint32_t*)out = h1;
+}
+
 /*-----------------------------------------------------------------------------*/
 
 #ifdef __cplusplus
@@ -34,6 +34,24 @@ void MurmurHash3_x86_32  ( const void * key, int len, uint32_t seed, void * out
 void MurmurHash3_x86_128 ( const void * key, int len, uint32_t seed, void * out );
 void MurmurHash3_x64_128 ( const void * key, int len, uint32_t seed, void * out );
 
+/*-----------------------------------------------------------------------------
+// Streaming MurmurHash3_x86_32. Feeding a key through any number of
+// update calls gives the same hash as MurmurHash3_x86_32 on the whole key. */
+
+typedef struct {
+  uint32_t h1;
+  uint32_t len;
+  union {
+    uint32_t block;
+    uint8_t bytes[4];
+  } tail;
+  int tail_len;
+} MurmurHash3_x86_32_state;
+
+void MurmurHash3_x86_32_init   ( MurmurHash3_x86_32_state * state, uint32_t seed );
+void MurmurHash3_x86_32_update ( MurmurHash3_x86_32_state * state, const void * key, int len );
+void MurmurHash3_x86_32_final  ( MurmurHash3_x86_32_state * state, void * out );
+
 #ifdef __cplusplus
 }
 #endif
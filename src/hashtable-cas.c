@@ -0,0 +1,646 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <memory.h>
+#include <stdint.h>
+
+#include "config.h"
+
+#define __HT_INTERNAL
+#include "hashtable-cas.h"
+#include "MurmurHash3.h"
+
+#ifdef USE_PTHREAD
+#include <sched.h>
+#define HT_CAS_YIELD() sched_yield()
+#else
+#define HT_CAS_YIELD()
+#endif
+
+/* Slot word for entry i (0 based) of hash, and its parts */
+#define HT_CAS_WORD(hash, i) (((uint64_t)(hash) << 32) | ((uint64_t)(i) + 1))
+#define HT_CAS_HASH(word) ((uint32_t)((word) >> 32))
+#define HT_CAS_INDEX(word) ((uint32_t)(word) - 1)
+
+/* Slots moved to the next array. No entry index goes with them. */
+#define HT_CAS_MOVED_EMPTY ((uint64_t)1 << 32)
+#define HT_CAS_MOVED_FULL ((uint64_t)2 << 32)
+#define HT_CAS_MOVED(word) ((word) != 0 && (uint32_t)(word) == 0)
+
+/**
+* Get entry "index" from the segment holding it.
+*
+* @param    struct htable_cas *table
+* @param    uint32_t index
+* @return   struct htable_entry *
+**/
+static HT_STRUCT(htable_entry) *
+htable_cas_entry(
+    HT_STRUCT(htable_cas) *table,
+    uint32_t index
+) {
+    uint32_t base = table->first->capacity,
+             quot = index / base,
+             level = 0;
+    
+    /* Segment n > 0 starts at base << (n - 1) */
+    while (quot) {
+        level += 1;
+        quot >>= 1;
+    }
+    
+    if (level == 0) {
+        return &table->segments[0][index];
+    }
+    
+    return &HT_LOAD_ACQUIRE(table->segments[level])[index - (base << (level - 1))];
+}
+
+/**
+* Check whether published entry ent holds key.
+*
+* @param    struct htable_cas *table
+* @param    struct htable_entry *ent
+* @param    uint32_t key_size
+* @param    void *key
+* @return   int, non-zero if equal
+**/
+static int
+htable_cas_key_equal(
+    HT_STRUCT(htable_cas) *table,
+    HT_STRUCT(htable_entry) *ent,
+    uint32_t key_size,
+    void *key
+) {
+    if (ent->key_size != key_size) {
+        return 0;
+    }
+    
+    if (table->flags & HT_FLAG_MEMCMP) {
+        return memcmp(key, ent->key, key_size) == 0;
+    }
+    
+    return table->cmpfn(key, ent->key) == 0;
+}
+
+/**
+* Give back entry ent, which lost the race for its key. Its index can't
+* be handed out again, as another thread may have taken a later one.
+*
+* @param    struct htable_cas *table
+* @param    struct htable_entry *ent
+* @return   void
+**/
+static void
+htable_cas_discard(
+    HT_STRUCT(htable_cas) *table,
+    HT_STRUCT(htable_entry) *ent
+) {
+    if (table->copyfn != NULL && table->freefn != NULL) {
+        /* Never published, free the copy now */
+        table->freefn(ent);
+    }
+    
+    HT_ATOMIC_INC(table->wasted);
+}
+
+/**
+* Allocate an empty slot array.
+*
+* @param    uint32_t size
+* @param    uint32_t capacity
+* @param    uint32_t level
+* @return   struct htable_cas_array *
+*               NULL on error
+**/
+static HT_STRUCT(htable_cas_array) *
+htable_cas_array_new(
+    uint32_t size,
+    uint32_t capacity,
+    uint32_t level
+) {
+    HT_STRUCT(htable_cas_array) *array;
+    
+    array = malloc(sizeof(*array));
+    if (!array) {
+        return NULL;
+    }
+    
+    memset(array, 0, sizeof(*array));
+    array->size = size;
+    array->capacity = capacity;
+    array->level = level;
+    
+    array->slots = calloc(size, sizeof(*array->slots));
+    if (!array->slots) {
+        free(array);
+        return NULL;
+    }
+    
+    return array;
+}
+
+/**
+* Put slot word into array, which only movers are writing to yet, so
+* there's no need to compare keys.
+*
+* @param    struct htable_cas_array *array
+* @param    uint64_t word
+* @return   void
+**/
+static void
+htable_cas_put(
+    HT_STRUCT(htable_cas_array) *array,
+    uint64_t word
+) {
+    uint32_t slot = HT_CAS_HASH(word) % array->size,
+             step = 0;
+    
+    while (!HT_ATOMIC_CAS(array->slots[slot], (uint64_t)0, word)) {
+        step += 1;
+        slot = (slot + step) % array->size;
+    }
+}
+
+/**
+* Move one chunk of slots from array to array->next. Free slots are
+* marked first, so no insert can land in them afterwards. Full ones are
+* marked once their copy is in place.
+*
+* @param    struct htable_cas_array *array
+* @param    uint32_t chunk
+* @return   void
+**/
+static void
+htable_cas_move(
+    HT_STRUCT(htable_cas_array) *array,
+    uint32_t chunk
+) {
+    uint32_t i = chunk * HT_CAS_CHUNK,
+             end = i + HT_CAS_CHUNK;
+    uint64_t word;
+    
+    HT_STRUCT(htable_cas_array) *next = HT_LOAD_ACQUIRE(array->next);
+    
+    if (end > array->size) {
+        end = array->size;
+    }
+    
+    for (; i < end; i++) {
+        word = HT_LOAD_ACQUIRE(array->slots[i]);
+        
+        if (word == 0) {
+            if (HT_ATOMIC_CAS(array->slots[i], (uint64_t)0, HT_CAS_MOVED_EMPTY)) {
+                continue;
+            }
+            
+            /* An insert got there first */
+            word = HT_LOAD_ACQUIRE(array->slots[i]);
+        }
+        
+        htable_cas_put(next, word);
+        HT_STORE_RELEASE(array->slots[i], HT_CAS_MOVED_FULL);
+    }
+}
+
+/**
+* Help move array to array->next, a chunk at a time, until there are no
+* chunks left, then wait for the other helpers to finish theirs. The
+* thread finishing the last chunk switches the table over.
+*
+* @param    struct htable_cas *table
+* @param    struct htable_cas_array *array
+* @return   void
+**/
+static void
+htable_cas_help(
+    HT_STRUCT(htable_cas) *table,
+    HT_STRUCT(htable_cas_array) *array
+) {
+    uint32_t chunk,
+             chunks = (array->size + HT_CAS_CHUNK - 1) / HT_CAS_CHUNK;
+    
+    HT_STRUCT(htable_cas_array) *next = HT_LOAD_ACQUIRE(array->next);
+    
+    while (HT_LOAD_ACQUIRE(array->claimed) < chunks) {
+        chunk = HT_ATOMIC_INC(array->claimed) - 1;
+        if (chunk >= chunks) {
+            break;
+        }
+        
+        htable_cas_move(array, chunk);
+        
+        if (HT_ATOMIC_INC(array->moved) == chunks) {
+            /* Everything's moved, send inserts to the new array */
+            HT_STORE_RELEASE(table->capacity, next->capacity);
+            HT_STORE_RELEASE(table->array, next);
+        }
+    }
+    
+    while (HT_LOAD_ACQUIRE(table->array) == array) {
+        HT_CAS_YIELD();
+    }
+}
+
+/**
+* Start moving array to one twice the size, unless another thread
+* already has, and help until it's done.
+*
+* @param    struct htable_cas *table
+* @param    struct htable_cas_array *array
+* @return   int, 0 on error (out of memory or too big)
+**/
+static int
+htable_cas_grow(
+    HT_STRUCT(htable_cas) *table,
+    HT_STRUCT(htable_cas_array) *array
+) {
+    uint32_t level = array->level + 1;
+    
+    HT_STRUCT(htable_entry) *segment;
+    HT_STRUCT(htable_cas_array) *next;
+    
+    if (HT_LOAD_ACQUIRE(array->next) == NULL) {
+        if (level >= HT_CAS_LEVELS || array->size > 0x7fffffff) {
+            return 0;
+        }
+        
+        /* Room for the entries the new array can take, before anyone
+           can insert into it */
+        if (HT_LOAD_ACQUIRE(table->segments[level]) == NULL) {
+            segment = calloc(array->capacity, sizeof(*segment));
+            if (!segment) {
+                return 0;
+            }
+            
+            if (!HT_ATOMIC_CAS(table->segments[level],
+                               (HT_STRUCT(htable_entry) *)NULL, segment)) {
+                free(segment);
+            }
+        }
+        
+        next = htable_cas_array_new(array->size * 2, array->capacity * 2, level);
+        if (!next) {
+            return 0;
+        }
+        
+        if (!HT_ATOMIC_CAS(array->next, (HT_STRUCT(htable_cas_array) *)NULL, next)) {
+            free(next->slots);
+            free(next);
+        }
+    }
+    
+    htable_cas_help(table, array);
+    return 1;
+}
+
+/**
+* htable_cas_new()
+*
+* Create a new lock-free table of "size" slots. It doubles in size each
+* time HT_MAX_LOAD percent of its slots are used. See htable_new_ex().
+*
+* @param    uint32_t size
+* @param    uint32_t seed
+* @param    htable_cmpfn cmpfn
+* @param    htable_copyfn copyfn
+*               - Called before the entry is published. Only the
+*                 winner's copy is kept if threads race on one key, the
+*                 others are passed to freefn right away.
+* @param    htable_freefn freefn
+* @param    uint32_t flags
+*               - HT_FLAG_SET and HT_FLAG_MEMCMP only
+* @return   struct htable_cas *
+*               NULL on error
+**/
+HT_STRUCT(htable_cas) *
+HT_EXPORT(htable_cas_new)
+HT_ARGS((
+    uint32_t size,
+    uint32_t random_seed,
+    HT_EXPORT(htable_cmpfn) cmpfn,
+    HT_EXPORT(htable_copyfn) copyfn,
+    HT_EXPORT(htable_freefn) freefn,
+    uint32_t flags
+)) {
+    HT_STRUCT(htable_cas) *table;
+    
+    if (    (flags & ~(HT_FLAG_SET | HT_FLAG_MEMCMP)) ||
+            (cmpfn == NULL && !(flags & HT_FLAG_MEMCMP)) ||
+            size < HT_MIN_SIZE) {
+        return NULL;
+    }
+    
+    table = malloc(sizeof(*table));
+    if (!table) {
+        return NULL;
+    }
+    
+    memset(table, 0, sizeof(*table));
+    table->seed = random_seed;
+    table->flags = flags;
+    table->copyfn = copyfn;
+    table->freefn = freefn;
+    table->cmpfn = cmpfn;
+    
+    table->first = htable_cas_array_new(size,
+                        (uint32_t)((uint64_t)size * HT_MAX_LOAD / 100), 0);
+    
+    if (!table->first) {
+        free(table);
+        return NULL;
+    }
+    
+    table->array = table->first;
+    table->capacity = table->first->capacity;
+    table->segments[0] = calloc(table->capacity, sizeof(*table->segments[0]));
+    
+    if (!table->segments[0]) {
+        free(table->first->slots);
+        free(table->first);
+        free(table);
+        return NULL;
+    }
+    
+    return table;
+}
+
+/**
+* htable_cas_delete()
+*
+* Delete table. No other thread may be using it.
+*
+* @param    struct htable_cas *table
+* @return   void
+**/
+void
+HT_EXPORT(htable_cas_delete)
+HT_ARGS((
+    HT_STRUCT(htable_cas) *table
+)) {
+    uint32_t i;
+    uint64_t word;
+    
+    HT_STRUCT(htable_cas_array) *array, *next;
+    
+    if (table->freefn != NULL) {
+        array = table->array;
+        
+        for (i = 0; i < array->size; i++) {
+            word = array->slots[i];
+            if (word != 0) {
+                /* Call freefn() */
+                table->freefn(htable_cas_entry(table, HT_CAS_INDEX(word)));
+            }
+        }
+    }
+    
+    for (array = table->first; array != NULL; array = next) {
+        next = array->next;
+        free(array->slots);
+        free(array);
+    }
+    
+    for (i = 0; i < HT_CAS_LEVELS; i++) {
+        free(table->segments[i]);
+    }
+    
+    free(table);
+}
+
+/**
+* htable_cas_find_or_insert()
+*
+* Get the entry for key, inserting key and data if it's not there. Safe
+* to call from any number of threads at once: exactly one of the threads
+* racing to insert a key wins, and all of them get the winner's entry.
+* The entry must not be modified, other than through atomic operations
+* on its data. A thread that finds the table resizing helps move slots,
+* and waits for the move to finish, before inserting.
+*
+* @param    struct htable_cas *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+* @param    void *data
+*               - Only used if the key is inserted
+* @param    int *inserted
+*               - Set to 1 if key was inserted, 0 if it existed.
+*                 May be NULL.
+*
+* @return   NULL on error (out of memory), pointer to
+*           the existing or new entry on success
+**/
+HT_STRUCT(htable_entry) *
+HT_EXPORT(htable_cas_find_or_insert)
+HT_ARGS((
+    HT_STRUCT(htable_cas) *table,
+    uint32_t key_size,
+    void *key,
+    void *data,
+    int *inserted
+)) {
+    
+    uint32_t hash, slot, index, step;
+    uint64_t word;
+    int have_entry = 0;
+    
+    HT_STRUCT(htable_cas_array) *array;
+    HT_STRUCT(htable_entry) *ent = NULL;
+    
+    if (inserted != NULL) {
+        *inserted = 0;
+    }
+    
+    /* Get initial hash */
+    MurmurHash3_x86_32(key, key_size, table->seed, &hash);
+    
+    for (;;) {
+        array = HT_LOAD_ACQUIRE(table->array);
+        
+        if (HT_LOAD_ACQUIRE(array->next) != NULL) {
+            /* Resizing, inserts have to wait for the new array */
+            htable_cas_help(table, array);
+            continue;
+        }
+        
+        slot = hash % array->size;
+        step = 0;
+        
+        while (step < array->size) {
+            word = HT_LOAD_ACQUIRE(array->slots[slot]);
+            
+            if (word == 0) {
+                if (!have_entry) {
+                    /* Fill in an entry before trying to publish it. It's
+                       kept across slots lost to other keys. */
+                    index = HT_ATOMIC_INC(table->next) - 1;
+                    
+                    while (index >= HT_LOAD_ACQUIRE(table->capacity)) {
+                        if (!htable_cas_grow(table, HT_LOAD_ACQUIRE(table->array))) {
+                            HT_ATOMIC_INC(table->wasted);
+                            return NULL;
+                        }
+                    }
+                    
+                    ent = htable_cas_entry(table, index);
+                    
+                    ent->key_size = key_size;
+                    ent->entry = index;
+                    
+                    if (table->copyfn != NULL) {
+                        table->copyfn(ent, key,
+                                      (table->flags & HT_FLAG_SET) ? NULL : data);
+                    } else {
+                        ent->key = key;
+                        ent->data = (table->flags & HT_FLAG_SET) ? NULL : data;
+                    }
+                    
+                    have_entry = 1;
+                    
+                    if (HT_LOAD_ACQUIRE(table->array) != array) {
+                        /* Grew to make room, start over */
+                        break;
+                    }
+                }
+                
+                /* Full barrier: the entry is complete before it's visible */
+                if (HT_ATOMIC_CAS(array->slots[slot], (uint64_t)0,
+                                  HT_CAS_WORD(hash, ent->entry))) {
+                    HT_ATOMIC_INC(table->used);
+                    if (inserted != NULL) {
+                        *inserted = 1;
+                    }
+                    
+                    return ent;
+                }
+                
+                /* Lost the slot, check who took it */
+                word = HT_LOAD_ACQUIRE(array->slots[slot]);
+            }
+            
+            if (HT_CAS_MOVED(word)) {
+                /* Resize started, start over */
+                break;
+            }
+            
+            if (    HT_CAS_HASH(word) == hash &&
+                    htable_cas_key_equal(table,
+                        htable_cas_entry(table, HT_CAS_INDEX(word)),
+                        key_size, key)) {
+                if (have_entry) {
+                    htable_cas_discard(table, ent);
+                }
+                
+                return htable_cas_entry(table, HT_CAS_INDEX(word));
+            }
+            
+            step += 1;
+            slot = (slot + step) % array->size;
+        }
+        
+        if (step == array->size && !htable_cas_grow(table, array)) {
+            /* Probed every slot, and can't grow */
+            if (have_entry) {
+                htable_cas_discard(table, ent);
+            }
+            
+            return NULL;
+        }
+    }
+}
+
+/**
+* htable_cas_add()
+*
+* Add item to table, if the key isn't there yet. Unlike htable_add(), an
+* existing entry is kept as is. See htable_cas_find_or_insert().
+*
+* @param    struct htable_cas *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+* @param    void *data
+*
+* @return   0 on error, 1 on success
+**/
+int
+HT_EXPORT(htable_cas_add)
+HT_ARGS((
+    HT_STRUCT(htable_cas) *table,
+    uint32_t key_size,
+    void *key,
+    void *data
+)) {
+    return HT_EXPORT(htable_cas_find_or_insert)(table, key_size, key, data, NULL) != NULL;
+}
+
+/**
+* htable_cas_get()
+*
+* Get entry from table, without locks. Safe alongside inserts, and
+* resizes, which it doesn't wait for.
+*
+* @param    struct htable_cas *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+*
+* @return   NULL on error, pointer on success
+**/
+HT_STRUCT(htable_entry) *
+HT_EXPORT(htable_cas_get)
+HT_ARGS((
+    HT_STRUCT(htable_cas) *table,
+    uint32_t key_size,
+    void *key
+)) {
+    
+    uint32_t hash, slot, step;
+    uint64_t word;
+    int moved;
+    
+    HT_STRUCT(htable_cas_array) *array;
+    
+    /* Get initial hash */
+    MurmurHash3_x86_32(key, key_size, table->seed, &hash);
+    array = HT_LOAD_ACQUIRE(table->array);
+    
+    for (;;) {
+        slot = hash % array->size;
+        step = 0;
+        moved = 0;
+        
+        while (step < array->size) {
+            word = HT_LOAD_ACQUIRE(array->slots[slot]);
+            
+            if (word == 0 || word == HT_CAS_MOVED_EMPTY) {
+                /* Slots are never freed, so this ends the chain */
+                moved |= (word != 0);
+                break;
+            }
+            
+            if (word == HT_CAS_MOVED_FULL) {
+                moved = 1;
+            } else if ( HT_CAS_HASH(word) == hash &&
+                        htable_cas_key_equal(table,
+                            htable_cas_entry(table, HT_CAS_INDEX(word)),
+                            key_size, key)) {
+                return htable_cas_entry(table, HT_CAS_INDEX(word));
+            }
+            
+            step += 1;
+            slot = (slot + step) % array->size;
+        }
+        
+        if (!moved) {
+            return NULL;
+        }
+        
+        /* Part of the chain has been moved, it's in the next array */
+        array = HT_LOAD_ACQUIRE(array->next);
+    }
+}
@@ -0,0 +1,206 @@
+#pragma once
+#include "hashtable.h"
+
+/* hashtable.h drops its export macros at the end, outside the library */
+#ifdef __HT_INTERNAL
+  #define HT_EXTERN
+#else
+  #define HT_EXTERN extern
+#endif
+
+#ifndef HT_EXPORT
+    #define HT_EXPORT(SYM) SYM
+#endif
+
+#define HT_ARGS(SYM) SYM
+
+/* Slot array generations, and so entry segments, a table can grow to */
+#ifndef HT_CAS_LEVELS
+    #define HT_CAS_LEVELS 32
+#endif
+
+/* Slots moved at a time by each thread helping with a resize */
+#ifndef HT_CAS_CHUNK
+    #define HT_CAS_CHUNK 256
+#endif
+
+/* Lock-free insert-only table, for many threads adding to and reading
+   from the same table. Each slot is one 64 bit word: the key's hash in
+   the high half, and the index of its entry plus one in the low half,
+   or 0 if the slot is free. A thread inserts by filling in a fresh entry
+   first, then claiming a free slot with compare-and-swap. The swap is a
+   full barrier, and readers load slots with acquire ordering, so an
+   entry's key and data are complete before anyone can see it. Entries
+   never move or change once published (until the table is deleted), so
+   pointers to them stay valid. */
+
+/* One generation of slots. When it fills up, a slot array twice the
+   size is linked in as "next", and every thread inserting into the
+   table helps move slots over, HT_CAS_CHUNK at a time, claiming chunks
+   with "claimed" and counting finished ones in "moved". Moved slots are
+   marked, so inserts into them fail and readers know to look in "next".
+   Old generations are kept until the table is deleted, readers may
+   still be in them. */
+struct HT_EXPORT(htable_cas_array) {
+    uint64_t *slots;
+    uint32_t size;
+    uint32_t capacity;
+    uint32_t claimed;
+    uint32_t moved;
+    uint32_t level;
+    struct HT_EXPORT(htable_cas_array) *next;
+};
+
+/* "array" is the slot array inserts go to. Entries live in segments that
+   are added as the table grows: segments[0] holds as many as the first
+   slot array has room for, and each later one as many as all before
+   it. "capacity" is the number of entries the current slot array has
+   room for.
+   "next" is the number of entries handed out, "used" the number
+   published. Entries lost to a concurrent insert of the same key are
+   counted in "wasted". */
+struct HT_EXPORT(htable_cas) {
+    struct HT_EXPORT(htable_cas_array) *array;
+    struct HT_EXPORT(htable_cas_array) *first;
+    struct HT_EXPORT(htable_entry) *segments[HT_CAS_LEVELS];
+    uint32_t capacity;
+    uint32_t next;
+    uint32_t used;
+    uint32_t wasted;
+    uint32_t seed;
+    uint32_t flags;
+    
+    HT_EXPORT(htable_copyfn) copyfn;
+    HT_EXPORT(htable_freefn) freefn;
+    HT_EXPORT(htable_cmpfn) cmpfn;
+};
+
+/**
+* htable_cas_new()
+*
+* Create a new lock-free table of "size" slots. It doubles in size each
+* time HT_MAX_LOAD percent of its slots are used. See htable_new_ex().
+*
+* @param    uint32_t size
+* @param    uint32_t seed
+* @param    htable_cmpfn cmpfn
+* @param    htable_copyfn copyfn
+*               - Called before the entry is published. Only the
+*                 winner's copy is kept if threads race on one key, the
+*                 others are passed to freefn right away.
+* @param    htable_freefn freefn
+* @param    uint32_t flags
+*               - HT_FLAG_SET and HT_FLAG_MEMCMP only
+* @return   struct htable_cas *
+*               NULL on error
+**/
+HT_EXTERN struct HT_EXPORT(htable_cas) *
+HT_EXPORT(htable_cas_new)
+HT_ARGS((
+    uint32_t size,
+    uint32_t random_seed,
+    HT_EXPORT(htable_cmpfn) cmpfn,
+    HT_EXPORT(htable_copyfn) copyfn,
+    HT_EXPORT(htable_freefn) freefn,
+    uint32_t flags
+));
+
+/**
+* htable_cas_delete()
+*
+* Delete table. No other thread may be using it.
+*
+* @param    struct htable_cas *table
+* @return   void
+**/
+HT_EXTERN void
+HT_EXPORT(htable_cas_delete)
+HT_ARGS((
+    struct HT_EXPORT(htable_cas) *table
+));
+
+/**
+* htable_cas_find_or_insert()
+*
+* Get the entry for key, inserting key and data if it's not there. Safe
+* to call from any number of threads at once: exactly one of the threads
+* racing to insert a key wins, and all of them get the winner's entry.
+* The entry must not be modified, other than through atomic operations
+* on its data. A thread that finds the table resizing helps move slots,
+* and waits for the move to finish, before inserting.
+*
+* @param    struct htable_cas *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+* @param    void *data
+*               - Only used if the key is inserted
+* @param    int *inserted
+*               - Set to 1 if key was inserted, 0 if it existed.
+*                 May be NULL.
+*
+* @return   NULL on error (out of memory), pointer to
+*           the existing or new entry on success
+**/
+HT_EXTERN struct HT_EXPORT(htable_entry) *
+HT_EXPORT(htable_cas_find_or_insert)
+HT_ARGS((
+    struct HT_EXPORT(htable_cas) *table,
+    uint32_t key_size,
+    void *key,
+    void *data,
+    int *inserted
+));
+
+/**
+* htable_cas_add()
+*
+* Add item to table, if the key isn't there yet. Unlike htable_add(), an
+* existing entry is kept as is. See htable_cas_find_or_insert().
+*
+* @param    struct htable_cas *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+* @param    void *data
+*
+* @return   0 on error, 1 on success
+**/
+HT_EXTERN int
+HT_EXPORT(htable_cas_add)
+HT_ARGS((
+    struct HT_EXPORT(htable_cas) *table,
+    uint32_t key_size,
+    void *key,
+    void *data
+));
+
+/**
+* htable_cas_get()
+*
+* Get entry from table, without locks. Safe alongside inserts, and
+* resizes, which it doesn't wait for.
+*
+* @param    struct htable_cas *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+*
+* @return   NULL on error, pointer on success
+**/
+HT_EXTERN struct HT_EXPORT(htable_entry) *
+HT_EXPORT(htable_cas_get)
+HT_ARGS((
+    struct HT_EXPORT(htable_cas) *table,
+    uint32_t key_size,
+    void *key
+));
+
+#ifndef __HT_INTERNAL
+  #undef HT_EXTERN
+  #undef HT_ARGS
+  #undef HT_EXPORT
+#endif
@@ -0,0 +1,889 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <memory.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include "config.h"
+
+#define __HT_INTERNAL
+#include "hashtable-hamt.h"
+#include "MurmurHash3.h"
+
+/* Hash bits consumed per trie level */
+#define HT_HAMT_BITS 5
+#define HT_HAMT_MASK ((1 << HT_HAMT_BITS) - 1)
+
+/* Depth at which all 32 hash bits are used up. Nodes at that depth are
+   collision nodes: a plain list of leaves with equal hashes. */
+#define HT_HAMT_MAX_DEPTH ((32 + HT_HAMT_BITS - 1) / HT_HAMT_BITS)
+
+/* Position of hash in a node at depth, and its bit in the node maps */
+#define HT_HAMT_POS(hash, depth) \
+    (((hash) >> ((depth) * HT_HAMT_BITS)) & HT_HAMT_MASK)
+#define HT_HAMT_BIT(pos) ((uint32_t)1 << (pos))
+
+/* Entry, shared by every node (of every version) that holds it */
+struct htable_hamt_leaf {
+    uint32_t refs;
+    uint32_t hash;
+    HT_STRUCT(htable_entry) ent;
+};
+
+/* Trie node. "child" holds the leaves, in position order, followed by
+   the sub-nodes, in position order. Collision nodes have empty maps,
+   and "count" leaves. */
+struct HT_EXPORT(htable_hamt_node) {
+    uint32_t refs;
+    uint32_t datamap;
+    uint32_t nodemap;
+    uint32_t count;
+    void *child[1];
+};
+
+/* Node unpacked by position, for editing. See htable_hamt_pack(). */
+struct htable_hamt_edit {
+    uint32_t datamap;
+    uint32_t nodemap;
+    void *child[1 << HT_HAMT_BITS];
+};
+
+/**
+* Number of bits set in x.
+*
+* @param    uint32_t x
+* @return   uint32_t
+**/
+static uint32_t
+htable_hamt_popcount(
+    uint32_t x
+) {
+#if defined(__GNUC__)
+    return __builtin_popcount(x);
+#else
+    x = x - ((x >> 1) & 0x55555555);
+    x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+    x = (x + (x >> 4)) & 0x0F0F0F0F;
+    
+    return (x * 0x01010101) >> 24;
+#endif
+}
+
+/**
+* Number of leaves in node at depth.
+*
+* @param    struct htable_hamt_node *node
+* @param    uint32_t depth
+* @return   uint32_t
+**/
+static uint32_t
+htable_hamt_leaves(
+    HT_STRUCT(htable_hamt_node) *node,
+    uint32_t depth
+) {
+    if (depth == HT_HAMT_MAX_DEPTH) {
+        return node->count;
+    }
+    
+    return htable_hamt_popcount(node->datamap);
+}
+
+/**
+* Allocate a node with room for count children, and one reference.
+*
+* @param    uint32_t count
+* @return   struct htable_hamt_node *, NULL on error
+**/
+static HT_STRUCT(htable_hamt_node) *
+htable_hamt_node_alloc(
+    uint32_t count
+) {
+    HT_STRUCT(htable_hamt_node) *node;
+    
+    node = malloc(offsetof(HT_STRUCT(htable_hamt_node), child) +
+                  sizeof(node->child[0]) * count);
+    
+    if (!node) {
+        return NULL;
+    }
+    
+    node->refs = 1;
+    node->datamap = 0;
+    node->nodemap = 0;
+    node->count = count;
+    
+    return node;
+}
+
+/**
+* Drop a reference to leaf, calling freefn and freeing it with the last.
+*
+* @param    struct htable_hamt *hamt
+* @param    struct htable_hamt_leaf *leaf
+* @return   void
+**/
+static void
+htable_hamt_leaf_release(
+    HT_STRUCT(htable_hamt) *hamt,
+    struct htable_hamt_leaf *leaf
+) {
+    if (HT_ATOMIC_DEC(leaf->refs) != 0) {
+        return;
+    }
+    
+    if (hamt->freefn != NULL) {
+        /* Call freefn() */
+        hamt->freefn(&leaf->ent);
+    }
+    
+    free(leaf);
+}
+
+/**
+* Drop a reference to node at depth, releasing its children and freeing
+* it with the last.
+*
+* @param    struct htable_hamt *hamt
+* @param    struct htable_hamt_node *node
+* @param    uint32_t depth
+* @return   void
+**/
+static void
+htable_hamt_node_release(
+    HT_STRUCT(htable_hamt) *hamt,
+    HT_STRUCT(htable_hamt_node) *node,
+    uint32_t depth
+) {
+    uint32_t i, leaves;
+    
+    if (HT_ATOMIC_DEC(node->refs) != 0) {
+        return;
+    }
+    
+    leaves = htable_hamt_leaves(node, depth);
+    for (i = 0; i < node->count; i++) {
+        if (i < leaves) {
+            htable_hamt_leaf_release(hamt, node->child[i]);
+        } else {
+            htable_hamt_node_release(hamt, node->child[i], depth + 1);
+        }
+    }
+    
+    free(node);
+}
+
+/**
+* Unpack branch node (NULL for an empty one) by position.
+*
+* @param    struct htable_hamt_node *node
+* @param    struct htable_hamt_edit *edit
+* @return   void
+**/
+static void
+htable_hamt_unpack(
+    HT_STRUCT(htable_hamt_node) *node,
+    struct htable_hamt_edit *edit
+) {
+    uint32_t pos, leaf = 0, sub;
+    
+    edit->datamap = 0;
+    edit->nodemap = 0;
+    
+    if (node == NULL) {
+        return;
+    }
+    
+    edit->datamap = node->datamap;
+    edit->nodemap = node->nodemap;
+    sub = htable_hamt_popcount(node->datamap);
+    
+    for (pos = 0; pos <= HT_HAMT_MASK; pos++) {
+        if (node->datamap & HT_HAMT_BIT(pos)) {
+            edit->child[pos] = node->child[leaf++];
+        } else if (node->nodemap & HT_HAMT_BIT(pos)) {
+            edit->child[pos] = node->child[sub++];
+        }
+    }
+}
+
+/**
+* Pack edit into a new branch node, taking a reference to every child.
+* Callers drop the references to children they created themselves.
+*
+* @param    struct htable_hamt_edit *edit
+* @return   struct htable_hamt_node *, NULL on error
+**/
+static HT_STRUCT(htable_hamt_node) *
+htable_hamt_pack(
+    struct htable_hamt_edit *edit
+) {
+    uint32_t pos, leaf = 0, sub;
+    
+    HT_STRUCT(htable_hamt_node) *node;
+    
+    node = htable_hamt_node_alloc(
+                htable_hamt_popcount(edit->datamap) +
+                htable_hamt_popcount(edit->nodemap));
+    
+    if (!node) {
+        return NULL;
+    }
+    
+    node->datamap = edit->datamap;
+    node->nodemap = edit->nodemap;
+    sub = htable_hamt_popcount(edit->datamap);
+    
+    for (pos = 0; pos <= HT_HAMT_MASK; pos++) {
+        if (edit->datamap & HT_HAMT_BIT(pos)) {
+            node->child[leaf++] = edit->child[pos];
+            HT_ATOMIC_INC(((struct htable_hamt_leaf *)edit->child[pos])->refs);
+        } else if (edit->nodemap & HT_HAMT_BIT(pos)) {
+            node->child[sub++] = edit->child[pos];
+            HT_ATOMIC_INC(((HT_STRUCT(htable_hamt_node) *)edit->child[pos])->refs);
+        }
+    }
+    
+    return node;
+}
+
+/**
+* Check whether leaf holds key.
+*
+* @param    struct htable_hamt *hamt
+* @param    struct htable_hamt_leaf *leaf
+* @param    uint32_t hash
+* @param    uint32_t key_size
+* @param    void *key
+* @return   int, non-zero if equal
+**/
+static int
+htable_hamt_key_equal(
+    HT_STRUCT(htable_hamt) *hamt,
+    struct htable_hamt_leaf *leaf,
+    uint32_t hash,
+    uint32_t key_size,
+    void *key
+) {
+    return  leaf->hash == hash &&
+            leaf->ent.key_size == key_size &&
+            hamt->cmpfn(key, leaf->ent.key) == 0;
+}
+
+/**
+* Build a node at depth holding leaves a and b, which have different
+* keys, but the same hash bits down to depth.
+*
+* @param    struct htable_hamt_leaf *a
+* @param    struct htable_hamt_leaf *b
+* @param    uint32_t depth
+* @return   struct htable_hamt_node *, NULL on error
+**/
+static HT_STRUCT(htable_hamt_node) *
+htable_hamt_merge(
+    HT_STRUCT(htable_hamt) *hamt,
+    struct htable_hamt_leaf *a,
+    struct htable_hamt_leaf *b,
+    uint32_t depth
+) {
+    uint32_t pa, pb;
+    
+    struct htable_hamt_edit edit;
+    HT_STRUCT(htable_hamt_node) *node, *sub;
+    
+    if (depth == HT_HAMT_MAX_DEPTH) {
+        node = htable_hamt_node_alloc(2);
+        if (!node) {
+            return NULL;
+        }
+        
+        node->child[0] = a;
+        node->child[1] = b;
+        HT_ATOMIC_INC(a->refs);
+        HT_ATOMIC_INC(b->refs);
+        
+        return node;
+    }
+    
+    pa = HT_HAMT_POS(a->hash, depth);
+    pb = HT_HAMT_POS(b->hash, depth);
+    
+    if (pa != pb) {
+        edit.datamap = HT_HAMT_BIT(pa) | HT_HAMT_BIT(pb);
+        edit.nodemap = 0;
+        edit.child[pa] = a;
+        edit.child[pb] = b;
+        
+        return htable_hamt_pack(&edit);
+    }
+    
+    sub = htable_hamt_merge(hamt, a, b, depth + 1);
+    if (!sub) {
+        return NULL;
+    }
+    
+    edit.datamap = 0;
+    edit.nodemap = HT_HAMT_BIT(pa);
+    edit.child[pa] = sub;
+    
+    node = htable_hamt_pack(&edit);
+    htable_hamt_node_release(hamt, sub, depth + 1);
+    
+    return node;
+}
+
+/**
+* Copy of node at depth (NULL for an empty root) with leaf inserted,
+* replacing a leaf with the same key. node is not changed.
+*
+* @param    struct htable_hamt *hamt
+* @param    struct htable_hamt_node *node
+* @param    uint32_t depth
+* @param    struct htable_hamt_leaf *leaf
+* @param    void *key
+*               - Key of leaf, as passed by the caller
+* @param    int *added
+*               - Set to 1 if no leaf was replaced
+* @return   struct htable_hamt_node *, NULL on error
+**/
+static HT_STRUCT(htable_hamt_node) *
+htable_hamt_insert_node(
+    HT_STRUCT(htable_hamt) *hamt,
+    HT_STRUCT(htable_hamt_node) *node,
+    uint32_t depth,
+    struct htable_hamt_leaf *leaf,
+    void *key,
+    int *added
+) {
+    uint32_t i, pos, bit;
+    
+    struct htable_hamt_edit edit;
+    struct htable_hamt_leaf *old;
+    HT_STRUCT(htable_hamt_node) *copy,
+                                *sub = NULL;
+    
+    if (depth == HT_HAMT_MAX_DEPTH) {
+        /* Collision node: replace or append */
+        for (i = 0; i < node->count; i++) {
+            if (htable_hamt_key_equal(hamt, node->child[i], leaf->hash,
+                                      leaf->ent.key_size, key)) {
+                break;
+            }
+        }
+        
+        *added = (i == node->count);
+        copy = htable_hamt_node_alloc(node->count + *added);
+        if (!copy) {
+            return NULL;
+        }
+        
+        memcpy(copy->child, node->child, sizeof(node->child[0]) * node->count);
+        copy->child[i] = leaf;
+        
+        for (i = 0; i < copy->count; i++) {
+            HT_ATOMIC_INC(((struct htable_hamt_leaf *)copy->child[i])->refs);
+        }
+        
+        return copy;
+    }
+    
+    htable_hamt_unpack(node, &edit);
+    pos = HT_HAMT_POS(leaf->hash, depth);
+    bit = HT_HAMT_BIT(pos);
+    
+    if (edit.datamap & bit) {
+        old = edit.child[pos];
+        if (htable_hamt_key_equal(hamt, old, leaf->hash, leaf->ent.key_size, key)) {
+            *added = 0;
+            edit.child[pos] = leaf;
+        } else {
+            /* Push both leaves a level down */
+            sub = htable_hamt_merge(hamt, old, leaf, depth + 1);
+            if (!sub) {
+                return NULL;
+            }
+            
+            *added = 1;
+            edit.datamap ^= bit;
+            edit.nodemap |= bit;
+            edit.child[pos] = sub;
+        }
+    } else if (edit.nodemap & bit) {
+        sub = htable_hamt_insert_node(hamt, edit.child[pos], depth + 1, leaf, key, added);
+        if (!sub) {
+            return NULL;
+        }
+        
+        edit.child[pos] = sub;
+    } else {
+        *added = 1;
+        edit.datamap |= bit;
+        edit.child[pos] = leaf;
+    }
+    
+    copy = htable_hamt_pack(&edit);
+    if (sub != NULL) {
+        htable_hamt_node_release(hamt, sub, depth + 1);
+    }
+    
+    return copy;
+}
+
+/**
+* Copy of node at depth without key. node is not changed.
+*
+* @param    struct htable_hamt *hamt
+* @param    struct htable_hamt_node *node
+* @param    uint32_t depth
+* @param    uint32_t hash
+* @param    uint32_t key_size
+* @param    void *key
+* @param    struct htable_hamt_node **out
+*               - Receives the copy, NULL if it would be empty
+* @return   1 if removed, 0 if key was not found, -1 on error
+**/
+static int
+htable_hamt_remove_node(
+    HT_STRUCT(htable_hamt) *hamt,
+    HT_STRUCT(htable_hamt_node) *node,
+    uint32_t depth,
+    uint32_t hash,
+    uint32_t key_size,
+    void *key,
+    HT_STRUCT(htable_hamt_node) **out
+) {
+    uint32_t i, j, pos, bit;
+    int res;
+    
+    struct htable_hamt_edit edit;
+    HT_STRUCT(htable_hamt_node) *sub = NULL;
+    
+    *out = NULL;
+    
+    if (depth == HT_HAMT_MAX_DEPTH) {
+        for (i = 0; i < node->count; i++) {
+            if (htable_hamt_key_equal(hamt, node->child[i], hash, key_size, key)) {
+                break;
+            }
+        }
+        
+        if (i == node->count) {
+            return 0;
+        }
+        
+        if (node->count == 1) {
+            return 1;
+        }
+        
+        *out = htable_hamt_node_alloc(node->count - 1);
+        if (!*out) {
+            return -1;
+        }
+        
+        for (i = 0, j = 0; j < node->count; j++) {
+            if (!htable_hamt_key_equal(hamt, node->child[j], hash, key_size, key)) {
+                (*out)->child[i++] = node->child[j];
+                HT_ATOMIC_INC(((struct htable_hamt_leaf *)node->child[j])->refs);
+            }
+        }
+        
+        return 1;
+    }
+    
+    htable_hamt_unpack(node, &edit);
+    pos = HT_HAMT_POS(hash, depth);
+    bit = HT_HAMT_BIT(pos);
+    
+    if (edit.datamap & bit) {
+        if (!htable_hamt_key_equal(hamt, edit.child[pos], hash, key_size, key)) {
+            return 0;
+        }
+        
+        edit.datamap ^= bit;
+    } else if (edit.nodemap & bit) {
+        res = htable_hamt_remove_node(hamt, edit.child[pos], depth + 1,
+                                      hash, key_size, key, &sub);
+        if (res <= 0) {
+            return res;
+        }
+        
+        if (sub == NULL) {
+            edit.nodemap ^= bit;
+        } else if (sub->count == 1 && sub->nodemap == 0) {
+            /* Pull a lone leaf up, so the trie stays compact */
+            edit.nodemap ^= bit;
+            edit.datamap |= bit;
+            edit.child[pos] = sub->child[0];
+        } else {
+            edit.child[pos] = sub;
+        }
+    } else {
+        return 0;
+    }
+    
+    if (edit.datamap | edit.nodemap) {
+        *out = htable_hamt_pack(&edit);
+    }
+    
+    if (sub != NULL) {
+        htable_hamt_node_release(hamt, sub, depth + 1);
+    }
+    
+    if ((edit.datamap | edit.nodemap) && *out == NULL) {
+        return -1;
+    }
+    
+    return 1;
+}
+
+/**
+* Call fn for every entry under node at depth.
+*
+* @param    struct htable_hamt_node *node
+* @param    uint32_t depth
+* @param    htable_scanfn fn
+* @param    void *ctx
+* @return   void
+**/
+static void
+htable_hamt_foreach_node(
+    HT_STRUCT(htable_hamt_node) *node,
+    uint32_t depth,
+    HT_EXPORT(htable_scanfn) fn,
+    void *ctx
+) {
+    uint32_t i, leaves;
+    
+    leaves = htable_hamt_leaves(node, depth);
+    for (i = 0; i < node->count; i++) {
+        if (i < leaves) {
+            fn(&((struct htable_hamt_leaf *)node->child[i])->ent, ctx);
+        } else {
+            htable_hamt_foreach_node(node->child[i], depth + 1, fn, ctx);
+        }
+    }
+}
+
+/**
+* htable_hamt_new()
+*
+* Create a new, empty HAMT version. Keys are hashed with MurmurHash3
+* and compared with cmpfn, as in htable_new(). copyfn is called once per
+* inserted entry. freefn is called once the last version holding an
+* entry is deleted, or never, for entries still held.
+*
+* @param    uint32_t seed
+* @param    htable_cmpfn cmpfn
+* @param    htable_copyfn copyfn
+* @param    htable_freefn freefn
+* @return   struct htable_hamt *
+*               NULL on error
+**/
+HT_STRUCT(htable_hamt) *
+HT_EXPORT(htable_hamt_new)
+HT_ARGS((
+    uint32_t seed,
+    HT_EXPORT(htable_cmpfn) cmpfn,
+    HT_EXPORT(htable_copyfn) copyfn,
+    HT_EXPORT(htable_freefn) freefn
+)) {
+    HT_STRUCT(htable_hamt) *hamt;
+    
+    if (cmpfn == NULL) {
+        return NULL;
+    }
+    
+    hamt = malloc(sizeof(*hamt));
+    if (!hamt) {
+        return NULL;
+    }
+    
+    hamt->root = NULL;
+    hamt->used = 0;
+    hamt->seed = seed;
+    hamt->refs = 1;
+    hamt->copyfn = copyfn;
+    hamt->freefn = freefn;
+    hamt->cmpfn = cmpfn;
+    
+    return hamt;
+}
+
+/**
+* htable_hamt_retain()
+*
+* Take another reference to version, for another reader. Each reference
+* is dropped with htable_hamt_delete().
+*
+* @param    struct htable_hamt *hamt
+* @return   struct htable_hamt *, hamt itself
+**/
+HT_STRUCT(htable_hamt) *
+HT_EXPORT(htable_hamt_retain)
+HT_ARGS((
+    HT_STRUCT(htable_hamt) *hamt
+)) {
+    HT_ATOMIC_INC(hamt->refs);
+    return hamt;
+}
+
+/**
+* htable_hamt_delete()
+*
+* Drop a reference to version. Nodes and entries not shared with other
+* versions are freed with the last one.
+*
+* @param    struct htable_hamt *hamt
+* @return   void
+**/
+void
+HT_EXPORT(htable_hamt_delete)
+HT_ARGS((
+    HT_STRUCT(htable_hamt) *hamt
+)) {
+    if (HT_ATOMIC_DEC(hamt->refs) != 0) {
+        return;
+    }
+    
+    if (hamt->root != NULL) {
+        htable_hamt_node_release(hamt, hamt->root, 0);
+    }
+    
+    free(hamt);
+}
+
+/**
+* htable_hamt_insert()
+*
+* Get a new version with key set to data, replacing an existing entry.
+* Copies one node per trie level, O(log32 n). hamt is not changed.
+*
+* Usage:
+*
+* next = htable_hamt_insert(current, strlen(key), key, value);
+* if (next != NULL) {
+*     htable_hamt_delete(current);
+*     current = next;
+* }
+*
+* @param    struct htable_hamt *hamt
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+* @param    void *data
+*
+* @return   struct htable_hamt *
+*               NULL on error
+**/
+HT_STRUCT(htable_hamt) *
+HT_EXPORT(htable_hamt_insert)
+HT_ARGS((
+    HT_STRUCT(htable_hamt) *hamt,
+    uint32_t key_size,
+    void *key,
+    void *data
+)) {
+    
+    int added = 0;
+    
+    HT_STRUCT(htable_hamt) *version;
+    HT_STRUCT(htable_hamt_node) *root;
+    struct htable_hamt_leaf *leaf;
+    
+    version = malloc(sizeof(*version));
+    if (!version) {
+        return NULL;
+    }
+    
+    leaf = malloc(sizeof(*leaf));
+    if (!leaf) {
+        free(version);
+        return NULL;
+    }
+    
+    memset(leaf, 0, sizeof(*leaf));
+    leaf->refs = 1;
+    leaf->ent.key_size = key_size;
+    MurmurHash3_x86_32(key, key_size, hamt->seed, &leaf->hash);
+    
+    if (hamt->copyfn != NULL) {
+        hamt->copyfn(&leaf->ent, key, data);
+    } else {
+        leaf->ent.key = key;
+        leaf->ent.data = data;
+    }
+    
+    root = htable_hamt_insert_node(hamt, hamt->root, 0, leaf, key, &added);
+    
+    /* Nodes holding the leaf have their own references by now */
+    if (HT_ATOMIC_DEC(leaf->refs) == 0) {
+        if (hamt->copyfn != NULL && hamt->freefn != NULL) {
+            /* Only what copyfn made is ours to free */
+            hamt->freefn(&leaf->ent);
+        }
+        
+        free(leaf);
+    }
+    
+    if (!root) {
+        free(version);
+        return NULL;
+    }
+    
+    *version = *hamt;
+    version->root = root;
+    version->used = hamt->used + added;
+    version->refs = 1;
+    
+    return version;
+}
+
+/**
+* htable_hamt_remove()
+*
+* Get a new version without key. If key is not there, the new version
+* shares the whole trie with hamt, which is not changed either way.
+*
+* @param    struct htable_hamt *hamt
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+*
+* @return   struct htable_hamt *
+*               NULL on error
+**/
+HT_STRUCT(htable_hamt) *
+HT_EXPORT(htable_hamt_remove)
+HT_ARGS((
+    HT_STRUCT(htable_hamt) *hamt,
+    uint32_t key_size,
+    void *key
+)) {
+    
+    uint32_t hash;
+    int res = 0;
+    
+    HT_STRUCT(htable_hamt) *version;
+    HT_STRUCT(htable_hamt_node) *root = NULL;
+    
+    version = malloc(sizeof(*version));
+    if (!version) {
+        return NULL;
+    }
+    
+    /* Get initial hash */
+    MurmurHash3_x86_32(key, key_size, hamt->seed, &hash);
+    
+    if (hamt->root != NULL) {
+        res = htable_hamt_remove_node(hamt, hamt->root, 0, hash, key_size, key, &root);
+        if (res < 0) {
+            free(version);
+            return NULL;
+        }
+    }
+    
+    *version = *hamt;
+    version->refs = 1;
+    
+    if (res == 0) {
+        /* Not found, share the whole trie */
+        if (hamt->root != NULL) {
+            HT_ATOMIC_INC(hamt->root->refs);
+        }
+    } else {
+        version->root = root;
+        version->used--;
+    }
+    
+    return version;
+}
+
+/**
+* htable_hamt_get()
+*
+* Get entry from version. The entry must not be modified.
+*
+* @param    struct htable_hamt *hamt
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+*
+* @return   NULL on error, pointer on success
+**/
+HT_STRUCT(htable_entry) *
+HT_EXPORT(htable_hamt_get)
+HT_ARGS((
+    HT_STRUCT(htable_hamt) *hamt,
+    uint32_t key_size,
+    void *key
+)) {
+    
+    uint32_t i, hash, bit, depth = 0;
+    
+    HT_STRUCT(htable_hamt_node) *node = hamt->root;
+    struct htable_hamt_leaf *leaf;
+    
+    /* Get initial hash */
+    MurmurHash3_x86_32(key, key_size, hamt->seed, &hash);
+    
+    while (node != NULL) {
+        if (depth == HT_HAMT_MAX_DEPTH) {
+            for (i = 0; i < node->count; i++) {
+                leaf = node->child[i];
+                if (htable_hamt_key_equal(hamt, leaf, hash, key_size, key)) {
+                    return &leaf->ent;
+                }
+            }
+            
+            return NULL;
+        }
+        
+        bit = HT_HAMT_BIT(HT_HAMT_POS(hash, depth));
+        
+        if (node->datamap & bit) {
+            leaf = node->child[htable_hamt_popcount(node->datamap & (bit - 1))];
+            if (htable_hamt_key_equal(hamt, leaf, hash, key_size, key)) {
+                return &leaf->ent;
+            }
+            
+            return NULL;
+        }
+        
+        if (!(node->nodemap & bit)) {
+            return NULL;
+        }
+        
+        node = node->child[htable_hamt_popcount(node->datamap) +
+                           htable_hamt_popcount(node->nodemap & (bit - 1))];
+        depth++;
+    }
+    
+    return NULL;
+}
+
+/**
+* htable_hamt_foreach()
+*
+* Call fn for every entry of version, in trie order.
+*
+* @param    struct htable_hamt *hamt
+* @param    htable_scanfn fn
+* @param    void *ctx
+*               - Passed to fn unchanged
+*
+* @return   void
+**/
+void
+HT_EXPORT(htable_hamt_foreach)
+HT_ARGS((
+    HT_STRUCT(htable_hamt) *hamt,
+    HT_EXPORT(htable_scanfn) fn,
+    void *ctx
+)) {
+    if (hamt->root != NULL) {
+        htable_hamt_foreach_node(hamt->root, 0, fn, ctx);
+    }
+}
@@ -0,0 +1,191 @@
+#pragma once
+#include "hashtable.h"
+
+/* hashtable.h drops its export macros at the end, outside the library */
+#ifdef __HT_INTERNAL
+  #define HT_EXTERN
+#else
+  #define HT_EXTERN extern
+#endif
+
+#ifndef HT_EXPORT
+    #define HT_EXPORT(SYM) SYM
+#endif
+
+#define HT_ARGS(SYM) SYM
+
+/* Persistent hash array mapped trie. Every version is immutable: insert
+   and remove return a new version, which shares all nodes off the
+   changed path with the version it was derived from. Versions are
+   reference counted, and may be read and released from any thread. */
+
+struct HT_EXPORT(htable_hamt_node);
+
+/* HAMT version. "used" is the number of entries. */
+struct HT_EXPORT(htable_hamt) {
+    struct HT_EXPORT(htable_hamt_node) *root;
+    uint32_t used;
+    uint32_t seed;
+    uint32_t refs;
+    
+    HT_EXPORT(htable_copyfn) copyfn;
+    HT_EXPORT(htable_freefn) freefn;
+    HT_EXPORT(htable_cmpfn) cmpfn;
+};
+
+/**
+* htable_hamt_new()
+*
+* Create a new, empty HAMT version. Keys are hashed with MurmurHash3
+* and compared with cmpfn, as in htable_new(). copyfn is called once per
+* inserted entry. freefn is called once the last version holding an
+* entry is deleted, or never, for entries still held.
+*
+* @param    uint32_t seed
+* @param    htable_cmpfn cmpfn
+* @param    htable_copyfn copyfn
+* @param    htable_freefn freefn
+* @return   struct htable_hamt *
+*               NULL on error
+**/
+HT_EXTERN struct HT_EXPORT(htable_hamt) *
+HT_EXPORT(htable_hamt_new)
+HT_ARGS((
+    uint32_t seed,
+    HT_EXPORT(htable_cmpfn) cmpfn,
+    HT_EXPORT(htable_copyfn) copyfn,
+    HT_EXPORT(htable_freefn) freefn
+));
+
+/**
+* htable_hamt_retain()
+*
+* Take another reference to version, for another reader. Each reference
+* is dropped with htable_hamt_delete().
+*
+* @param    struct htable_hamt *hamt
+* @return   struct htable_hamt *, hamt itself
+**/
+HT_EXTERN struct HT_EXPORT(htable_hamt) *
+HT_EXPORT(htable_hamt_retain)
+HT_ARGS((
+    struct HT_EXPORT(htable_hamt) *hamt
+));
+
+/**
+* htable_hamt_delete()
+*
+* Drop a reference to version. Nodes and entries not shared with other
+* versions are freed with the last one.
+*
+* @param    struct htable_hamt *hamt
+* @return   void
+**/
+HT_EXTERN void
+HT_EXPORT(htable_hamt_delete)
+HT_ARGS((
+    struct HT_EXPORT(htable_hamt) *hamt
+));
+
+/**
+* htable_hamt_insert()
+*
+* Get a new version with key set to data, replacing an existing entry.
+* Copies one node per trie level, O(log32 n). hamt is not changed.
+*
+* Usage:
+*
+* next = htable_hamt_insert(current, strlen(key), key, value);
+* if (next != NULL) {
+*     htable_hamt_delete(current);
+*     current = next;
+* }
+*
+* @param    struct htable_hamt *hamt
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+* @param    void *data
+*
+* @return   struct htable_hamt *
+*               NULL on error
+**/
+HT_EXTERN struct HT_EXPORT(htable_hamt) *
+HT_EXPORT(htable_hamt_insert)
+HT_ARGS((
+    struct HT_EXPORT(htable_hamt) *hamt,
+    uint32_t key_size,
+    void *key,
+    void *data
+));
+
+/**
+* htable_hamt_remove()
+*
+* Get a new version without key. If key is not there, the new version
+* shares the whole trie with hamt, which is not changed either way.
+*
+* @param    struct htable_hamt *hamt
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+*
+* @return   struct htable_hamt *
+*               NULL on error
+**/
+HT_EXTERN struct HT_EXPORT(htable_hamt) *
+HT_EXPORT(htable_hamt_remove)
+HT_ARGS((
+    struct HT_EXPORT(htable_hamt) *hamt,
+    uint32_t key_size,
+    void *key
+));
+
+/**
+* htable_hamt_get()
+*
+* Get entry from version. The entry must not be modified.
+*
+* @param    struct htable_hamt *hamt
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+*
+* @return   NULL on error, pointer on success
+**/
+HT_EXTERN struct HT_EXPORT(htable_entry) *
+HT_EXPORT(htable_hamt_get)
+HT_ARGS((
+    struct HT_EXPORT(htable_hamt) *hamt,
+    uint32_t key_size,
+    void *key
+));
+
+/**
+* htable_hamt_foreach()
+*
+* Call fn for every entry of version, in trie order.
+*
+* @param    struct htable_hamt *hamt
+* @param    htable_scanfn fn
+* @param    void *ctx
+*               - Passed to fn unchanged
+*
+* @return   void
+**/
+HT_EXTERN void
+HT_EXPORT(htable_hamt_foreach)
+HT_ARGS((
+    struct HT_EXPORT(htable_hamt) *hamt,
+    HT_EXPORT(htable_scanfn) fn,
+    void *ctx
+));
+
+#ifndef __HT_INTERNAL
+  #undef HT_EXTERN
+  #undef HT_ARGS
+  #undef HT_EXPORT
+#endif
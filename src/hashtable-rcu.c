@@ -0,0 +1,602 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <memory.h>
+#include <stdint.h>
+
+#include "config.h"
+
+#define __HT_INTERNAL
+#include "hashtable-rcu.h"
+
+#ifdef USE_PTHREAD
+#include <sched.h>
+
+/* Entry, or old table, waiting for the readers of its epoch to leave */
+struct HT_EXPORT(htable_rcu_retired) {
+    uint32_t epoch;
+    HT_STRUCT(htable) *table;
+    HT_STRUCT(htable_entry) ent;
+};
+
+/**
+* Free retired item: delete the old table, or call freefn for the entry.
+*
+* @param    struct htable_rcu *table
+* @param    struct htable_rcu_retired *item
+* @return   void
+**/
+static void
+htable_rcu_free(
+    HT_STRUCT(htable_rcu) *table,
+    HT_STRUCT(htable_rcu_retired) *item
+) {
+    if (item->table != NULL) {
+        /* Keys and data moved on to the new table */
+        HT_EXPORT(htable_delete)(item->table);
+    } else if (table->freefn != NULL) {
+        /* Call freefn() */
+        table->freefn(&item->ent);
+    }
+}
+
+/**
+* Start a new epoch, and get the oldest epoch a reader is still running
+* in, which is newer than any epoch retired items are tagged with if no
+* reader is running. Called with the lock held.
+*
+* @param    struct htable_rcu *table
+* @return   uint32_t
+**/
+static uint32_t
+htable_rcu_advance(
+    HT_STRUCT(htable_rcu) *table
+) {
+    uint32_t epoch, oldest;
+    
+    HT_STRUCT(htable_rcu_reader) *reader;
+    
+    /* Epoch 0 marks readers outside of read sections */
+    oldest = table->epoch + 1;
+    if (oldest == 0) {
+        oldest = 1;
+    }
+    
+    HT_STORE_RELEASE(table->epoch, oldest);
+    
+    /* Order the unlinks and the new epoch before reading reader epochs.
+       Readers fence between announcing their epoch and reading, so a
+       reader seen outside of a read section sees the unlinks. */
+    HT_FENCE();
+    
+    for (reader = table->readers; reader != NULL; reader = reader->next) {
+        epoch = HT_LOAD_ACQUIRE(reader->epoch);
+        if (epoch != 0 && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+    
+    return oldest;
+}
+
+/**
+* Free retired items no reader can still see. Called with the lock held.
+*
+* @param    struct htable_rcu *table
+* @return   void
+**/
+static void
+htable_rcu_reclaim(
+    HT_STRUCT(htable_rcu) *table
+) {
+    uint32_t i, kept = 0, oldest;
+    
+    oldest = htable_rcu_advance(table);
+    
+    for (i = 0; i < table->retired_used; i++) {
+        if (table->retired[i].epoch < oldest) {
+            htable_rcu_free(table, &table->retired[i]);
+        } else {
+            table->retired[kept++] = table->retired[i];
+        }
+    }
+    
+    table->retired_used = kept;
+}
+
+/**
+* Retire old table, or entry ent if old is NULL. Called with the lock
+* held, after unlinking it. If there's no memory to keep it, wait out
+* the readers that may see it, and free it right away.
+*
+* @param    struct htable_rcu *table
+* @param    struct htable *old
+* @param    struct htable_entry *ent
+* @return   void
+**/
+static void
+htable_rcu_retire(
+    HT_STRUCT(htable_rcu) *table,
+    HT_STRUCT(htable) *old,
+    HT_STRUCT(htable_entry) *ent
+) {
+    uint32_t new_size, epoch;
+    
+    HT_STRUCT(htable_rcu_retired) item, *retired;
+    
+    item.epoch = table->epoch;
+    item.table = old;
+    if (ent != NULL) {
+        item.ent = *ent;
+    }
+    
+    if (table->retired_used == table->retired_size) {
+        new_size = table->retired_size ? table->retired_size * 2 : HT_RCU_BATCH;
+        retired = realloc(table->retired, sizeof(*retired) * new_size);
+        
+        if (!retired) {
+            do {
+                sched_yield();
+                epoch = htable_rcu_advance(table);
+            } while (epoch <= item.epoch);
+            
+            htable_rcu_free(table, &item);
+            return;
+        }
+        
+        table->retired = retired;
+        table->retired_size = new_size;
+    }
+    
+    table->retired[table->retired_used++] = item;
+}
+
+/**
+* Replace the table with a rebuilt copy, without tombstones, and grown
+* if it's more than half full. Readers keep using the old table until
+* they see the new one. Called with the lock held.
+*
+* @param    struct htable_rcu *table
+* @return   0 on error, 1 on success
+**/
+static int
+htable_rcu_rebuild(
+    HT_STRUCT(htable_rcu) *table
+) {
+    uint32_t new_size;
+    
+    HT_STRUCT(htable) *old = table->table,
+                      *copy;
+    
+    new_size = old->size;
+    if ((uint64_t)(old->used + 1) * 200 > (uint64_t)old->size * HT_MAX_LOAD) {
+        if (old->size > UINT32_MAX / 2) {
+            return 0;
+        }
+        
+        new_size = old->size * 2;
+    }
+    
+    /* Built straight from the old slots, reusing stored hashes */
+    copy = HT_EXPORT(htable_clone_ex)(old, new_size);
+    if (!copy) {
+        return 0;
+    }
+    
+    HT_STORE_RELEASE(table->table, copy);
+    htable_rcu_retire(table, old, NULL);
+    
+    return 1;
+}
+
+/**
+* Call freefn for an entry still in the table, from htable_rcu_delete().
+*
+* @param    struct htable_entry *ent
+* @param    void *ctx
+* @return   void
+**/
+static void
+htable_rcu_free_entry(
+    HT_STRUCT(htable_entry) *ent,
+    void *ctx
+) {
+    ((HT_STRUCT(htable_rcu) *)ctx)->freefn(ent);
+}
+
+/**
+* htable_rcu_new()
+*
+* Create a new read-mostly hash table. See htable_new_ex(). copyfn is
+* called by writers, freefn after a grace period.
+*
+* @param    uint32_t size
+* @param    uint32_t seed
+* @param    htable_cmpfn cmpfn
+* @param    htable_copyfn copyfn
+* @param    htable_freefn freefn
+* @param    uint32_t flags
+*               - HT_FLAG_SET and HT_FLAG_MEMCMP only
+* @return   struct htable_rcu *
+*               NULL on error
+**/
+HT_STRUCT(htable_rcu) *
+HT_EXPORT(htable_rcu_new)
+HT_ARGS((
+    uint32_t size,
+    uint32_t random_seed,
+    HT_EXPORT(htable_cmpfn) cmpfn,
+    HT_EXPORT(htable_copyfn) copyfn,
+    HT_EXPORT(htable_freefn) freefn,
+    uint32_t flags
+)) {
+    HT_STRUCT(htable_rcu) *table;
+    
+    if (flags & ~(HT_FLAG_SET | HT_FLAG_MEMCMP)) {
+        return NULL;
+    }
+    
+    table = malloc(sizeof(*table));
+    if (!table) {
+        return NULL;
+    }
+    
+    memset(table, 0, sizeof(*table));
+    table->epoch = 1;
+    table->copyfn = copyfn;
+    table->freefn = freefn;
+    
+    /* Callbacks are run here, where retiring is handled */
+    table->table = HT_EXPORT(htable_new_ex)(size, random_seed, cmpfn,
+                                            NULL, NULL, flags | HT_FLAG_RCU);
+    
+    if (!table->table) {
+        free(table);
+        return NULL;
+    }
+    
+    if (pthread_mutex_init(&table->lock, NULL) != 0) {
+        HT_EXPORT(htable_delete)(table->table);
+        free(table);
+        return NULL;
+    }
+    
+    return table;
+}
+
+/**
+* htable_rcu_delete()
+*
+* Delete table, its readers, and everything retired. No other thread
+* may be using it.
+*
+* @param    struct htable_rcu *table
+* @return   void
+**/
+void
+HT_EXPORT(htable_rcu_delete)
+HT_ARGS((
+    HT_STRUCT(htable_rcu) *table
+)) {
+    uint32_t i;
+    
+    HT_STRUCT(htable_rcu_reader) *reader, *next;
+    
+    for (i = 0; i < table->retired_used; i++) {
+        htable_rcu_free(table, &table->retired[i]);
+    }
+    
+    if (table->freefn != NULL) {
+        HT_EXPORT(htable_foreach)(table->table, &htable_rcu_free_entry, table);
+    }
+    
+    for (reader = table->readers; reader != NULL; reader = next) {
+        next = reader->next;
+        free(reader);
+    }
+    
+    HT_EXPORT(htable_delete)(table->table);
+    pthread_mutex_destroy(&table->lock);
+    free(table->retired);
+    free(table);
+}
+
+/**
+* htable_rcu_reader_new()
+*
+* Register a reader, for use by one thread at a time.
+*
+* @param    struct htable_rcu *table
+* @return   struct htable_rcu_reader *
+*               NULL on error
+**/
+HT_STRUCT(htable_rcu_reader) *
+HT_EXPORT(htable_rcu_reader_new)
+HT_ARGS((
+    HT_STRUCT(htable_rcu) *table
+)) {
+    HT_STRUCT(htable_rcu_reader) *reader;
+    
+    reader = malloc(sizeof(*reader));
+    if (!reader) {
+        return NULL;
+    }
+    
+    memset(reader, 0, sizeof(*reader));
+    
+    pthread_mutex_lock(&table->lock);
+    reader->next = table->readers;
+    table->readers = reader;
+    pthread_mutex_unlock(&table->lock);
+    
+    return reader;
+}
+
+/**
+* htable_rcu_reader_delete()
+*
+* Unregister and free reader, which must be outside of a read section.
+*
+* @param    struct htable_rcu *table
+* @param    struct htable_rcu_reader *reader
+* @return   void
+**/
+void
+HT_EXPORT(htable_rcu_reader_delete)
+HT_ARGS((
+    HT_STRUCT(htable_rcu) *table,
+    HT_STRUCT(htable_rcu_reader) *reader
+)) {
+    HT_STRUCT(htable_rcu_reader) **link;
+    
+    pthread_mutex_lock(&table->lock);
+    
+    for (link = &table->readers; *link != NULL; link = &(*link)->next) {
+        if (*link == reader) {
+            *link = reader->next;
+            break;
+        }
+    }
+    
+    pthread_mutex_unlock(&table->lock);
+    free(reader);
+}
+
+/**
+* htable_rcu_enter()
+*
+* Start a read section. Entries returned by htable_rcu_get() stay valid
+* until htable_rcu_leave(). Read sections should be short: writers can't
+* free anything retired while one is running.
+*
+* Usage:
+*
+* htable_rcu_enter(table, reader);
+* ent = htable_rcu_get(table, strlen(key), key);
+* if (ent != NULL) {
+*     use(ent->data);
+* }
+* htable_rcu_leave(reader);
+*
+* @param    struct htable_rcu *table
+* @param    struct htable_rcu_reader *reader
+* @return   void
+**/
+void
+HT_EXPORT(htable_rcu_enter)
+HT_ARGS((
+    HT_STRUCT(htable_rcu) *table,
+    HT_STRUCT(htable_rcu_reader) *reader
+)) {
+    HT_STORE_RELEASE(reader->epoch, HT_LOAD_ACQUIRE(table->epoch));
+    
+    /* Announce the epoch before reading the table. See
+       htable_rcu_advance(). */
+    HT_FENCE();
+}
+
+/**
+* htable_rcu_leave()
+*
+* End a read section.
+*
+* @param    struct htable_rcu_reader *reader
+* @return   void
+**/
+void
+HT_EXPORT(htable_rcu_leave)
+HT_ARGS((
+    HT_STRUCT(htable_rcu_reader) *reader
+)) {
+    HT_STORE_RELEASE(reader->epoch, 0);
+}
+
+/**
+* htable_rcu_get()
+*
+* Get entry from table, inside a read section. The entry must not be
+* modified. A writer may replace its data at any time, so read the data
+* with htable_rcu_data(), not ent->data.
+*
+* @param    struct htable_rcu *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+*
+* @return   NULL on error, pointer on success
+**/
+HT_STRUCT(htable_entry) *
+HT_EXPORT(htable_rcu_get)
+HT_ARGS((
+    HT_STRUCT(htable_rcu) *table,
+    uint32_t key_size,
+    void *key
+)) {
+    return HT_EXPORT(htable_get)(HT_LOAD_ACQUIRE(table->table), key_size, key);
+}
+
+/**
+* htable_rcu_data()
+*
+* Get the data of an entry returned by htable_rcu_get(), inside the same
+* read section. Loaded with acquire ordering, pairing with the release
+* store of a writer replacing it, so what the data points to is seen as
+* it was written. Either the old or the new data is returned; both stay
+* valid until htable_rcu_leave().
+*
+* @param    struct htable_entry *ent
+* @return   void *
+**/
+void *
+HT_EXPORT(htable_rcu_data)
+HT_ARGS((
+    const HT_STRUCT(htable_entry) *ent
+)) {
+    return HT_LOAD_ACQUIRE(ent->data);
+}
+
+/**
+* htable_rcu_add()
+*
+* Add item to table, replacing an existing entry, which is retired. The
+* table is rebuilt, bigger or without tombstones, when it fills up.
+*
+* @param    struct htable_rcu *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+* @param    void *data
+*
+* @return   0 on error, 1 on success
+**/
+int
+HT_EXPORT(htable_rcu_add)
+HT_ARGS((
+    HT_STRUCT(htable_rcu) *table,
+    uint32_t key_size,
+    void *key,
+    void *data
+)) {
+    int res = 1,
+        replaced = 0;
+    
+    HT_STRUCT(htable) *current;
+    HT_STRUCT(htable_entry) item, old, *ent;
+    
+    memset(&item, 0, sizeof(item));
+    item.key_size = key_size;
+    
+    if (table->copyfn != NULL) {
+        table->copyfn(&item, key, data);
+    } else {
+        item.key = key;
+        item.data = data;
+    }
+    
+    pthread_mutex_lock(&table->lock);
+    current = table->table;
+    
+    ent = HT_EXPORT(htable_get)(current, key_size, key);
+    if (ent != NULL) {
+        /* Replaced in place, readers see either entry. The old one is
+           retired once it's no longer linked, as in htable_rcu_remove(),
+           since retiring may free it right away. */
+        old = *ent;
+        replaced = 1;
+    } else if ((uint64_t)(current->used + current->deleted + 1) * 100 >
+               (uint64_t)current->size * HT_MAX_LOAD) {
+        res = htable_rcu_rebuild(table);
+    }
+    
+    res = res && HT_EXPORT(htable_add)(table->table, key_size, item.key, item.data);
+    
+    if (res && replaced) {
+        htable_rcu_retire(table, NULL, &old);
+    }
+    
+    if (!res && table->copyfn != NULL && table->freefn != NULL) {
+        /* Never published, free the copy now */
+        table->freefn(&item);
+    }
+    
+    if (table->retired_used >= HT_RCU_BATCH) {
+        htable_rcu_reclaim(table);
+    }
+    
+    pthread_mutex_unlock(&table->lock);
+    return res;
+}
+
+/**
+* htable_rcu_remove()
+*
+* Remove item from table. The entry is retired.
+*
+* @param    struct htable_rcu *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+*
+* @return   0 on error, 1 on success
+**/
+int
+HT_EXPORT(htable_rcu_remove)
+HT_ARGS((
+    HT_STRUCT(htable_rcu) *table,
+    uint32_t key_size,
+    void *key
+)) {
+    HT_STRUCT(htable_entry) item, *ent;
+    
+    pthread_mutex_lock(&table->lock);
+    
+    ent = HT_EXPORT(htable_get)(table->table, key_size, key);
+    if (ent == NULL) {
+        pthread_mutex_unlock(&table->lock);
+        return 0;
+    }
+    
+    item = *ent;
+    HT_EXPORT(htable_remove)(table->table, key_size, key);
+    htable_rcu_retire(table, NULL, &item);
+    
+    if (table->retired_used >= HT_RCU_BATCH) {
+        htable_rcu_reclaim(table);
+    }
+    
+    pthread_mutex_unlock(&table->lock);
+    return 1;
+}
+
+/**
+* htable_rcu_synchronize()
+*
+* Wait for every read section running now to end, then free everything
+* retired so far. Must not be called from inside a read section.
+*
+* @param    struct htable_rcu *table
+* @return   void
+**/
+void
+HT_EXPORT(htable_rcu_synchronize)
+HT_ARGS((
+    HT_STRUCT(htable_rcu) *table
+)) {
+    pthread_mutex_lock(&table->lock);
+    htable_rcu_reclaim(table);
+    
+    while (table->retired_used > 0) {
+        /* Let readers finish, without holding writers up */
+        pthread_mutex_unlock(&table->lock);
+        sched_yield();
+        pthread_mutex_lock(&table->lock);
+        htable_rcu_reclaim(table);
+    }
+    
+    pthread_mutex_unlock(&table->lock);
+}
+
+#endif
@@ -0,0 +1,279 @@
+#pragma once
+#include "hashtable.h"
+
+/* hashtable.h drops its export macros at the end, outside the library */
+#ifdef __HT_INTERNAL
+  #define HT_EXTERN
+#else
+  #define HT_EXTERN extern
+#endif
+
+#ifndef HT_EXPORT
+    #define HT_EXPORT(SYM) SYM
+#endif
+
+#define HT_ARGS(SYM) SYM
+
+/* Entries retired by writers before the reclaimer checks on readers */
+#ifndef HT_RCU_BATCH
+    #define HT_RCU_BATCH 64
+#endif
+
+#ifdef USE_PTHREAD
+#include <pthread.h>
+
+/* Read-mostly table. Lookups take no locks and do no atomic
+   read-modify-write: a reader announces the epoch it runs in, and reads
+   a HT_FLAG_RCU table. Writers are serialized by a mutex. Entries they
+   replace or remove, and the old table when it's rebuilt, are retired
+   with the epoch they left in, and only freed (freefn called) once no
+   reader can still be running in that epoch. */
+
+/* Reader of one thread. "epoch" is 0 outside of read sections. */
+struct HT_EXPORT(htable_rcu_reader) {
+    uint32_t epoch;
+    struct HT_EXPORT(htable_rcu_reader) *next;
+    
+    /* Keep other readers' epochs off this cache line */
+    char pad[64];
+};
+
+struct HT_EXPORT(htable_rcu_retired);
+
+/* "table" is the current table, replaced when it's rebuilt. */
+struct HT_EXPORT(htable_rcu) {
+    struct HT_EXPORT(htable) *table;
+    uint32_t epoch;
+    
+    struct HT_EXPORT(htable_rcu_reader) *readers;
+    struct HT_EXPORT(htable_rcu_retired) *retired;
+    uint32_t retired_used;
+    uint32_t retired_size;
+    
+    pthread_mutex_t lock;
+    HT_EXPORT(htable_copyfn) copyfn;
+    HT_EXPORT(htable_freefn) freefn;
+};
+
+/**
+* htable_rcu_new()
+*
+* Create a new read-mostly hash table. See htable_new_ex(). copyfn is
+* called by writers, freefn after a grace period.
+*
+* @param    uint32_t size
+* @param    uint32_t seed
+* @param    htable_cmpfn cmpfn
+* @param    htable_copyfn copyfn
+* @param    htable_freefn freefn
+* @param    uint32_t flags
+*               - HT_FLAG_SET and HT_FLAG_MEMCMP only
+* @return   struct htable_rcu *
+*               NULL on error
+**/
+HT_EXTERN struct HT_EXPORT(htable_rcu) *
+HT_EXPORT(htable_rcu_new)
+HT_ARGS((
+    uint32_t size,
+    uint32_t random_seed,
+    HT_EXPORT(htable_cmpfn) cmpfn,
+    HT_EXPORT(htable_copyfn) copyfn,
+    HT_EXPORT(htable_freefn) freefn,
+    uint32_t flags
+));
+
+/**
+* htable_rcu_delete()
+*
+* Delete table, its readers, and everything retired. No other thread
+* may be using it.
+*
+* @param    struct htable_rcu *table
+* @return   void
+**/
+HT_EXTERN void
+HT_EXPORT(htable_rcu_delete)
+HT_ARGS((
+    struct HT_EXPORT(htable_rcu) *table
+));
+
+/**
+* htable_rcu_reader_new()
+*
+* Register a reader, for use by one thread at a time.
+*
+* @param    struct htable_rcu *table
+* @return   struct htable_rcu_reader *
+*               NULL on error
+**/
+HT_EXTERN struct HT_EXPORT(htable_rcu_reader) *
+HT_EXPORT(htable_rcu_reader_new)
+HT_ARGS((
+    struct HT_EXPORT(htable_rcu) *table
+));
+
+/**
+* htable_rcu_reader_delete()
+*
+* Unregister and free reader, which must be outside of a read section.
+*
+* @param    struct htable_rcu *table
+* @param    struct htable_rcu_reader *reader
+* @return   void
+**/
+HT_EXTERN void
+HT_EXPORT(htable_rcu_reader_delete)
+HT_ARGS((
+    struct HT_EXPORT(htable_rcu) *table,
+    struct HT_EXPORT(htable_rcu_reader) *reader
+));
+
+/**
+* htable_rcu_enter()
+*
+* Start a read section. Entries returned by htable_rcu_get() stay valid
+* until htable_rcu_leave(). Read sections should be short: writers can't
+* free anything retired while one is running.
+*
+* Usage:
+*
+* htable_rcu_enter(table, reader);
+* ent = htable_rcu_get(table, strlen(key), key);
+* if (ent != NULL) {
+*     use(htable_rcu_data(ent));
+* }
+* htable_rcu_leave(reader);
+*
+* @param    struct htable_rcu *table
+* @param    struct htable_rcu_reader *reader
+* @return   void
+**/
+HT_EXTERN void
+HT_EXPORT(htable_rcu_enter)
+HT_ARGS((
+    struct HT_EXPORT(htable_rcu) *table,
+    struct HT_EXPORT(htable_rcu_reader) *reader
+));
+
+/**
+* htable_rcu_leave()
+*
+* End a read section.
+*
+* @param    struct htable_rcu_reader *reader
+* @return   void
+**/
+HT_EXTERN void
+HT_EXPORT(htable_rcu_leave)
+HT_ARGS((
+    struct HT_EXPORT(htable_rcu_reader) *reader
+));
+
+/**
+* htable_rcu_get()
+*
+* Get entry from table, inside a read section. The entry must not be
+* modified. A writer may replace its data at any time, so read the data
+* with htable_rcu_data(), not ent->data.
+*
+* @param    struct htable_rcu *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+*
+* @return   NULL on error, pointer on success
+**/
+HT_EXTERN struct HT_EXPORT(htable_entry) *
+HT_EXPORT(htable_rcu_get)
+HT_ARGS((
+    struct HT_EXPORT(htable_rcu) *table,
+    uint32_t key_size,
+    void *key
+));
+
+/**
+* htable_rcu_data()
+*
+* Get the data of an entry returned by htable_rcu_get(), inside the same
+* read section. Loaded with acquire ordering, pairing with the release
+* store of a writer replacing it, so what the data points to is seen as
+* it was written. Either the old or the new data is returned; both stay
+* valid until htable_rcu_leave().
+*
+* @param    struct htable_entry *ent
+* @return   void *
+**/
+HT_EXTERN void *
+HT_EXPORT(htable_rcu_data)
+HT_ARGS((
+    const struct HT_EXPORT(htable_entry) *ent
+));
+
+/**
+* htable_rcu_add()
+*
+* Add item to table, replacing an existing entry, which is retired. The
+* table is rebuilt, bigger or without tombstones, when it fills up.
+*
+* @param    struct htable_rcu *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+* @param    void *data
+*
+* @return   0 on error, 1 on success
+**/
+HT_EXTERN int
+HT_EXPORT(htable_rcu_add)
+HT_ARGS((
+    struct HT_EXPORT(htable_rcu) *table,
+    uint32_t key_size,
+    void *key,
+    void *data
+));
+
+/**
+* htable_rcu_remove()
+*
+* Remove item from table. The entry is retired.
+*
+* @param    struct htable_rcu *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+*
+* @return   0 on error, 1 on success
+**/
+HT_EXTERN int
+HT_EXPORT(htable_rcu_remove)
+HT_ARGS((
+    struct HT_EXPORT(htable_rcu) *table,
+    uint32_t key_size,
+    void *key
+));
+
+/**
+* htable_rcu_synchronize()
+*
+* Wait for every read section running now to end, then free everything
+* retired so far. Must not be called from inside a read section.
+*
+* @param    struct htable_rcu *table
+* @return   void
+**/
+HT_EXTERN void
+HT_EXPORT(htable_rcu_synchronize)
+HT_ARGS((
+    struct HT_EXPORT(htable_rcu) *table
+));
+
+#endif
+
+#ifndef __HT_INTERNAL
+  #undef HT_EXTERN
+  #undef HT_ARGS
+  #undef HT_EXPORT
+#endif
@@ -0,0 +1,418 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <memory.h>
+#include <stdint.h>
+
+#include "config.h"
+
+#define __HT_INTERNAL
+#include "hashtable-sharded.h"
+#include "MurmurHash3.h"
+
+#ifdef USE_PTHREAD
+#include <pthread.h>
+
+/* Shards are padded to this size, so neighbouring locks don't share
+   cache lines (two lines, for adjacent line prefetching). */
+#define HT_SHARD_PAD 128
+
+/* Largest number of shards */
+#define HT_SHARDS_MAX 65536
+
+struct HT_EXPORT(htable_shard) {
+    union {
+        struct {
+            pthread_rwlock_t lock;
+            HT_STRUCT(htable) *table;
+        } s;
+        
+        char pad[HT_SHARD_PAD];
+    } u;
+};
+
+#define HT_SHARD_LOCK(shard) (&(shard)->u.s.lock)
+#define HT_SHARD_TABLE(shard) ((shard)->u.s.table)
+
+/**
+* Get the shard for key, by the high bits of its hash.
+*
+* @param    struct htable_sharded *table
+* @param    uint32_t key_size
+* @param    void *key
+* @return   struct htable_shard *
+**/
+static HT_STRUCT(htable_shard) *
+htable_sharded_route(
+    HT_STRUCT(htable_sharded) *table,
+    uint32_t key_size,
+    void *key
+) {
+    uint32_t hash;
+    
+    if (table->nshards == 1) {
+        return table->shards;
+    }
+    
+    /* Shards index their slots by the low bits of the same hash */
+    MurmurHash3_x86_32(key, key_size, table->seed, &hash);
+    return &table->shards[hash >> table->shift];
+}
+
+/**
+* Make room in shard for one more entry: grow it once the load reaches
+* HT_MAX_LOAD, or rebuild it at the same size if that's mostly slots
+* left behind by htable_remove(). Called with the write lock held.
+*
+* @param    struct htable *shard
+* @return   0 on error, 1 on success
+**/
+static int
+htable_sharded_reserve(
+    HT_STRUCT(htable) *shard
+) {
+    uint32_t new_size = shard->size;
+    
+    if ((uint64_t)(shard->used + shard->deleted + 1) * 100 <=
+        (uint64_t)shard->size * HT_MAX_LOAD) {
+        return 1;
+    }
+    
+    if ((uint64_t)(shard->used + 1) * 200 > (uint64_t)shard->size * HT_MAX_LOAD) {
+        if (shard->size > UINT32_MAX / 2) {
+            /* Can't grow, htable_add() will use what's left */
+            return 1;
+        }
+        
+        new_size = shard->size * 2;
+    }
+    
+    return HT_EXPORT(htable_resize)(shard, 0, new_size);
+}
+
+/**
+* htable_sharded_new()
+*
+* Create a new sharded hash table. See htable_new_ex(). Entries can't
+* be returned by pointer once the shard lock is dropped, so values are
+* read with htable_sharded_get() or htable_sharded_lookup(), and
+* HT_VALUE_WIDTH() is not supported.
+*
+* @param    uint32_t nshards
+*               - Rounded up to a power of two
+* @param    uint32_t size
+*               - Initial size of the whole table, split between shards
+* @param    uint32_t seed
+* @param    htable_cmpfn cmpfn
+* @param    htable_copyfn copyfn
+* @param    htable_freefn freefn
+* @param    uint32_t flags
+* @return   struct htable_sharded *
+*               NULL on error
+**/
+HT_STRUCT(htable_sharded) *
+HT_EXPORT(htable_sharded_new)
+HT_ARGS((
+    uint32_t nshards,
+    uint32_t size,
+    uint32_t random_seed,
+    HT_EXPORT(htable_cmpfn) cmpfn,
+    HT_EXPORT(htable_copyfn) copyfn,
+    HT_EXPORT(htable_freefn) freefn,
+    uint32_t flags
+)) {
+    uint32_t i, count = 1, shift = 32, shard_size;
+    
+    HT_STRUCT(htable_sharded) *table;
+    HT_STRUCT(htable_shard) *shard;
+    
+    if (nshards == 0 || nshards > HT_SHARDS_MAX ||
+            (flags & HT_FLAG_INLINE_VALUES)) {
+        return NULL;
+    }
+    
+    while (count < nshards) {
+        count *= 2;
+        shift--;
+    }
+    
+    shard_size = size / count;
+    if (shard_size < HT_MIN_SIZE) {
+        shard_size = HT_MIN_SIZE;
+    }
+    
+    table = malloc(sizeof(*table));
+    if (!table) {
+        return NULL;
+    }
+    
+    table->shards = malloc(sizeof(*table->shards) * count);
+    if (!table->shards) {
+        free(table);
+        return NULL;
+    }
+    
+    table->nshards = count;
+    table->shift = shift;
+    table->seed = random_seed;
+    
+    for (i = 0; i < count; i++) {
+        shard = &table->shards[i];
+        HT_SHARD_TABLE(shard) = HT_EXPORT(htable_new_ex)(
+                                    shard_size, random_seed,
+                                    cmpfn, copyfn, freefn, flags);
+        
+        if (!HT_SHARD_TABLE(shard)) {
+            break;
+        }
+        
+        if (pthread_rwlock_init(HT_SHARD_LOCK(shard), NULL) != 0) {
+            HT_EXPORT(htable_delete)(HT_SHARD_TABLE(shard));
+            break;
+        }
+    }
+    
+    if (i < count) {
+        /* Unwind the shards made so far */
+        table->nshards = i;
+        HT_EXPORT(htable_sharded_delete)(table);
+        return NULL;
+    }
+    
+    return table;
+}
+
+/**
+* htable_sharded_delete()
+*
+* Delete sharded hash table. No other thread may be using it.
+*
+* @param    struct htable_sharded *table
+* @return   void
+**/
+void
+HT_EXPORT(htable_sharded_delete)
+HT_ARGS((
+    HT_STRUCT(htable_sharded) *table
+)) {
+    uint32_t i;
+    
+    for (i = 0; i < table->nshards; i++) {
+        pthread_rwlock_destroy(HT_SHARD_LOCK(&table->shards[i]));
+        HT_EXPORT(htable_delete)(HT_SHARD_TABLE(&table->shards[i]));
+    }
+    
+    free(table->shards);
+    free(table);
+}
+
+/**
+* htable_sharded_add()
+*
+* Add item to its shard, replacing an existing entry. The shard grows
+* as needed, under its own write lock.
+*
+* @param    struct htable_sharded *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+* @param    void *data
+*
+* @return   0 on error, 1 on success
+**/
+int
+HT_EXPORT(htable_sharded_add)
+HT_ARGS((
+    HT_STRUCT(htable_sharded) *table,
+    uint32_t key_size,
+    void *key,
+    void *data
+)) {
+    int res;
+    
+    HT_STRUCT(htable_shard) *shard;
+    
+    shard = htable_sharded_route(table, key_size, key);
+    pthread_rwlock_wrlock(HT_SHARD_LOCK(shard));
+    
+    res = htable_sharded_reserve(HT_SHARD_TABLE(shard)) &&
+          HT_EXPORT(htable_add)(HT_SHARD_TABLE(shard), key_size, key, data);
+    
+    pthread_rwlock_unlock(HT_SHARD_LOCK(shard));
+    return res;
+}
+
+/**
+* htable_sharded_remove()
+*
+* Remove item from its shard.
+*
+* @param    struct htable_sharded *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+*
+* @return   0 on error, 1 on success
+**/
+int
+HT_EXPORT(htable_sharded_remove)
+HT_ARGS((
+    HT_STRUCT(htable_sharded) *table,
+    uint32_t key_size,
+    void *key
+)) {
+    int res;
+    
+    HT_STRUCT(htable_shard) *shard;
+    
+    shard = htable_sharded_route(table, key_size, key);
+    pthread_rwlock_wrlock(HT_SHARD_LOCK(shard));
+    res = HT_EXPORT(htable_remove)(HT_SHARD_TABLE(shard), key_size, key);
+    pthread_rwlock_unlock(HT_SHARD_LOCK(shard));
+    
+    return res;
+}
+
+/**
+* htable_sharded_get()
+*
+* Look up key, under its shard's read lock.
+*
+* @param    struct htable_sharded *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+* @param    void **data
+*               - Receives the entry's data, if found. May be NULL.
+*
+* @return   0 if not found, 1 if found
+**/
+int
+HT_EXPORT(htable_sharded_get)
+HT_ARGS((
+    HT_STRUCT(htable_sharded) *table,
+    uint32_t key_size,
+    void *key,
+    void **data
+)) {
+    HT_STRUCT(htable_shard) *shard;
+    HT_STRUCT(htable_entry) *ent;
+    
+    shard = htable_sharded_route(table, key_size, key);
+    pthread_rwlock_rdlock(HT_SHARD_LOCK(shard));
+    
+    ent = HT_EXPORT(htable_get)(HT_SHARD_TABLE(shard), key_size, key);
+    if (ent != NULL && data != NULL) {
+        *data = (HT_SHARD_TABLE(shard)->flags & HT_FLAG_SET) ? NULL : ent->data;
+    }
+    
+    pthread_rwlock_unlock(HT_SHARD_LOCK(shard));
+    return ent != NULL;
+}
+
+/**
+* htable_sharded_lookup()
+*
+* Look up key, and call fn with its entry while the shard's read lock
+* is held. fn must not modify the table.
+*
+* @param    struct htable_sharded *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+* @param    htable_scanfn fn
+* @param    void *ctx
+*               - Passed to fn unchanged
+*
+* @return   0 if not found, 1 if found
+**/
+int
+HT_EXPORT(htable_sharded_lookup)
+HT_ARGS((
+    HT_STRUCT(htable_sharded) *table,
+    uint32_t key_size,
+    void *key,
+    HT_EXPORT(htable_scanfn) fn,
+    void *ctx
+)) {
+    HT_STRUCT(htable_shard) *shard;
+    HT_STRUCT(htable_entry) *ent;
+    
+    shard = htable_sharded_route(table, key_size, key);
+    pthread_rwlock_rdlock(HT_SHARD_LOCK(shard));
+    
+    ent = HT_EXPORT(htable_get)(HT_SHARD_TABLE(shard), key_size, key);
+    if (ent != NULL) {
+        fn(ent, ctx);
+    }
+    
+    pthread_rwlock_unlock(HT_SHARD_LOCK(shard));
+    return ent != NULL;
+}
+
+/**
+* htable_sharded_foreach()
+*
+* Call fn for every entry, one shard at a time, under that shard's read
+* lock. Entries added or removed concurrently in other shards may or may
+* not be seen. fn must not modify the table.
+*
+* @param    struct htable_sharded *table
+* @param    htable_scanfn fn
+* @param    void *ctx
+*               - Passed to fn unchanged
+*
+* @return   void
+**/
+void
+HT_EXPORT(htable_sharded_foreach)
+HT_ARGS((
+    HT_STRUCT(htable_sharded) *table,
+    HT_EXPORT(htable_scanfn) fn,
+    void *ctx
+)) {
+    uint32_t i;
+    
+    HT_STRUCT(htable_shard) *shard;
+    
+    for (i = 0; i < table->nshards; i++) {
+        shard = &table->shards[i];
+        pthread_rwlock_rdlock(HT_SHARD_LOCK(shard));
+        HT_EXPORT(htable_foreach)(HT_SHARD_TABLE(shard), fn, ctx);
+        pthread_rwlock_unlock(HT_SHARD_LOCK(shard));
+    }
+}
+
+/**
+* htable_sharded_used()
+*
+* Number of entries in the table, summed shard by shard. Only exact if
+* no other thread is writing.
+*
+* @param    struct htable_sharded *table
+* @return   uint32_t
+**/
+uint32_t
+HT_EXPORT(htable_sharded_used)
+HT_ARGS((
+    HT_STRUCT(htable_sharded) *table
+)) {
+    uint32_t i, used = 0;
+    
+    HT_STRUCT(htable_shard) *shard;
+    
+    for (i = 0; i < table->nshards; i++) {
+        shard = &table->shards[i];
+        pthread_rwlock_rdlock(HT_SHARD_LOCK(shard));
+        used += HT_SHARD_TABLE(shard)->used;
+        pthread_rwlock_unlock(HT_SHARD_LOCK(shard));
+    }
+    
+    return used;
+}
+
+#endif
@@ -0,0 +1,219 @@
+#pragma once
+#include "hashtable.h"
+
+/* hashtable.h drops its export macros at the end, outside the library */
+#ifdef __HT_INTERNAL
+  #define HT_EXTERN
+#else
+  #define HT_EXTERN extern
+#endif
+
+#ifndef HT_EXPORT
+    #define HT_EXPORT(SYM) SYM
+#endif
+
+#define HT_ARGS(SYM) SYM
+
+#ifdef USE_PTHREAD
+
+/* Thread safe hash table, made of independent tables (shards). A key's
+   shard is picked by the high bits of its hash, and each shard has its
+   own reader-writer lock, so threads working on different shards never
+   wait for each other. Growing a shard only locks that shard. */
+
+struct HT_EXPORT(htable_shard);
+
+/* "shift" is 32 minus log2(nshards), for routing by the high hash bits */
+struct HT_EXPORT(htable_sharded) {
+    struct HT_EXPORT(htable_shard) *shards;
+    uint32_t nshards;
+    uint32_t shift;
+    uint32_t seed;
+};
+
+/**
+* htable_sharded_new()
+*
+* Create a new sharded hash table. See htable_new_ex(). Entries can't
+* be returned by pointer once the shard lock is dropped, so values are
+* read with htable_sharded_get() or htable_sharded_lookup(), and
+* HT_VALUE_WIDTH() is not supported.
+*
+* @param    uint32_t nshards
+*               - Rounded up to a power of two
+* @param    uint32_t size
+*               - Initial size of the whole table, split between shards
+* @param    uint32_t seed
+* @param    htable_cmpfn cmpfn
+* @param    htable_copyfn copyfn
+* @param    htable_freefn freefn
+* @param    uint32_t flags
+* @return   struct htable_sharded *
+*               NULL on error
+**/
+HT_EXTERN struct HT_EXPORT(htable_sharded) *
+HT_EXPORT(htable_sharded_new)
+HT_ARGS((
+    uint32_t nshards,
+    uint32_t size,
+    uint32_t random_seed,
+    HT_EXPORT(htable_cmpfn) cmpfn,
+    HT_EXPORT(htable_copyfn) copyfn,
+    HT_EXPORT(htable_freefn) freefn,
+    uint32_t flags
+));
+
+/**
+* htable_sharded_delete()
+*
+* Delete sharded hash table. No other thread may be using it.
+*
+* @param    struct htable_sharded *table
+* @return   void
+**/
+HT_EXTERN void
+HT_EXPORT(htable_sharded_delete)
+HT_ARGS((
+    struct HT_EXPORT(htable_sharded) *table
+));
+
+/**
+* htable_sharded_add()
+*
+* Add item to its shard, replacing an existing entry. The shard grows
+* as needed, under its own write lock.
+*
+* @param    struct htable_sharded *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+* @param    void *data
+*
+* @return   0 on error, 1 on success
+**/
+HT_EXTERN int
+HT_EXPORT(htable_sharded_add)
+HT_ARGS((
+    struct HT_EXPORT(htable_sharded) *table,
+    uint32_t key_size,
+    void *key,
+    void *data
+));
+
+/**
+* htable_sharded_remove()
+*
+* Remove item from its shard.
+*
+* @param    struct htable_sharded *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+*
+* @return   0 on error, 1 on success
+**/
+HT_EXTERN int
+HT_EXPORT(htable_sharded_remove)
+HT_ARGS((
+    struct HT_EXPORT(htable_sharded) *table,
+    uint32_t key_size,
+    void *key
+));
+
+/**
+* htable_sharded_get()
+*
+* Look up key, under its shard's read lock.
+*
+* @param    struct htable_sharded *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+* @param    void **data
+*               - Receives the entry's data, if found. May be NULL.
+*
+* @return   0 if not found, 1 if found
+**/
+HT_EXTERN int
+HT_EXPORT(htable_sharded_get)
+HT_ARGS((
+    struct HT_EXPORT(htable_sharded) *table,
+    uint32_t key_size,
+    void *key,
+    void **data
+));
+
+/**
+* htable_sharded_lookup()
+*
+* Look up key, and call fn with its entry while the shard's read lock
+* is held. fn must not modify the table.
+*
+* @param    struct htable_sharded *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+* @param    htable_scanfn fn
+* @param    void *ctx
+*               - Passed to fn unchanged
+*
+* @return   0 if not found, 1 if found
+**/
+HT_EXTERN int
+HT_EXPORT(htable_sharded_lookup)
+HT_ARGS((
+    struct HT_EXPORT(htable_sharded) *table,
+    uint32_t key_size,
+    void *key,
+    HT_EXPORT(htable_scanfn) fn,
+    void *ctx
+));
+
+/**
+* htable_sharded_foreach()
+*
+* Call fn for every entry, one shard at a time, under that shard's read
+* lock. Entries added or removed concurrently in other shards may or may
+* not be seen. fn must not modify the table.
+*
+* @param    struct htable_sharded *table
+* @param    htable_scanfn fn
+* @param    void *ctx
+*               - Passed to fn unchanged
+*
+* @return   void
+**/
+HT_EXTERN void
+HT_EXPORT(htable_sharded_foreach)
+HT_ARGS((
+    struct HT_EXPORT(htable_sharded) *table,
+    HT_EXPORT(htable_scanfn) fn,
+    void *ctx
+));
+
+/**
+* htable_sharded_used()
+*
+* Number of entries in the table, summed shard by shard. Only exact if
+* no other thread is writing.
+*
+* @param    struct htable_sharded *table
+* @return   uint32_t
+**/
+HT_EXTERN uint32_t
+HT_EXPORT(htable_sharded_used)
+HT_ARGS((
+    struct HT_EXPORT(htable_sharded) *table
+));
+
+#endif
+
+#ifndef __HT_INTERNAL
+  #undef HT_EXTERN
+  #undef HT_ARGS
+  #undef HT_EXPORT
+#endif
@@ -1,8 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <memory.h>
 #include <stdint.h>
 #include <limits.h>
+#include <math.h>
 
 #include "config.h"
 
@@ -10,7 +12,19 @@
 #include "hashtable.h"
 #include "MurmurHash3.h"
 
-#define HT_STRUCT(in) struct HT_EXPORT(in)
+/* Rebuilds can be split over threads, which claim slots atomically */
+#if defined(USE_PTHREAD) && defined(__GNUC__)
+    #define HT_PARALLEL
+    #include <pthread.h>
+#endif
+
+/* Seqlock readers give up the CPU while a write section is open */
+#ifdef USE_PTHREAD
+    #include <sched.h>
+    #define HT_YIELD() sched_yield()
+#else
+    #define HT_YIELD()
+#endif
 
 #if __WORDSIZE == 64
 
@@ -123,640 +137,3986 @@ HT_ARGS((
     return 0;
 }
 
+/* Marks a slot whose entry was removed. Lookups must probe past it. */
+#define HT_TOMBSTONE UINT32_MAX
+
+/* Initial capacity of the dense entries/hashes arrays */
+#define HT_ENTRIES_MIN 8
+
+/* Slot i of a slot array, given the slot size */
+#define HT_SLOT_AT(base, slot_size, i) \
+    ((HT_STRUCT(htable_entry) *)((char *)(base) + (size_t)(i) * (slot_size)))
+
+/* Slot i of the table, in the flat slot array or in a page */
+#define HT_SLOT(t, i) \
+    ((t)->pages == NULL ? \
+     HT_SLOT_AT((t)->table, (t)->slot_size, (i)) : \
+     HT_SLOT_AT((t)->pages[(i) / HT_PAGE_SLOTS], (t)->slot_size, \
+                (i) % HT_PAGE_SLOTS))
+
+/* Number of pages of a HT_FLAG_COW table of "size" slots */
+#define HT_PAGES(size) (((size) + HT_PAGE_SLOTS - 1) / HT_PAGE_SLOTS)
+
+/* Pages are preceded by a header holding their reference count. The
+   header size keeps slots aligned for any member type. */
+#define HT_PAGE_HEADER 16
+#define HT_PAGE_REFS(page) \
+    (*(uint32_t *)((char *)(page) - HT_PAGE_HEADER))
+
+/* Inline key storage of a slot (HT_FLAG_INLINE_KEYS) */
+#define HT_INLINE_KEY(t, ent) ((char *)(ent) + (t)->key_offset)
+
+/* Whether a key of key_size fits inline, including its NUL terminator */
+#define HT_KEY_FITS(key_size) ((key_size) < HT_INLINE_KEY_SIZE)
+
+/* Keys of at least HT_TAIL_CMP_MIN bytes have their last
+   HT_TAIL_CMP_SIZE bytes compared first */
+#define HT_TAIL_CMP_MIN 32
+#define HT_TAIL_CMP_SIZE 8
+
+/* Inline value storage of a slot (HT_FLAG_INLINE_VALUES) */
+#define HT_INLINE_VALUE(ent) ((void *)&(ent)->data)
+
+/* Data of an entry: NULL for sets, the inline value or the data pointer */
+#define HT_DATA(t, ent) \
+    (((t)->flags & HT_FLAG_SET) ? NULL : \
+     ((t)->flags & HT_FLAG_INLINE_VALUES) ? HT_INLINE_VALUE(ent) : (ent)->data)
+
+/* Round n up to a multiple of the pointer size */
+#define HT_ALIGN(n) \
+    (((n) + sizeof(void *) - 1) & ~(uint32_t)(sizeof(void *) - 1))
+
+/* i'th entry of the table, in dense order */
+#define HT_ENTRY(t, i) HT_SLOT((t), (t)->entries[(i)])
+
+/* Slot array replaced while HT_FLAG_SEQLOCK readers may still be in it */
+struct HT_EXPORT(htable_retired) {
+    HT_STRUCT(htable_retired) *next;
+    HT_STRUCT(htable_entry) *table;
+};
+
+#if defined(__GNUC__)
+    #define HT_PREFETCH(addr) __builtin_prefetch((addr))
+#else
+    #define HT_PREFETCH(addr) ((void)(addr))
+#endif
+
+/* Dense order loops touch a random slot per entry. Prefetch the slot
+   HT_PREFETCH_DISTANCE entries ahead of i, and the key of the slot half
+   as far ahead, by which time that slot should be in cache. */
+#define HT_PREFETCH_ENTRY(t, i) \
+    do { \
+        if ((i) + HT_PREFETCH_DISTANCE < (t)->used) { \
+            HT_PREFETCH(HT_ENTRY((t), (i) + HT_PREFETCH_DISTANCE)); \
+        } \
+        if ((i) + HT_PREFETCH_DISTANCE / 2 < (t)->used) { \
+            HT_PREFETCH(HT_ENTRY((t), (i) + HT_PREFETCH_DISTANCE / 2)->key); \
+        } \
+    } while (0)
+
 /**
-* htable_new()
-*
-* Create a new hash table
+* Compare key against the key of ent, which is known to be of the same
+* size. Tables with HT_FLAG_MEMCMP or HT_FLAG_INLINE_KEYS compare bytes
+* with memcmp(), checking the tail first: long keys such as URLs tend to
+* share a prefix, so that rejects most mismatches within a few bytes.
 *
-* @param    uint32_t size
-* @param    uint32_t seed
-* @param    htable_cmpfn cmpfn
-*               - See function typedef prototypes for more information
-* @param    htable_copyfn copyfn
-*               - See function typedef prototypes for more information
-* @param    htable_freefn freefn
-*               - See function typedef prototypes for more information
-* @return   struct htable *
-*               NULL on error
+* @param    struct htable *table
+* @param    struct htable_entry *ent
+* @param    void *key
+* @return   int, non-zero if equal
 **/
-HT_STRUCT(htable) *
-HT_EXPORT(htable_new)
-HT_ARGS((
-    uint32_t size,
-    uint32_t random_seed,
-    HT_EXPORT(htable_cmpfn) cmpfn,
-    HT_EXPORT(htable_copyfn) copyfn,
-    HT_EXPORT(htable_freefn) freefn
-)) {
-    HT_STRUCT(htable) *table;
-    
-    /* cmpfn is required */
-    if (cmpfn == NULL) {
-        return NULL;
-    }
+static int
+htable_key_equal(
+    HT_STRUCT(htable) *table,
+    HT_STRUCT(htable_entry) *ent,
+    void *key
+) {
+    uint32_t key_size = ent->key_size;
+    char *stored;
     
-    table = malloc(sizeof(*table));
-    if (!table) {
-        return NULL;
+    if (!(table->flags & (HT_FLAG_MEMCMP | HT_FLAG_INLINE_KEYS))) {
+        return table->cmpfn(key, ent->key) == 0;
     }
     
-    memset(table, 0, sizeof(*table));
-    table->table = malloc(sizeof(*table->table) * size);
-    if (!table->table) {
-        free(table);
-        return NULL;
+    if ((table->flags & HT_FLAG_INLINE_KEYS) && HT_KEY_FITS(key_size)) {
+        /* Read short keys straight from the slot, no pointer chase */
+        stored = HT_INLINE_KEY(table, ent);
+    } else {
+        stored = ent->key;
     }
     
-    table->entries = malloc(sizeof(*table->entries) * size);
-    if (!table->entries) {
-        free(table->table);
-        free(table);
-        return NULL;
+    if (    key_size >= HT_TAIL_CMP_MIN &&
+            memcmp((char *)key + key_size - HT_TAIL_CMP_SIZE,
+                   stored + key_size - HT_TAIL_CMP_SIZE,
+                   HT_TAIL_CMP_SIZE) != 0) {
+        return 0;
     }
     
-    memset(table->table, 0, sizeof(*table->table) * size);
-    memset(table->entries, 0, sizeof(*table->entries) * size);
-    table->size = size;
-    table->used = 0;
-    table->seed = random_seed;
-    table->copyfn = copyfn;
-    table->freefn = freefn;
-    table->cmpfn = cmpfn;
-    
-    return table;
+    return memcmp(key, stored, key_size) == 0;
 }
 
 /**
-* htable_clone()
-*
-* Clone hash table, returning new object. If table->copyfn is not NULL,
-* it will be used to copy data into the new hash table.
+* Compare the key made of fragments iov[0..iovcnt) against the key_size
+* bytes at "stored". The last fragment is compared first, as it tends to
+* be the most distinctive.
 *
-* @param    struct htable *src
-* @return   struct htable *
-*               NULL on error
+* @param    const char *stored
+* @param    uint32_t key_size
+* @param    struct htable_iovec *iov
+* @param    int iovcnt
+* @return   int, non-zero if equal
 **/
-HT_EXTERN HT_STRUCT(htable) *
-HT_EXPORT(htable_clone)
-HT_ARGS((
-    HT_STRUCT(htable) *src
-)) {
+static int
+htable_bytes_equal_iov(
+    const char *stored,
+    uint32_t key_size,
+    const HT_STRUCT(htable_iovec) *iov,
+    int iovcnt
+) {
+    uint32_t offset;
+    int i;
     
-    uint32_t i, hash;
+    offset = key_size - iov[iovcnt - 1].len;
+    if (memcmp(stored + offset, iov[iovcnt - 1].base, iov[iovcnt - 1].len) != 0) {
+        return 0;
+    }
     
-    HT_STRUCT(htable_entry) *table,
-                            **entries;
+    offset = 0;
+    for (i = 0; i < iovcnt - 1; i++) {
+        if (memcmp(stored + offset, iov[i].base, iov[i].len) != 0) {
+            return 0;
+        }
+        
+        offset += iov[i].len;
+    }
     
-    HT_STRUCT(htable) *dst = HT_EXPORT(htable_new)(
-                                    src->size,
-                                    src->seed,
-                                    src->cmpfn,
-                                    src->copyfn,
-                                    src->freefn);
+    return 1;
+}
+
+/**
+* Compare the key made of fragments iov[0..iovcnt) against the key of
+* ent, which is known to be of the same total size. Only for tables that
+* compare bytes (HT_FLAG_MEMCMP or HT_FLAG_INLINE_KEYS).
+*
+* @param    struct htable *table
+* @param    struct htable_entry *ent
+* @param    struct htable_iovec *iov
+* @param    int iovcnt
+* @return   int, non-zero if equal
+**/
+static int
+htable_key_equal_iov(
+    HT_STRUCT(htable) *table,
+    HT_STRUCT(htable_entry) *ent,
+    const HT_STRUCT(htable_iovec) *iov,
+    int iovcnt
+) {
+    char *stored;
     
-    if (!dst) {
-        return NULL;
+    if ((table->flags & HT_FLAG_INLINE_KEYS) && HT_KEY_FITS(ent->key_size)) {
+        stored = HT_INLINE_KEY(table, ent);
+    } else {
+        stored = ent->key;
     }
     
-    /* Retain pointers */
-    table = dst->table;
-    entries = dst->entries;
-    
-    /* Zero out tables */
-    memset(table, 0, sizeof(*table) * src->size);
-    memset(entries, 0, sizeof(*entries) * src->size);
+    return htable_bytes_equal_iov(stored, ent->key_size, iov, iovcnt);
+}
+
+/**
+* Walk the probe sequence for hash, looking for key. If free_slot is not
+* NULL, it receives the index of the first reusable slot (tombstone or
+* empty) seen along the way, or HT_TOMBSTONE if the table has none.
+*
+* Probing is triangular: h, h+1, h+3, h+6, ... which visits every slot
+* when the table size is a power of two. The walk stops at the first
+* slot that has never been used.
+*
+* The key is either contiguous (key), or made of fragments (iov and
+* iovcnt, with key NULL). See htable_probe() for the common case.
+*
+* @param    struct htable *table
+* @param    uint32_t hash
+* @param    uint32_t key_size
+* @param    void *key
+* @param    struct htable_iovec *iov
+* @param    int iovcnt
+* @param    uint32_t *free_slot
+* @return   pointer to matching entry, NULL if not found
+**/
+static HT_STRUCT(htable_entry) *
+htable_probe_ex(
+    HT_STRUCT(htable) *table,
+    uint32_t hash,
+    uint32_t key_size,
+    void *key,
+    const HT_STRUCT(htable_iovec) *iov,
+    int iovcnt,
+    uint32_t *free_slot
+) {
+    uint32_t slot = hash % table->size,
+             step = 0;
     
-    /* Copy memory */
-    memcpy(dst, src, sizeof(*dst));
+    HT_STRUCT(htable_entry) *ent;
     
-    /* Link pointers */
-    dst->table = table;
-    dst->entries = entries;
+    if (free_slot != NULL) {
+        *free_slot = HT_TOMBSTONE;
+    }
     
-    if (src->copyfn == NULL) {
-        for (i = 0; i < src->used; i++) {
-            /* TODO: Use memcpy()??? */
+    while (step < table->size) {
+        ent = HT_SLOT(table, slot);
         
-            hash = src->entries[i]->hash;
-            dst->table[hash].key_size = src->entries[i]->key_size;
-            dst->table[hash].key = src->entries[i]->key;
-            dst->table[hash].data = src->entries[i]->data;
-            dst->table[hash].entry = i;
-            dst->table[hash].hash = hash;
-            dst->entries[i] = &dst->table[hash];
-        }
-    } else {
-        for (i = 0; i < src->used; i++) {
-            hash = src->entries[i]->hash;
+        if (ent->key == NULL) {
+            if (ent->entry != HT_TOMBSTONE) {
+                /* Never used, end of chain */
+                if (free_slot != NULL && *free_slot == HT_TOMBSTONE) {
+                    *free_slot = slot;
+                }
+                
+                return NULL;
+            }
             
-            src->copyfn(&dst->table[hash], src->entries[i]->key, src->entries[i]->data);
-            dst->entries[i] = &dst->table[hash];
+            /* Tombstones of HT_FLAG_RCU tables wait for a rebuild */
+            if (    free_slot != NULL && *free_slot == HT_TOMBSTONE &&
+                    !(table->flags & HT_FLAG_RCU)) {
+                *free_slot = slot;
+            }
+        } else if (ent->key_size == key_size) {
+            if (key != NULL ? htable_key_equal(table, ent, key) :
+                    htable_key_equal_iov(table, ent, iov, iovcnt)) {
+                return ent;
+            }
         }
+        
+        step += 1;
+        slot = (slot + step) % table->size;
     }
     
-    return dst;
+    return NULL;
 }
 
 /**
-* htable_delete()
+* Walk the probe sequence for hash, looking for contiguous key. See
+* htable_probe_ex().
 *
-* Delete hash table created by htable_new(). If table->freefn is not NULL,
-* it will be called for each element, so allocated memory can be freed.
+* @param    struct htable *table
+* @param    uint32_t hash
+* @param    uint32_t key_size
+* @param    void *key
+* @param    uint32_t *free_slot
+* @return   pointer to matching entry, NULL if not found
+**/
+static HT_STRUCT(htable_entry) *
+htable_probe(
+    HT_STRUCT(htable) *table,
+    uint32_t hash,
+    uint32_t key_size,
+    void *key,
+    uint32_t *free_slot
+) {
+    return htable_probe_ex(table, hash, key_size, key, NULL, 0, free_slot);
+}
+
+/**
+* Walk the probe sequence for hash in slot array "slots" of "size" slots,
+* looking for key, while a writer may be modifying the table
+* (HT_FLAG_RCU, HT_FLAG_SEQLOCK). Each slot's key pointer is read once,
+* with acquire ordering, so the key_size and data stored before it was
+* published are seen too. The key is contiguous (key) or made of
+* fragments (iov and iovcnt, with key NULL). See htable_probe_ex().
 *
 * @param    struct htable *table
-* @return   void
+* @param    struct htable_entry *slots
+* @param    uint32_t size
+* @param    uint32_t hash
+* @param    uint32_t key_size
+* @param    void *key
+* @param    struct htable_iovec *iov
+* @param    int iovcnt
+* @return   pointer to matching entry, NULL if not found
 **/
-void
-HT_EXPORT(htable_delete)
-HT_ARGS((
-    HT_STRUCT(htable) *table
-)) {
+static HT_STRUCT(htable_entry) *
+htable_probe_rcu(
+    HT_STRUCT(htable) *table,
+    HT_STRUCT(htable_entry) *slots,
+    uint32_t size,
+    uint32_t hash,
+    uint32_t key_size,
+    void *key,
+    const HT_STRUCT(htable_iovec) *iov,
+    int iovcnt
+) {
+    uint32_t slot = hash % size,
+             step = 0;
+    void *stored;
     
-    uint32_t i;
+    HT_STRUCT(htable_entry) *ent;
     
-    if (table->freefn != NULL) {
-        for (i = 0; i < table->used; i++) {
-            if (table->entries[i] && table->entries[i]->key) {
-                /* Call freefn() */
-                table->freefn(table->entries[i]);
+    while (step < size) {
+        ent = HT_SLOT_AT(slots, table->slot_size, slot);
+        stored = HT_LOAD_ACQUIRE(ent->key);
+        
+        if (stored == NULL) {
+            /* Removal marks the tombstone before clearing the key */
+            if (HT_LOAD_ACQUIRE(ent->entry) != HT_TOMBSTONE) {
+                return NULL;
+            }
+        } else if (ent->key_size == key_size) {
+            if (key == NULL) {
+                /* Readers never see inline keys, stored is the key */
+                if (htable_bytes_equal_iov(stored, key_size, iov, iovcnt)) {
+                    return ent;
+                }
+            } else if ((table->flags & HT_FLAG_MEMCMP) ?
+                       memcmp(key, stored, key_size) == 0 :
+                       table->cmpfn(key, stored) == 0) {
+                return ent;
             }
         }
+        
+        step += 1;
+        slot = (slot + step) % size;
     }
     
-    free(table->table);
-    free(table->entries);
-    free(table);
+    return NULL;
 }
 
 /**
-* htable_resize()
-*
-* Resize hash table, normally for growing, but can also be used to
-* shrink the size of the table.
+* Make room for at least "size" entries in table->entries and
+* table->hashes, growing them geometrically.
 *
 * @param    struct htable *table
-* @param    uint8_t load_thresh
-*               Number between 0 and 100. If load factor is below it,
-*               then resize won't trigger. Use 0 to disable.
-*
-* @param    uint32_t new_size
+* @param    uint32_t size
 * @return   0 on error, 1 on success
 **/
-int
-HT_EXPORT(htable_resize)
-HT_ARGS((
+static int
+htable_entries_reserve(
     HT_STRUCT(htable) *table,
-    uint8_t load_thresh,
-    uint32_t new_size
-)) {
-
-    uint32_t i, res;
-    float load_calc;
-    
-    HT_STRUCT(htable) tmp_table;
-    HT_STRUCT(htable_entry) *new_table;
-    HT_STRUCT(htable_entry) **new_entries;
+    uint32_t size
+) {
+    uint32_t new_size = table->entries_size;
+    uint32_t *new_entries,
+             *new_hashes;
     
-    /* Check load_thresh before proceeding */
-    load_calc = 100.0f * ((float)table->used / (float)table->size);
-    if (load_thresh && load_calc < load_thresh) {
+    if (size <= table->entries_size) {
         return 1;
     }
     
-    new_table = malloc(sizeof(*new_table) * new_size);
-    if (!new_table) {
-        return 0;
+    if (new_size < HT_ENTRIES_MIN) {
+        new_size = HT_ENTRIES_MIN;
     }
     
-    new_entries = malloc(sizeof(*new_entries) * new_size);
+    while (new_size < size) {
+        if (new_size > UINT32_MAX / 2) {
+            new_size = size;
+            break;
+        }
+        
+        new_size *= 2;
+    }
+    
+    new_entries = realloc(table->entries, sizeof(*new_entries) * new_size);
     if (!new_entries) {
-        free(new_table);
         return 0;
     }
     
-    /* Zero out */
-    memset(&tmp_table, 0, sizeof(tmp_table));
-    memset(new_table, 0, sizeof(*new_table) * new_size);
-    memset(new_entries, 0, sizeof(*new_entries) * new_size);
-    
-    /* Set variables on tmp_table */
-    tmp_table.table = new_table;
-    tmp_table.entries = new_entries;
-    tmp_table.size = new_size;
-    tmp_table.used = 0;
-    tmp_table.seed = table->seed;
-    tmp_table.copyfn = NULL;
-    tmp_table.freefn = NULL;
-    tmp_table.cmpfn = table->cmpfn;
+    table->entries = new_entries;
     
-    /* Iterate over source */
-    for (i = 0; i < table->used; i++) {
-        
-        /* Add entries to new table array */
-        res = HT_EXPORT(htable_add)(
-                        &tmp_table,
-                        table->entries[i]->key_size,
-                        table->entries[i]->key,
-                        table->entries[i]->data);
-        
-        /* Catch error */
-        if (!res) {
-            free(new_table);
-            free(new_entries);
-            return 0;
-        }
+    new_hashes = realloc(table->hashes, sizeof(*new_hashes) * new_size);
+    if (!new_hashes) {
+        return 0;
     }
     
-    /* Free old memory */
-    free(table->table);
-    free(table->entries);
-    
-    /* Link up new data */
-    table->table = new_table;
-    table->entries = new_entries;
-    table->size = new_size;
-    table->used = tmp_table.used;
+    table->hashes = new_hashes;
+    table->entries_size = new_size;
     
     return 1;
 }
 
 /**
-* Create new htable_collection object.
+* Shrink table->entries and table->hashes to fit table->used.
 *
-* @param    uint32_t size
-* @return   NULL on error
+* @param    struct htable *table
+* @return   void
 **/
-HT_STRUCT(htable_collection) *
-HT_EXPORT(htable_collection_new)
-HT_ARGS((
-    uint32_t size
-)) {
-    HT_STRUCT(htable_collection) *collection
-        = malloc(sizeof(*collection));
+static void
+htable_entries_trim(
+    HT_STRUCT(htable) *table
+) {
+    uint32_t new_size = table->used;
+    uint32_t *new_entries,
+             *new_hashes;
     
-    if (!collection) {
-        return NULL;
+    if (new_size < HT_ENTRIES_MIN) {
+        new_size = HT_ENTRIES_MIN;
     }
     
-    memset(collection, 0, sizeof(*collection));
-    collection->list = malloc(sizeof(*(collection->list)) * size);
-    if (!collection->list) {
-        free(collection);
-        return NULL;
+    if (new_size >= table->entries_size) {
+        return;
     }
     
-    collection->size = size;
-    collection->used = 0;
+    /* Shrinking realloc() can only fail by keeping the old block */
+    new_entries = realloc(table->entries, sizeof(*new_entries) * new_size);
+    new_hashes = realloc(table->hashes, sizeof(*new_hashes) * new_size);
     
-    return collection;
+    if (new_entries) {
+        table->entries = new_entries;
+    }
+    
+    if (new_hashes) {
+        table->hashes = new_hashes;
+    }
+    
+    if (new_entries && new_hashes) {
+        table->entries_size = new_size;
+    }
 }
 
 /**
-* Resize htable_collection object.
+* Allocate a page of "bytes" bytes of slots, with one reference, copied
+* from src, or zero filled if src is NULL.
 *
-* @param    struct htable_collection *
-* @param    uint32_t size
-* @return   NULL on error
+* @param    size_t bytes
+* @param    void *src
+* @return   pointer to the first slot, NULL on error
 **/
-int
-HT_EXPORT(htable_collection_resize)
-HT_ARGS((
-    HT_STRUCT(htable_collection) *collection,
-    uint32_t size
-)) {
-    HT_STRUCT(htable_entry) **new_list;
+static void *
+htable_page_alloc(
+    size_t bytes,
+    const void *src
+) {
+    char *page = malloc(HT_PAGE_HEADER + bytes);
     
-    if (size < collection->used) {
-        /* Elements wont fit */
-        return 0;
+    if (!page) {
+        return NULL;
     }
     
-    new_list = malloc(sizeof(*new_list) * (size + 1));
-    if (!new_list) {
-        return 0;
-    }
+    page += HT_PAGE_HEADER;
+    HT_PAGE_REFS(page) = 1;
     
-    memcpy(new_list, collection->list, sizeof(*new_list) * (collection->used + 1));
-    free(collection->list);
-    collection->list = new_list;
+    if (src != NULL) {
+        memcpy(page, src, bytes);
+    } else {
+        memset(page, 0, bytes);
+    }
     
-    return 1;
+    return page;
 }
 
 /**
-* Delete htable_collection object created by htable_collection_new
+* Drop a reference to page, freeing it with the last one.
 *
-* @param    struct htable_collection *
+* @param    void *page
 * @return   void
 **/
-void
-HT_EXPORT(htable_collection_delete)
-HT_ARGS((
-    HT_STRUCT(htable_collection) *collection
-)) {
-    if (!collection) {
-        return;
+static void
+htable_page_release(
+    void *page
+) {
+    if (HT_ATOMIC_DEC(HT_PAGE_REFS(page)) == 0) {
+        free((char *)page - HT_PAGE_HEADER);
     }
+}
+
+/**
+* Size in bytes of page k of table. The last page only holds the slots
+* left over.
+*
+* @param    struct htable *table
+* @param    uint32_t k
+* @return   size_t
+**/
+static size_t
+htable_page_bytes(
+    HT_STRUCT(htable) *table,
+    uint32_t k
+) {
+    uint32_t slots = table->size - k * HT_PAGE_SLOTS;
     
-    if (collection->list) {
-        free(collection->list);
+    if (slots > HT_PAGE_SLOTS) {
+        slots = HT_PAGE_SLOTS;
     }
     
-    free(collection);
+    return (size_t)table->slot_size * slots;
 }
 
 /**
-* htable_add()
-*
-* Add item to hash table. 
+* Allocate zeroed slot storage for table->size slots: a flat array, or
+* pages for HT_FLAG_COW tables.
 *
 * @param    struct htable *table
-* @param    uint32_t key_size
-*               - sizeof(key) for ints
-*               - strlen(key) for strings
-* @param    void *key
-* @param    void *data
-*
 * @return   0 on error, 1 on success
 **/
-int
-HT_EXPORT(htable_add)
-HT_ARGS((
-    HT_STRUCT(htable) *table,
-    uint32_t key_size,
-    void *key,
-    void *data
-)) {
-    
-    uint32_t hash,
-             step = 0;
+static int
+htable_slots_alloc(
+    HT_STRUCT(htable) *table
+) {
+    uint32_t k, npages;
     
-    /* Get initial hash */
-    MurmurHash3_x86_32(key, key_size, table->seed, &hash);
+    table->table = NULL;
+    table->pages = NULL;
     
-    do {
-        /* Quadratic Probing Function:
-            h = (h + (step * step - step) / 2) % size */
-        hash = (hash + (step * step - step) / 2) % table->size;
-        
-        if (table->table[hash].key == NULL) {
-            goto insert;
-        } else if (table->cmpfn(key, table->table[hash].key) == 0) {
-            /* Replace */
-            if (table->freefn != NULL) {
-                /* Call freefn() */
-                table->freefn(&(table->table[hash]));
-            }
-            
-            goto replace;
+    if (!(table->flags & HT_FLAG_COW)) {
+        table->table = malloc((size_t)table->slot_size * table->size);
+        if (!table->table) {
+            return 0;
         }
         
-        step += 1;
-    } while (hash);
+        memset(table->table, 0, (size_t)table->slot_size * table->size);
+        return 1;
+    }
     
-    return 0;
+    npages = HT_PAGES(table->size);
+    table->pages = malloc(sizeof(*table->pages) * npages);
+    if (!table->pages) {
+        return 0;
+    }
     
-        insert:
-            table->table[hash].hash = hash;
-            table->table[hash].entry = table->used;
-            table->entries[table->used] = &table->table[hash];
-            table->used++;
-            
-        replace:
-            table->table[hash].key_size = key_size;
-            if (table->copyfn) {
-                table->copyfn(&(table->table[hash]), key, data);
-            } else {
-                table->table[hash].key = key;
-                table->table[hash].data = data;
+    for (k = 0; k < npages; k++) {
+        table->pages[k] = htable_page_alloc(htable_page_bytes(table, k), NULL);
+        if (!table->pages[k]) {
+            while (k--) {
+                htable_page_release(table->pages[k]);
             }
+            
+            free(table->pages);
+            table->pages = NULL;
+            return 0;
+        }
+    }
     
     return 1;
 }
 
 /**
-* htable_add_loop()
-*
-* Unlink htable_add(), which will fail on its first try, htable_add_loop()
-* will try a maximum of "max_loops" times to add an item before giving up.
-* It uses a quadratic resizing algorithm, so its best to keep max_loops
-* relatively small.
+* Release slot storage of table, dropping page references.
 *
 * @param    struct htable *table
-* @param    uint32_t key_size
-*               - sizeof(key) for ints
-*               - strlen(key) for strings
-* @param    void *key
-* @param    void *data
-* @param    int max_loops
-*
-* @return   0 on failure, otherwise the number of loops it took to
-*           successfully add item.
+* @return   void
 **/
-int
-HT_EXPORT(htable_add_loop)
-HT_ARGS((
-    HT_STRUCT(htable) *table,
-    uint32_t key_size,
-    void *key,
-    void *data,
-    int max_loops
-)) {
-    int loop;
-    int chunk = table->size;
-    int size = table->size;
+static void
+htable_slots_free(
+    HT_STRUCT(htable) *table
+) {
+    uint32_t k;
     
-    max_loops++;
-    for (loop = 1; loop < max_loops; loop++) {
-        if (HT_EXPORT(htable_add)(table, key_size, key, data)) {
-            return loop;
+    if (table->pages != NULL) {
+        for (k = 0; k < HT_PAGES(table->size); k++) {
+            htable_page_release(table->pages[k]);
         }
         
-        size += chunk;
-        chunk += (chunk / 2);
-        
-        if (!HT_EXPORT(htable_resize)(table, 0, size)) {
-            return 0;
-        }
+        free(table->pages);
     }
     
-    return 0;
+    free(table->table);
 }
 
 /**
-* htable_remove()
+* Make page k private to table, copying it if a snapshot shares it.
 *
-* Remove item from hash table.
+* @param    struct htable *table
+* @param    uint32_t k
+* @return   0 on error, 1 on success
+**/
+static int
+htable_page_own(
+    HT_STRUCT(htable) *table,
+    uint32_t k
+) {
+    void *page = table->pages[k],
+         *copy;
+    
+    if (HT_PAGE_REFS(page) == 1) {
+        return 1;
+    }
+    
+    copy = htable_page_alloc(htable_page_bytes(table, k), page);
+    if (!copy) {
+        return 0;
+    }
+    
+    table->pages[k] = copy;
+    htable_page_release(page);
+    
+    return 1;
+}
+
+/**
+* Get slot i for writing. For HT_FLAG_COW tables, the page holding it is
+* made private first, which moves it: pointers into a shared page must
+* be looked up again through this.
 *
+* @param    struct htable *table
+* @param    uint32_t i
+* @return   pointer to the slot, NULL on error
+**/
+static HT_STRUCT(htable_entry) *
+htable_slot_mut(
+    HT_STRUCT(htable) *table,
+    uint32_t i
+) {
+    if (table->pages != NULL && !htable_page_own(table, i / HT_PAGE_SLOTS)) {
+        return NULL;
+    }
+    
+    return HT_SLOT(table, i);
+}
+
+/**
+* Copy key into table owned storage of ent (HT_FLAG_INLINE_KEYS). Short
+* keys are stored in the slot, long keys are spilled to the heap. Either
+* way the copy is NUL terminated, and ent->key points to it.
 *
 * @param    struct htable *table
+* @param    struct htable_entry *ent
 * @param    uint32_t key_size
-*               - sizeof(key) for ints
-*               - strlen(key) for strings
 * @param    void *key
-*
 * @return   0 on error, 1 on success
 **/
-int
-HT_EXPORT(htable_remove)
-HT_ARGS((
+static int
+htable_store_key(
     HT_STRUCT(htable) *table,
+    HT_STRUCT(htable_entry) *ent,
     uint32_t key_size,
     void *key
-)) {
-
-    uint32_t hash,
-             step = 0;
-    
-    /* Get initial hash */
-    MurmurHash3_x86_32(key, key_size, table->seed, &hash);
+) {
+    char *dst;
     
-    do {
-        /* Quadratic Probing */
-        hash = (hash + (step * step - step) / 2) % table->size;
-        
-        if (    table->table[hash].key &&
-                table->cmpfn(key, table->table[hash].key) == 0) {
-            
-            if (table->freefn != NULL) {
-                /* Call freefn() */
-                table->freefn(&table->table[hash]);
-            }
-            
-            if (table->used > 0) {
-                /* Swap current entry with last entry, then NULL out last entry
-                   to maintain linear array of pointers to elements. */
-                table->entries[table->table[hash].entry] = table->entries[table->used-1];
-                table->entries[table->table[hash].entry]->entry = table->table[hash].entry;
-                table->entries[table->used-1] = NULL;
-            } else {
-                table->entries[0] = NULL;
-            }
-            
-            /* Zero out entry */
-            memset(&table->table[hash], 0, sizeof(*table->table));
-            
-            /* Decrement used count */
-            table->used--;
-            return 1;
+    if (HT_KEY_FITS(key_size)) {
+        dst = HT_INLINE_KEY(table, ent);
+    } else {
+        dst = malloc((size_t)key_size + 1);
+        if (!dst) {
+            return 0;
         }
-        
-        step += 1;
-    } while (hash);
+    }
     
-    return 0;
+    memcpy(dst, key, key_size);
+    dst[key_size] = '\0';
+    ent->key = dst;
+    ent->key_size = key_size;
+    
+    return 1;
 }
 
 /**
-* htable_get()
-*
-* Get entry from hash table.
+* Gather the key made of fragments iov[0..iovcnt) into table owned
+* storage of ent, as htable_store_key() does for contiguous keys.
 *
 * @param    struct htable *table
+* @param    struct htable_entry *ent
 * @param    uint32_t key_size
-*               - sizeof(key) for ints
-*               - strlen(key) for strings
-* @param    void *key
-*
-* @return   NULL on error, pointer on success
+*               - Total size of the fragments
+* @param    struct htable_iovec *iov
+* @param    int iovcnt
+* @return   0 on error, 1 on success
 **/
-HT_STRUCT(htable_entry) *
-HT_EXPORT(htable_get)
-HT_ARGS((
+static int
+htable_store_key_iov(
     HT_STRUCT(htable) *table,
+    HT_STRUCT(htable_entry) *ent,
     uint32_t key_size,
-    void *key
-)) {
+    const HT_STRUCT(htable_iovec) *iov,
+    int iovcnt
+) {
+    uint32_t offset = 0;
+    char *dst;
+    int i;
     
-    uint32_t hash,
-             step = 0;
+    if (HT_KEY_FITS(key_size)) {
+        dst = HT_INLINE_KEY(table, ent);
+    } else {
+        dst = malloc((size_t)key_size + 1);
+        if (!dst) {
+            return 0;
+        }
+    }
     
-    /* Get initial hash */
-    MurmurHash3_x86_32(key, key_size, table->seed, &hash);
+    for (i = 0; i < iovcnt; i++) {
+        memcpy(dst + offset, iov[i].base, iov[i].len);
+        offset += iov[i].len;
+    }
     
-    do {
-        /* Quadratic Probing */
-        hash = (hash + (step * step - step) / 2) % table->size;
-        
-        if (    table->table[hash].key &&
-                table->cmpfn(key, table->table[hash].key) == 0) {
-            return &(table->table[hash]);
-        }
-        
-        step += 1;
-    } while (hash);
+    dst[key_size] = '\0';
+    ent->key = dst;
+    ent->key_size = key_size;
     
-    return NULL;
+    return 1;
 }
 
 /**
-* htable_intersect()
-*
-* Get intersection of two hash tables, by key. Entries in the list
-* are pointers to elements in b, thus free()'ing b and then trying
-* to access elements in the list will likely cause a segfault. The
-* returned list can be freed via the htable_collection_delete()
-* function.
-*
-* Usage:
+* Release table owned key storage of ent (HT_FLAG_INLINE_KEYS).
 *
-* uint32_t i;
-* struct htable_collection *list = htable_intersect(a, b);
-* 
-* for (i = 0; i < list->used; i++) {
-*     printf("%s\n", (char *)(list->list[i]->key));
-* }
+* @param    struct htable *table
+* @param    struct htable_entry *ent
+* @return   void
+**/
+static void
+htable_free_key(
+    HT_STRUCT(htable) *table,
+    HT_STRUCT(htable_entry) *ent
+) {
+    if ((table->flags & HT_FLAG_INLINE_KEYS) && !HT_KEY_FITS(ent->key_size)) {
+        free(ent->key);
+    }
+}
+
+/**
+* Copy value_size bytes from data into the inline value of ent
+* (HT_FLAG_INLINE_VALUES). NULL data zero fills.
 *
-* htable_collection_delete(list);
+* @param    struct htable *table
+* @param    struct htable_entry *ent
+* @param    void *data
+* @return   void
+**/
+static void
+htable_store_value(
+    HT_STRUCT(htable) *table,
+    HT_STRUCT(htable_entry) *ent,
+    void *data
+) {
+    if (data != NULL) {
+        memcpy(HT_INLINE_VALUE(ent), data, table->value_size);
+    } else {
+        memset(HT_INLINE_VALUE(ent), 0, table->value_size);
+    }
+}
+
+/* Bits and 64 bit words per block of a Bloom filter */
+#define HT_BLOOM_BITS (HT_BLOOM_BLOCK * 8)
+#define HT_BLOOM_WORDS (HT_BLOOM_BLOCK / 8)
+
+/**
+* Create an empty Bloom filter for "capacity" keys, with false positive
+* rate fp_rate. The optimal k = ln 2 * bits per key is used, with bits
+* per key = -ln(fp_rate) / (ln 2)^2. Keeping each key's bits within one
+* block makes the rate a little worse than that of a plain filter.
 *
-* @param    struct htable *a
-* @param    struct htable *b
-* @return   struct htable_collection *
+* @param    uint32_t capacity
+* @param    double fp_rate
+* @return   struct htable_bloom *
 *               NULL on error
 **/
-HT_STRUCT(htable_collection) *
-HT_EXPORT(htable_intersect)
-HT_ARGS((
-    HT_STRUCT(htable) *a,
-    HT_STRUCT(htable) *b
-)) {
-
-    uint32_t max_size, i;
+static HT_STRUCT(htable_bloom) *
+htable_bloom_new(
+    uint32_t capacity,
+    double fp_rate
+) {
+    double ln2 = 0.69314718055994531,
+           bits_per_key = -log(fp_rate) / (ln2 * ln2),
+           nblocks = ceil(capacity * bits_per_key / HT_BLOOM_BITS);
     
-    HT_STRUCT(htable_collection) *collection;
-    HT_STRUCT(htable_entry) **list,
-                            *tmp;
-
-    if (a->used > b->used) {
-        max_size = a->used;
-    } else {
-        max_size = a->used;
-    }
+    HT_STRUCT(htable_bloom) *bloom;
     
-    collection = HT_EXPORT(htable_collection_new)(max_size+1);
-    if (!collection) {
+    bloom = malloc(sizeof(*bloom));
+    if (!bloom) {
         return NULL;
     }
     
-    list = collection->list;
-    for (i = 0; i < a->used; i++) {
-        tmp = HT_EXPORT(htable_get)(b, a->entries[i]->key_size, a->entries[i]->key);
-        
-        if (tmp != NULL) {
-            list[0] = tmp;
-            list++;
-            collection->used++;
-        }
+    memset(bloom, 0, sizeof(*bloom));
+    bloom->fp_rate = fp_rate;
+    bloom->k = (uint32_t)(bits_per_key * ln2 + 0.5);
+    if (bloom->k < 1) {
+        bloom->k = 1;
+    } else if (bloom->k > 16) {
+        /* Past this, more bits barely help in a block */
+        bloom->k = 16;
     }
     
-    list[0] = NULL;
-    return collection;
-}
-
-/**
-* htable_difference()
-*
-* Get difference of two hash tables, by key. Entries in the list
+    if (nblocks < 1) {
+        nblocks = 1;
+    } else if (nblocks > UINT32_MAX / HT_BLOOM_BLOCK) {
+        nblocks = UINT32_MAX / HT_BLOOM_BLOCK;
+    }
+    
+    bloom->nblocks = (uint32_t)nblocks;
+    bloom->mem = calloc((size_t)bloom->nblocks * HT_BLOOM_BLOCK + HT_BLOOM_BLOCK - 1, 1);
+    if (!bloom->mem) {
+        free(bloom);
+        return NULL;
+    }
+    
+    /* Each block on a cache line of its own */
+    bloom->blocks = (uint64_t *)(((uintptr_t)bloom->mem + HT_BLOOM_BLOCK - 1) &
+                                 ~(uintptr_t)(HT_BLOOM_BLOCK - 1));
+    
+    return bloom;
+}
+
+/**
+* Free Bloom filter.
+*
+* @param    struct htable_bloom *bloom
+* @return   void
+**/
+static void
+htable_bloom_free(
+    HT_STRUCT(htable_bloom) *bloom
+) {
+    if (bloom != NULL) {
+        free(bloom->mem);
+        free(bloom);
+    }
+}
+
+/**
+* Find the bits of hash in a Bloom filter: its block, and the first bit
+* and stride of its k bits within the block. The block comes from a
+* multiplicative remix of the hash, as the table's own slot comes from
+* its low bits. The stride is odd, so the k bits are all different.
+*
+* @param    struct htable_bloom *bloom
+* @param    uint32_t hash
+* @param    uint32_t *bit
+* @param    uint32_t *stride
+* @return   uint64_t *
+*               the block's words
+**/
+static uint64_t *
+htable_bloom_block(
+    HT_STRUCT(htable_bloom) *bloom,
+    uint32_t hash,
+    uint32_t *bit,
+    uint32_t *stride
+) {
+    uint32_t block, mix;
+    
+    block = (uint32_t)(((uint64_t)(uint32_t)(hash * 0x9E3779B1U) * bloom->nblocks) >> 32);
+    
+    mix = (hash ^ (hash >> 15)) * 0x85EBCA6BU;
+    mix ^= mix >> 13;
+    *bit = mix;
+    *stride = (mix >> 16) | 1;
+    
+    return bloom->blocks + (size_t)block * HT_BLOOM_WORDS;
+}
+
+/**
+* Add hash to Bloom filter.
+*
+* @param    struct htable_bloom *bloom
+* @param    uint32_t hash
+* @return   void
+**/
+static void
+htable_bloom_add(
+    HT_STRUCT(htable_bloom) *bloom,
+    uint32_t hash
+) {
+    uint32_t i, bit, stride;
+    uint64_t *words = htable_bloom_block(bloom, hash, &bit, &stride);
+    
+    for (i = 0; i < bloom->k; i++, bit += stride) {
+        words[(bit % HT_BLOOM_BITS) / 64] |= (uint64_t)1 << (bit % 64);
+    }
+}
+
+/**
+* Check hash against Bloom filter.
+*
+* @param    struct htable_bloom *bloom
+* @param    uint32_t hash
+* @return   0 if it was never added, 1 if it may have been
+**/
+static int
+htable_bloom_test(
+    HT_STRUCT(htable_bloom) *bloom,
+    uint32_t hash
+) {
+    uint32_t i, bit, stride;
+    uint64_t *words = htable_bloom_block(bloom, hash, &bit, &stride);
+    
+    for (i = 0; i < bloom->k; i++, bit += stride) {
+        if (!(words[(bit % HT_BLOOM_BITS) / 64] & ((uint64_t)1 << (bit % 64)))) {
+            return 0;
+        }
+    }
+    
+    return 1;
+}
+
+/**
+* Create a Bloom filter for table at "size" slots, as big as HT_MAX_LOAD
+* of them (or the entries it has, if more), with the same false positive
+* rate and statistics as the current one, and holding all of its keys.
+*
+* @param    struct htable *table
+* @param    uint32_t size
+* @param    double fp_rate
+* @return   struct htable_bloom *
+*               NULL on error
+**/
+static HT_STRUCT(htable_bloom) *
+htable_bloom_build(
+    HT_STRUCT(htable) *table,
+    uint32_t size,
+    double fp_rate
+) {
+    uint32_t i, capacity;
+    
+    HT_STRUCT(htable_bloom) *bloom;
+    
+    capacity = (uint32_t)((uint64_t)size * HT_MAX_LOAD / 100);
+    if (capacity < table->used) {
+        capacity = table->used;
+    }
+    
+    bloom = htable_bloom_new(capacity, fp_rate);
+    if (!bloom) {
+        return NULL;
+    }
+    
+    if (table->bloom != NULL) {
+        bloom->checks = table->bloom->checks;
+        bloom->skipped = table->bloom->skipped;
+        bloom->false_positives = table->bloom->false_positives;
+    }
+    
+    for (i = 0; i < table->used; i++) {
+        htable_bloom_add(bloom, table->hashes[i]);
+    }
+    
+    return bloom;
+}
+
+/**
+* Set the dense index (or HT_TOMBSTONE) of slot ent. Readers of
+* HT_FLAG_RCU and HT_FLAG_SEQLOCK tables load it on slots whose key they
+* saw NULL, while the writer may be claiming or moving that slot, so it
+* is stored atomically there.
+*
+* @param    struct htable *table
+* @param    struct htable_entry *ent
+* @param    uint32_t entry
+* @return   void
+**/
+static void
+htable_set_entry(
+    HT_STRUCT(htable) *table,
+    HT_STRUCT(htable_entry) *ent,
+    uint32_t entry
+) {
+    if (table->flags & (HT_FLAG_RCU | HT_FLAG_SEQLOCK)) {
+        HT_STORE_RELEASE(ent->entry, entry);
+    } else {
+        ent->entry = entry;
+    }
+}
+
+/**
+* Turn free slot "slot" (empty or tombstone, as found by htable_probe())
+* into a live entry for key: record it in the dense arrays, and copy the
+* key for HT_FLAG_INLINE_KEYS tables. Key pointer and data of other
+* tables are left for htable_fill(). key may be NULL when the key has
+* already been stored into the slot, after htable_entries_reserve() and
+* htable_slot_mut(), in which case this cannot fail.
+*
+* @param    struct htable *table
+* @param    uint32_t slot
+* @param    uint32_t hash
+* @param    uint32_t key_size
+* @param    void *key
+* @return   pointer to the entry, NULL on error
+**/
+static HT_STRUCT(htable_entry) *
+htable_claim(
+    HT_STRUCT(htable) *table,
+    uint32_t slot,
+    uint32_t hash,
+    uint32_t key_size,
+    void *key
+) {
+    HT_STRUCT(htable_entry) *ent;
+    
+    if (!htable_entries_reserve(table, table->used + 1)) {
+        return NULL;
+    }
+    
+    ent = htable_slot_mut(table, slot);
+    if (!ent) {
+        return NULL;
+    }
+    
+    if (    (table->flags & HT_FLAG_INLINE_KEYS) && key != NULL &&
+            !htable_store_key(table, ent, key_size, key)) {
+        return NULL;
+    }
+    
+    if (ent->entry == HT_TOMBSTONE) {
+        table->deleted--;
+        
+        if (table->flags & HT_FLAG_SEQLOCK) {
+            /* The tombstone kept its value, see htable_tombstone() */
+            memset((char *)ent + offsetof(HT_STRUCT(htable_entry), data), 0,
+                   table->slot_size - offsetof(HT_STRUCT(htable_entry), data));
+        }
+    }
+    
+    ent->key_size = key_size;
+    htable_set_entry(table, ent, table->used);
+    table->entries[table->used] = slot;
+    table->hashes[table->used] = hash;
+    table->used++;
+    
+    if (table->bloom != NULL) {
+        htable_bloom_add(table->bloom, hash);
+    }
+    
+    return ent;
+}
+
+/**
+* Store key and data into live entry ent, through copyfn if the table
+* has one. See htable_add().
+*
+* @param    struct htable *table
+* @param    struct htable_entry *ent
+* @param    uint32_t key_size
+* @param    void *key
+* @param    void *data
+* @return   void
+**/
+static void
+htable_fill(
+    HT_STRUCT(htable) *table,
+    HT_STRUCT(htable_entry) *ent,
+    uint32_t key_size,
+    void *key,
+    void *data
+) {
+    if (ent->key_size != key_size) {
+        /* Unchanged when replacing, so readers never see it written */
+        ent->key_size = key_size;
+    }
+    
+    if (table->flags & HT_FLAG_INLINE_VALUES) {
+        htable_store_value(table, ent, data);
+    }
+    
+    if (table->copyfn) {
+        table->copyfn(ent, key, (table->flags & HT_FLAG_SET) ? NULL : data);
+        return;
+    }
+    
+    if (table->flags & (HT_FLAG_RCU | HT_FLAG_SEQLOCK)) {
+        /* Readers may use the slot as soon as they see its key. A
+           replaced entry is live already, so its data is published on
+           its own. */
+        if (!(table->flags & (HT_FLAG_SET | HT_FLAG_INLINE_VALUES))) {
+            HT_STORE_RELEASE(ent->data, data);
+        }
+        
+        HT_STORE_RELEASE(ent->key, key);
+        return;
+    }
+    
+    if (!(table->flags & HT_FLAG_INLINE_KEYS)) {
+        ent->key = key;
+    }
+    
+    if (!(table->flags & (HT_FLAG_SET | HT_FLAG_INLINE_VALUES))) {
+        ent->data = data;
+    }
+}
+
+/**
+* Turn slot ent into a tombstone. Readers running alongside the writer
+* (HT_FLAG_RCU, HT_FLAG_SEQLOCK) may still be looking at it, so it keeps
+* its key_size and data, and its key is cleared last.
+*
+* @param    struct htable *table
+* @param    struct htable_entry *ent
+* @return   void
+**/
+static void
+htable_tombstone(
+    HT_STRUCT(htable) *table,
+    HT_STRUCT(htable_entry) *ent
+) {
+    if (table->flags & (HT_FLAG_RCU | HT_FLAG_SEQLOCK)) {
+        htable_set_entry(table, ent, HT_TOMBSTONE);
+        HT_STORE_RELEASE(ent->key, NULL);
+        return;
+    }
+    
+    memset(ent, 0, table->slot_size);
+    ent->entry = HT_TOMBSTONE;
+}
+
+/**
+* Smallest power-of-two size, at least HT_MIN_SIZE, that keeps table's
+* load factor at or below HT_MAX_LOAD. table->size if there is none.
+*
+* @param    struct htable *table
+* @return   uint32_t
+**/
+static uint32_t
+htable_fit_size(
+    HT_STRUCT(htable) *table
+) {
+    uint32_t new_size = HT_MIN_SIZE;
+    
+    while ((uint64_t)table->used * 100 > (uint64_t)new_size * HT_MAX_LOAD) {
+        if (new_size > UINT32_MAX / 2) {
+            return table->size;
+        }
+        
+        new_size *= 2;
+    }
+    
+    return new_size;
+}
+
+/**
+* Shrink table after removals, if its load factor is below the shrink
+* threshold and a smaller size would hold its entries. Tombstones alone
+* never trigger a rebuild, so removals stay O(1) while the load sits
+* between the threshold and the point where the table can shrink.
+* HT_FLAG_RCU tables are never shrunk here, as readers may still be
+* using the arrays a rebuild would free.
+*
+* @param    struct htable *table
+* @return   void
+**/
+static void
+htable_auto_shrink(
+    HT_STRUCT(htable) *table
+) {
+    if (    !table->shrink_thresh ||
+            (table->flags & HT_FLAG_RCU) ||
+            table->size <= HT_MIN_SIZE ||
+            (uint64_t)table->used * 100 >=
+            (uint64_t)table->size * table->shrink_thresh) {
+        return;
+    }
+    
+    if (htable_fit_size(table) < table->size) {
+        /* Failure only means the table keeps its current size */
+        HT_EXPORT(htable_shrink_to_fit)(table);
+    }
+}
+
+/**
+* Remove live entry ent: call freefn, leave a tombstone, and keep
+* table->entries dense by moving the last entry into its place. See
+* htable_remove().
+*
+* @param    struct htable *table
+* @param    struct htable_entry *ent
+* @return   0 on error, 1 on success
+**/
+static int
+htable_unlink(
+    HT_STRUCT(htable) *table,
+    HT_STRUCT(htable_entry) *ent
+) {
+    uint32_t slot;
+    
+    if (table->pages != NULL) {
+        /* Both ent and the last entry are written to */
+        slot = table->entries[ent->entry];
+        if (    !htable_slot_mut(table, table->entries[table->used-1]) ||
+                !(ent = htable_slot_mut(table, slot))) {
+            return 0;
+        }
+    }
+    
+    HT_EXPORT(htable_write_begin)(table);
+    
+    if (table->freefn != NULL) {
+        /* Call freefn() */
+        table->freefn(ent);
+    }
+    
+    htable_free_key(table, ent);
+    
+    /* Swap current entry with last entry, to maintain linear array
+       of slot indices. */
+    table->entries[ent->entry] = table->entries[table->used-1];
+    table->hashes[ent->entry] = table->hashes[table->used-1];
+    htable_set_entry(table, HT_ENTRY(table, ent->entry), ent->entry);
+    
+    /* Decrement used count */
+    table->used--;
+    table->deleted++;
+    
+    /* Leave a tombstone, so probe chains running through this slot
+       stay intact */
+    htable_tombstone(table, ent);
+    
+    htable_auto_shrink(table);
+    
+    HT_EXPORT(htable_write_end)(table);
+    return 1;
+}
+
+/**
+* Hash the key made of fragments iov[0..iovcnt), which is the same as
+* hashing the fragments concatenated.
+*
+* @param    struct htable *table
+* @param    struct htable_iovec *iov
+* @param    int iovcnt
+* @param    uint32_t *key_size
+*               - Receives the total size of the fragments
+* @return   uint32_t hash
+**/
+static uint32_t
+htable_hash_iov(
+    HT_STRUCT(htable) *table,
+    const HT_STRUCT(htable_iovec) *iov,
+    int iovcnt,
+    uint32_t *key_size
+) {
+    MurmurHash3_x86_32_state state;
+    uint32_t hash;
+    int i;
+    
+    *key_size = 0;
+    MurmurHash3_x86_32_init(&state, table->seed);
+    
+    for (i = 0; i < iovcnt; i++) {
+        MurmurHash3_x86_32_update(&state, iov[i].base, iov[i].len);
+        *key_size += iov[i].len;
+    }
+    
+    MurmurHash3_x86_32_final(&state, &hash);
+    return hash;
+}
+
+/**
+* Copy entry i of table into slot "slot" of shell, the table's new slot
+* storage, and record its new slot in new_entries.
+*
+* @param    struct htable *table
+* @param    struct htable *shell
+* @param    uint32_t *new_entries
+* @param    uint32_t i
+* @param    uint32_t slot
+* @return   void
+**/
+static void
+htable_copy_slot(
+    HT_STRUCT(htable) *table,
+    HT_STRUCT(htable) *shell,
+    uint32_t *new_entries,
+    uint32_t i,
+    uint32_t slot
+) {
+    HT_STRUCT(htable_entry) *ent = HT_SLOT(shell, slot);
+    
+    memcpy(ent, HT_ENTRY(table, i), table->slot_size);
+    new_entries[i] = slot;
+    
+    if ((table->flags & HT_FLAG_INLINE_KEYS) && HT_KEY_FITS(ent->key_size)) {
+        /* Inline key moved along with the slot */
+        ent->key = HT_INLINE_KEY(table, ent);
+    }
+}
+
+/**
+* Place the entries of table into shell, its new slot storage, by their
+* stored hash, in dense order. See htable_rebuild().
+*
+* @param    struct htable *table
+* @param    struct htable *shell
+* @param    uint32_t *new_entries
+* @return   0 on error (a probe sequence had no free slot), 1 on success
+**/
+static int
+htable_place(
+    HT_STRUCT(htable) *table,
+    HT_STRUCT(htable) *shell,
+    uint32_t *new_entries
+) {
+    uint32_t i, slot, step;
+    
+    for (i = 0; i < table->used; i++) {
+        if (i + HT_PREFETCH_DISTANCE < table->used) {
+            /* Old slot and new home slot of a later entry */
+            HT_PREFETCH(HT_ENTRY(table, i + HT_PREFETCH_DISTANCE));
+            HT_PREFETCH(HT_SLOT(shell,
+                table->hashes[i + HT_PREFETCH_DISTANCE] % shell->size));
+        }
+        
+        slot = table->hashes[i] % shell->size;
+        step = 0;
+        
+        /* Keys are unique, so the first empty slot is the right one */
+        while (HT_SLOT(shell, slot)->key != NULL) {
+            step += 1;
+            if (step >= shell->size) {
+                return 0;
+            }
+            
+            slot = (slot + step) % shell->size;
+        }
+        
+        htable_copy_slot(table, shell, new_entries, i, slot);
+    }
+    
+    return 1;
+}
+
+#ifdef HT_PARALLEL
+
+/* Slot claim of a parallel rebuild: entry index plus one in the low
+   half, and the probe step it got the slot at in the high half. 0 means
+   free. */
+#define HT_CLAIM_WORD(i, step) (((uint64_t)(step) << 32) | ((uint64_t)(i) + 1))
+
+/* Thread running a job of a parallel operation. First member of every
+   job struct, see htable_run_jobs(). */
+struct HT_EXPORT(htable_worker) {
+    pthread_t thread;
+    int started;
+};
+
+/* One thread's share of a parallel rebuild: entries [begin, end) when
+   claiming, slots [begin, end) when copying. */
+struct HT_EXPORT(htable_rebuild_job) {
+    HT_STRUCT(htable_worker) worker;
+    HT_STRUCT(htable) *table;
+    HT_STRUCT(htable) *shell;
+    uint64_t *claims;
+    uint32_t *new_entries;
+    uint32_t begin;
+    uint32_t end;
+    int *failed;
+};
+
+/**
+* Claim a slot for entry "index" among "size" claims. A slot held by a
+* later entry is taken over, and that entry goes on probing from where
+* it was, so each entry ends up in the first slot of its probe sequence
+* not taken by an earlier one. That's where htable_place() puts it, and
+* it doesn't depend on which thread gets where first.
+*
+* @param    uint64_t *claims
+* @param    uint32_t size
+* @param    uint32_t *hashes
+* @param    uint32_t index
+* @return   0 on error (a probe sequence had no free slot), 1 on success
+**/
+static int
+htable_claim_slot(
+    uint64_t *claims,
+    uint32_t size,
+    uint32_t *hashes,
+    uint32_t index
+) {
+    uint32_t slot = hashes[index] % size,
+             step = 0;
+    uint64_t held;
+    
+    for (;;) {
+        held = HT_LOAD_ACQUIRE(claims[slot]);
+        
+        if (held == 0 || (uint32_t)held - 1 > index) {
+            if (!HT_ATOMIC_CAS(claims[slot], held, HT_CLAIM_WORD(index, step))) {
+                /* Changed under us, look again */
+                continue;
+            }
+            
+            if (held == 0) {
+                return 1;
+            }
+            
+            /* Displaced a later entry, which carries on */
+            index = (uint32_t)held - 1;
+            step = (uint32_t)(held >> 32);
+        }
+        
+        step += 1;
+        if (step >= size) {
+            return 0;
+        }
+        
+        slot = (slot + step) % size;
+    }
+}
+
+/**
+* Claim slots for the entries of one job.
+*
+* @param    void *arg
+*               - struct htable_rebuild_job *
+* @return   NULL
+**/
+static void *
+htable_claim_worker(
+    void *arg
+) {
+    uint32_t i;
+    HT_STRUCT(htable_rebuild_job) *job = arg;
+    
+    for (i = job->begin; i < job->end; i++) {
+        if (HT_LOAD_ACQUIRE(*job->failed)) {
+            break;
+        }
+        
+        if (!htable_claim_slot(job->claims, job->shell->size,
+                               job->table->hashes, i)) {
+            HT_STORE_RELEASE(*job->failed, 1);
+            break;
+        }
+    }
+    
+    return NULL;
+}
+
+/**
+* Copy entries into the slots of one job, as claimed.
+*
+* @param    void *arg
+*               - struct htable_rebuild_job *
+* @return   NULL
+**/
+static void *
+htable_copy_worker(
+    void *arg
+) {
+    uint32_t slot;
+    uint64_t held;
+    HT_STRUCT(htable_rebuild_job) *job = arg;
+    
+    for (slot = job->begin; slot < job->end; slot++) {
+        if (slot + HT_PREFETCH_DISTANCE < job->end) {
+            /* Old slot of a later entry */
+            held = job->claims[slot + HT_PREFETCH_DISTANCE];
+            if (held != 0) {
+                HT_PREFETCH(HT_ENTRY(job->table, (uint32_t)held - 1));
+            }
+        }
+        
+        held = job->claims[slot];
+        if (held != 0) {
+            htable_copy_slot(job->table, job->shell, job->new_entries,
+                             (uint32_t)held - 1, slot);
+        }
+    }
+    
+    return NULL;
+}
+
+/**
+* Run fn on every job, each on its own thread, and the first on this
+* one. Jobs that can't get a thread are run here too. Jobs are
+* job_size bytes apart, and start with a struct htable_worker.
+*
+* @param    void *(*fn)(void *)
+* @param    void *jobs
+* @param    size_t job_size
+* @param    uint32_t njobs
+* @return   void
+**/
+static void
+htable_run_jobs(
+    void *(*fn)(void *),
+    void *jobs,
+    size_t job_size,
+    uint32_t njobs
+) {
+    uint32_t t;
+    
+    HT_STRUCT(htable_worker) *worker;
+    
+    for (t = 1; t < njobs; t++) {
+        worker = (void *)((char *)jobs + job_size * t);
+        worker->started = pthread_create(&worker->thread, NULL, fn, worker) == 0;
+    }
+    
+    fn(jobs);
+    
+    for (t = 1; t < njobs; t++) {
+        worker = (void *)((char *)jobs + job_size * t);
+        if (worker->started) {
+            pthread_join(worker->thread, NULL);
+        } else {
+            fn(worker);
+        }
+    }
+}
+
+/**
+* Place the entries of table into shell on nthreads threads, with the
+* same result as htable_place(). First every entry claims a slot, then
+* the claimed slots are filled, each thread taking an even share of the
+* entries, then of the slots.
+*
+* @param    struct htable *table
+* @param    struct htable *shell
+* @param    uint32_t *new_entries
+* @param    uint32_t nthreads
+* @return   0 on error, 1 on success
+**/
+static int
+htable_place_parallel(
+    HT_STRUCT(htable) *table,
+    HT_STRUCT(htable) *shell,
+    uint32_t *new_entries,
+    uint32_t nthreads
+) {
+    uint32_t t;
+    int failed = 0;
+    uint64_t *claims;
+    
+    HT_STRUCT(htable_rebuild_job) *jobs;
+    
+    if (nthreads > table->used) {
+        /* Not worth the threads */
+        return htable_place(table, shell, new_entries);
+    }
+    
+    claims = calloc(shell->size, sizeof(*claims));
+    jobs = malloc(sizeof(*jobs) * nthreads);
+    if (!claims || !jobs) {
+        free(claims);
+        free(jobs);
+        return 0;
+    }
+    
+    for (t = 0; t < nthreads; t++) {
+        jobs[t].table = table;
+        jobs[t].shell = shell;
+        jobs[t].claims = claims;
+        jobs[t].new_entries = new_entries;
+        jobs[t].failed = &failed;
+        jobs[t].begin = (uint32_t)((uint64_t)table->used * t / nthreads);
+        jobs[t].end = (uint32_t)((uint64_t)table->used * (t + 1) / nthreads);
+    }
+    
+    htable_run_jobs(&htable_claim_worker, jobs, sizeof(*jobs), nthreads);
+    
+    if (!failed) {
+        for (t = 0; t < nthreads; t++) {
+            jobs[t].begin = (uint32_t)((uint64_t)shell->size * t / nthreads);
+            jobs[t].end = (uint32_t)((uint64_t)shell->size * (t + 1) / nthreads);
+        }
+        
+        htable_run_jobs(&htable_copy_worker, jobs, sizeof(*jobs), nthreads);
+    }
+    
+    free(claims);
+    free(jobs);
+    
+    return !failed;
+}
+
+#endif
+
+/**
+* Rebuild table into a new slot array of new_size slots, placing entries
+* by their stored hash. Keys are not compared or hashed, and
+* copyfn/freefn are not called. Dense order of table->entries is
+* preserved. With nthreads > 1 the work is split over that many threads
+* (if built with USE_PTHREAD), with the same result.
+*
+* @param    struct htable *table
+* @param    uint32_t new_size
+* @param    uint32_t nthreads
+* @return   0 on error, 1 on success
+**/
+static int
+htable_rebuild(
+    HT_STRUCT(htable) *table,
+    uint32_t new_size,
+    uint32_t nthreads
+) {
+    uint32_t *new_entries;
+    int placed;
+    
+    /* Same table, with the new slot storage */
+    HT_STRUCT(htable) shell;
+    HT_STRUCT(htable_retired) *retired = NULL;
+    HT_STRUCT(htable_bloom) *bloom = NULL;
+    
+    if (new_size < table->used || new_size == 0) {
+        return 0;
+    }
+    
+    if (table->flags & HT_FLAG_SEQLOCK) {
+        /* Readers may be in the old slots, they're kept for now */
+        retired = malloc(sizeof(*retired));
+        if (!retired) {
+            return 0;
+        }
+    }
+    
+    if (table->bloom != NULL) {
+        /* Sized for the new table, and rid of removed keys */
+        bloom = htable_bloom_build(table, new_size, table->bloom->fp_rate);
+        if (!bloom) {
+            free(retired);
+            return 0;
+        }
+    }
+    
+    shell = *table;
+    shell.size = new_size;
+    if (!htable_slots_alloc(&shell)) {
+        htable_bloom_free(bloom);
+        free(retired);
+        return 0;
+    }
+    
+    new_entries = malloc(sizeof(*new_entries) * table->entries_size);
+    if (!new_entries) {
+        htable_slots_free(&shell);
+        htable_bloom_free(bloom);
+        free(retired);
+        return 0;
+    }
+
+#ifdef HT_PARALLEL
+    if (nthreads > 1) {
+        placed = htable_place_parallel(table, &shell, new_entries, nthreads);
+    } else
+#endif
+    placed = htable_place(table, &shell, new_entries);
+    
+    if (!placed) {
+        htable_slots_free(&shell);
+        free(new_entries);
+        htable_bloom_free(bloom);
+        free(retired);
+        return 0;
+    }
+    
+    HT_EXPORT(htable_write_begin)(table);
+    
+    /* Free old memory */
+    if (retired != NULL) {
+        retired->table = table->table;
+        retired->next = table->retired;
+        table->retired = retired;
+    } else {
+        htable_slots_free(table);
+    }
+    
+    free(table->entries);
+    
+    /* Link up new data */
+    table->table = shell.table;
+    table->pages = shell.pages;
+    table->entries = new_entries;
+    table->size = new_size;
+    table->deleted = 0;
+    
+    if (bloom != NULL) {
+        htable_bloom_free(table->bloom);
+        table->bloom = bloom;
+    }
+    
+    HT_EXPORT(htable_write_end)(table);
+    return 1;
+}
+
+/**
+* Reverse the bits of v, for htable_scan() cursors.
+*
+* @param    uint32_t v
+* @return   uint32_t
+**/
+static uint32_t
+htable_reverse_bits(
+    uint32_t v
+) {
+    v = ((v >> 1) & 0x55555555) | ((v & 0x55555555) << 1);
+    v = ((v >> 2) & 0x33333333) | ((v & 0x33333333) << 2);
+    v = ((v >> 4) & 0x0F0F0F0F) | ((v & 0x0F0F0F0F) << 4);
+    v = ((v >> 8) & 0x00FF00FF) | ((v & 0x00FF00FF) << 8);
+    
+    return (v >> 16) | (v << 16);
+}
+
+/**
+* htable_new()
+*
+* Create a new hash table
+*
+* @param    uint32_t size
+* @param    uint32_t seed
+* @param    htable_cmpfn cmpfn
+*               - See function typedef prototypes for more information
+* @param    htable_copyfn copyfn
+*               - See function typedef prototypes for more information
+* @param    htable_freefn freefn
+*               - See function typedef prototypes for more information
+* @return   struct htable *
+*               NULL on error
+**/
+HT_STRUCT(htable) *
+HT_EXPORT(htable_new)
+HT_ARGS((
+    uint32_t size,
+    uint32_t random_seed,
+    HT_EXPORT(htable_cmpfn) cmpfn,
+    HT_EXPORT(htable_copyfn) copyfn,
+    HT_EXPORT(htable_freefn) freefn
+)) {
+    return HT_EXPORT(htable_new_ex)(size, random_seed, cmpfn, copyfn, freefn, 0);
+}
+
+/**
+* htable_new_ex()
+*
+* Create a new hash table, with flags. See htable_new().
+*
+* @param    uint32_t size
+* @param    uint32_t seed
+* @param    htable_cmpfn cmpfn
+* @param    htable_copyfn copyfn
+* @param    htable_freefn freefn
+* @param    uint32_t flags
+*               - HT_FLAG_SET: key-only table, slots have no data field
+*               - HT_FLAG_INLINE_KEYS: table owned keys, short ones
+*                 stored in the slot
+*               - HT_VALUE_WIDTH(width): values of "width" bytes
+*                 stored in the slot
+*               - HT_FLAG_MEMCMP: compare keys by size and bytes
+* @return   struct htable *
+*               NULL on error
+**/
+HT_STRUCT(htable) *
+HT_EXPORT(htable_new_ex)
+HT_ARGS((
+    uint32_t size,
+    uint32_t random_seed,
+    HT_EXPORT(htable_cmpfn) cmpfn,
+    HT_EXPORT(htable_copyfn) copyfn,
+    HT_EXPORT(htable_freefn) freefn,
+    uint32_t flags
+)) {
+    HT_STRUCT(htable) *table;
+    
+    /* cmpfn is required, unless keys are compared by memcmp() */
+    if (    (cmpfn == NULL && !(flags & (HT_FLAG_MEMCMP | HT_FLAG_INLINE_KEYS))) ||
+            size == 0) {
+        return NULL;
+    }
+    
+    /* A set has no value to store inline */
+    if ((flags & HT_FLAG_SET) && (flags & HT_FLAG_INLINE_VALUES)) {
+        return NULL;
+    }
+    
+    /* Snapshots can't keep freed keys or data alive */
+    if (    (flags & HT_FLAG_COW) &&
+            (freefn != NULL || (flags & HT_FLAG_INLINE_KEYS))) {
+        return NULL;
+    }
+    
+    /* Concurrent readers need keys and data the table doesn't manage */
+    if (    (flags & HT_FLAG_RCU) &&
+            (copyfn != NULL || freefn != NULL ||
+             (flags & (HT_FLAG_INLINE_KEYS | HT_FLAG_INLINE_VALUES | HT_FLAG_COW)))) {
+        return NULL;
+    }
+    
+    /* Optimistic readers need keys the table doesn't free, in slots
+       that stay put */
+    if (    (flags & HT_FLAG_SEQLOCK) &&
+            (copyfn != NULL || freefn != NULL ||
+             (flags & (HT_FLAG_INLINE_KEYS | HT_FLAG_COW | HT_FLAG_RCU)))) {
+        return NULL;
+    }
+    
+    table = malloc(sizeof(*table));
+    if (!table) {
+        return NULL;
+    }
+    
+    memset(table, 0, sizeof(*table));
+    table->flags = flags;
+    
+    if (flags & HT_FLAG_SET) {
+        table->slot_size = offsetof(HT_STRUCT(htable_entry), data);
+    } else if (flags & HT_FLAG_INLINE_VALUES) {
+        /* Value bytes start at the data field, and may run past it */
+        table->value_size = flags >> 16;
+        table->slot_size = offsetof(HT_STRUCT(htable_entry), data) +
+                           HT_ALIGN(table->value_size);
+        
+        if (table->slot_size < sizeof(HT_STRUCT(htable_entry))) {
+            table->slot_size = sizeof(HT_STRUCT(htable_entry));
+        }
+    } else {
+        table->slot_size = sizeof(HT_STRUCT(htable_entry));
+    }
+    
+    if (flags & HT_FLAG_INLINE_KEYS) {
+        /* Key bytes follow the fixed fields and value, padded so the
+           next slot stays pointer aligned */
+        table->key_offset = table->slot_size;
+        table->slot_size += HT_ALIGN(HT_INLINE_KEY_SIZE);
+    }
+    
+    table->size = size;
+    if (!htable_slots_alloc(table)) {
+        free(table);
+        return NULL;
+    }
+    
+    if (!htable_entries_reserve(table, HT_ENTRIES_MIN)) {
+        free(table->entries);
+        free(table->hashes);
+        htable_slots_free(table);
+        free(table);
+        return NULL;
+    }
+    
+    table->used = 0;
+    table->seed = random_seed;
+    table->copyfn = copyfn;
+    table->freefn = freefn;
+    table->cmpfn = cmpfn;
+    
+    return table;
+}
+
+/**
+* htable_set_new()
+*
+* Create a new key-only hash table (set). Equivalent to calling
+* htable_new_ex() with HT_FLAG_SET. Pass NULL as data to htable_add().
+* htable_intersect() and htable_difference() work on sets as on any
+* other table.
+*
+* @param    uint32_t size
+* @param    uint32_t seed
+* @param    htable_cmpfn cmpfn
+* @param    htable_copyfn copyfn
+*               - Receives NULL data, and must not set dst->data
+* @param    htable_freefn freefn
+*               - Must not access ptr->data
+* @return   struct htable *
+*               NULL on error
+**/
+HT_STRUCT(htable) *
+HT_EXPORT(htable_set_new)
+HT_ARGS((
+    uint32_t size,
+    uint32_t random_seed,
+    HT_EXPORT(htable_cmpfn) cmpfn,
+    HT_EXPORT(htable_copyfn) copyfn,
+    HT_EXPORT(htable_freefn) freefn
+)) {
+    return HT_EXPORT(htable_new_ex)(
+                        size,
+                        random_seed,
+                        cmpfn,
+                        copyfn,
+                        freefn,
+                        HT_FLAG_SET);
+}
+
+/**
+* htable_clone()
+*
+* Clone hash table, returning new object. If table->copyfn is not NULL,
+* it will be used to copy data into the new hash table.
+*
+* @param    struct htable *src
+* @return   struct htable *
+*               NULL on error
+**/
+HT_EXTERN HT_STRUCT(htable) *
+HT_EXPORT(htable_clone)
+HT_ARGS((
+    HT_STRUCT(htable) *src
+)) {
+    return HT_EXPORT(htable_clone_ex)(src, 0);
+}
+
+/**
+* htable_clone_ex()
+*
+* Clone hash table into a table of "size" slots. Entries are placed by
+* their stored hash, in the same dense order, so keys are not hashed or
+* compared again and tombstones are left behind: cloning to a new size
+* costs one copy, where htable_clone() followed by htable_resize() costs
+* two. With size 0, slots are copied as they are, as by htable_clone().
+*
+* @param    struct htable *src
+* @param    uint32_t size
+*               - Power of two, at least src->used, or 0 to keep
+*                 src->size and its tombstones
+* @return   struct htable *
+*               NULL on error
+**/
+HT_STRUCT(htable) *
+HT_EXPORT(htable_clone_ex)
+HT_ARGS((
+    HT_STRUCT(htable) *src,
+    uint32_t size
+)) {
+    
+    uint32_t i, k;
+    
+    HT_STRUCT(htable_entry) *ent;
+    
+    HT_STRUCT(htable) *dst;
+    
+    if (size != 0 && size < src->used) {
+        return NULL;
+    }
+    
+    dst = HT_EXPORT(htable_new_ex)(
+                size ? size : src->size,
+                src->seed,
+                src->cmpfn,
+                src->copyfn,
+                src->freefn,
+                src->flags);
+    
+    if (!dst) {
+        return NULL;
+    }
+    
+    if (!htable_entries_reserve(dst, src->used)) {
+        HT_EXPORT(htable_delete)(dst);
+        return NULL;
+    }
+    
+    if (size != 0) {
+        /* Placed by stored hash, straight from the source slots */
+        if (!htable_place(src, dst, dst->entries)) {
+            HT_EXPORT(htable_delete)(dst);
+            return NULL;
+        }
+    } else {
+        /* Copy memory. Slots are copied as-is, so tombstones keep probe
+           chains intact in the clone, and slot indices stay valid. */
+        if (src->pages != NULL) {
+            for (k = 0; k < HT_PAGES(src->size); k++) {
+                memcpy(dst->pages[k], src->pages[k], htable_page_bytes(src, k));
+            }
+        } else {
+            memcpy(dst->table, src->table, (size_t)src->slot_size * src->size);
+        }
+        
+        memcpy(dst->entries, src->entries, sizeof(*dst->entries) * src->used);
+        dst->deleted = src->deleted;
+    }
+    
+    memcpy(dst->hashes, src->hashes, sizeof(*dst->hashes) * src->used);
+    dst->used = src->used;
+    dst->shrink_thresh = src->shrink_thresh;
+    
+    if (src->flags & HT_FLAG_INLINE_KEYS) {
+        for (i = 0; i < src->used; i++) {
+            HT_PREFETCH_ENTRY(dst, i);
+            
+            ent = HT_ENTRY(dst, i);
+            if (ent->key == HT_INLINE_KEY(dst, ent)) {
+                /* Moved along with the slot by htable_place() */
+                continue;
+            }
+            
+            if (!htable_store_key(dst, ent, ent->key_size, ent->key)) {
+                /* Entries from i on still share keys with src */
+                dst->used = i;
+                dst->freefn = NULL;
+                HT_EXPORT(htable_delete)(dst);
+                return NULL;
+            }
+        }
+    }
+    
+    if (src->copyfn != NULL) {
+        for (i = 0; i < src->used; i++) {
+            HT_PREFETCH_ENTRY(src, i);
+            HT_PREFETCH_ENTRY(dst, i);
+            
+            ent = HT_ENTRY(src, i);
+            src->copyfn(HT_ENTRY(dst, i), ent->key, HT_DATA(src, ent));
+        }
+    }
+    
+    if (src->bloom != NULL) {
+        dst->bloom = htable_bloom_build(dst, dst->size, src->bloom->fp_rate);
+        if (!dst->bloom) {
+            HT_EXPORT(htable_delete)(dst);
+            return NULL;
+        }
+    }
+    
+    return dst;
+}
+
+/**
+* htable_snapshot()
+*
+* Take a read-only, point in time snapshot of a HT_FLAG_COW table, in
+* O(pages) time: slot pages are shared, not copied. A page is copied when
+* the table first writes to it afterwards, so the snapshot keeps seeing
+* the entries as they were. Neither copyfn nor any other callback is
+* called, so keys and data pointed to by entries must stay valid until
+* the snapshot is deleted.
+*
+* The snapshot may be read and deleted on another thread, while the
+* table keeps being used on its own.
+*
+* @param    struct htable *table
+* @return   struct htable_snapshot *
+*               NULL on error, or if table is not HT_FLAG_COW
+**/
+HT_STRUCT(htable_snapshot) *
+HT_EXPORT(htable_snapshot)
+HT_ARGS((
+    HT_STRUCT(htable) *table
+)) {
+    
+    uint32_t k, npages;
+    
+    HT_STRUCT(htable_snapshot) *snap;
+    
+    if (table->pages == NULL) {
+        return NULL;
+    }
+    
+    snap = malloc(sizeof(*snap));
+    if (!snap) {
+        return NULL;
+    }
+    
+    npages = HT_PAGES(table->size);
+    snap->view = *table;
+    snap->view.bloom = NULL;
+    snap->view.pages = malloc(sizeof(*snap->view.pages) * npages);
+    if (!snap->view.pages) {
+        free(snap);
+        return NULL;
+    }
+    
+    for (k = 0; k < npages; k++) {
+        snap->view.pages[k] = table->pages[k];
+        HT_ATOMIC_INC(HT_PAGE_REFS(table->pages[k]));
+    }
+    
+    snap->view.entries = NULL;
+    snap->view.hashes = NULL;
+    snap->view.entries_size = 0;
+    snap->view.copyfn = NULL;
+    snap->view.freefn = NULL;
+    
+    return snap;
+}
+
+/**
+* htable_snapshot_get()
+*
+* Get entry from snapshot. The entry must not be modified.
+*
+* @param    struct htable_snapshot *snap
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+*
+* @return   NULL on error, pointer on success
+**/
+HT_STRUCT(htable_entry) *
+HT_EXPORT(htable_snapshot_get)
+HT_ARGS((
+    HT_STRUCT(htable_snapshot) *snap,
+    uint32_t key_size,
+    void *key
+)) {
+    
+    uint32_t hash;
+    
+    /* Get initial hash */
+    MurmurHash3_x86_32(key, key_size, snap->view.seed, &hash);
+    
+    return htable_probe(&snap->view, hash, key_size, key, NULL);
+}
+
+/**
+* htable_snapshot_foreach()
+*
+* Call fn for every entry of snapshot, in slot order. Pages are walked
+* sequentially. fn must not modify the entries.
+*
+* @param    struct htable_snapshot *snap
+* @param    htable_scanfn fn
+* @param    void *ctx
+*               - Passed to fn unchanged
+*
+* @return   void
+**/
+void
+HT_EXPORT(htable_snapshot_foreach)
+HT_ARGS((
+    HT_STRUCT(htable_snapshot) *snap,
+    HT_EXPORT(htable_scanfn) fn,
+    void *ctx
+)) {
+    
+    uint32_t i;
+    
+    HT_STRUCT(htable_entry) *ent;
+    
+    for (i = 0; i < snap->view.size; i++) {
+        ent = HT_SLOT(&snap->view, i);
+        if (ent->key != NULL) {
+            fn(ent, ctx);
+        }
+    }
+}
+
+/**
+* htable_snapshot_delete()
+*
+* Delete snapshot created by htable_snapshot(), releasing the pages it
+* shares. The table it was taken from is not affected.
+*
+* @param    struct htable_snapshot *snap
+* @return   void
+**/
+void
+HT_EXPORT(htable_snapshot_delete)
+HT_ARGS((
+    HT_STRUCT(htable_snapshot) *snap
+)) {
+    htable_slots_free(&snap->view);
+    free(snap);
+}
+
+/**
+* htable_delete()
+*
+* Delete hash table created by htable_new(). If table->freefn is not NULL,
+* it will be called for each element, so allocated memory can be freed.
+*
+* @param    struct htable *table
+* @return   void
+**/
+void
+HT_EXPORT(htable_delete)
+HT_ARGS((
+    HT_STRUCT(htable) *table
+)) {
+    
+    uint32_t i;
+    
+    HT_STRUCT(htable_entry) *ent;
+    
+    if (table->freefn != NULL || (table->flags & HT_FLAG_INLINE_KEYS)) {
+        for (i = 0; i < table->used; i++) {
+            HT_PREFETCH_ENTRY(table, i);
+            
+            ent = HT_ENTRY(table, i);
+            if (table->freefn != NULL) {
+                /* Call freefn() */
+                table->freefn(ent);
+            }
+            
+            htable_free_key(table, ent);
+        }
+    }
+    
+    HT_EXPORT(htable_reclaim)(table);
+    htable_bloom_free(table->bloom);
+    htable_slots_free(table);
+    free(table->entries);
+    free(table->hashes);
+    free(table);
+}
+
+/**
+* htable_clear()
+*
+* Remove all entries, keeping the allocated capacity, so the table can be
+* reused. If table->freefn is not NULL, it will be called for each
+* element. Only the used slots are visited, so the cost is O(used) rather
+* than O(size), unless htable_remove() has left tombstones, in which case
+* the whole slot array is reset. Pages of HT_FLAG_COW tables that are
+* shared with a snapshot are replaced by new, empty pages.
+*
+* @param    struct htable *table
+* @return   0 on error, 1 on success
+**/
+int
+HT_EXPORT(htable_clear)
+HT_ARGS((
+    HT_STRUCT(htable) *table
+)) {
+    
+    uint32_t i, k, npages = 0;
+    void **fresh = NULL;
+    
+    HT_STRUCT(htable_entry) *ent;
+    
+    if (table->pages != NULL) {
+        /* Pages shared with snapshots are replaced rather than written
+           to. Allocate replacements first, so failure changes nothing. */
+        npages = HT_PAGES(table->size);
+        fresh = malloc(sizeof(*fresh) * npages);
+        if (!fresh) {
+            return 0;
+        }
+        
+        for (k = 0; k < npages; k++) {
+            fresh[k] = NULL;
+            if (HT_PAGE_REFS(table->pages[k]) == 1) {
+                continue;
+            }
+            
+            fresh[k] = htable_page_alloc(htable_page_bytes(table, k), NULL);
+            if (!fresh[k]) {
+                while (k--) {
+                    if (fresh[k] != NULL) {
+                        htable_page_release(fresh[k]);
+                    }
+                }
+                
+                free(fresh);
+                return 0;
+            }
+        }
+    }
+    
+    HT_EXPORT(htable_write_begin)(table);
+    
+    for (i = 0; i < table->used; i++) {
+        HT_PREFETCH_ENTRY(table, i);
+        
+        ent = HT_ENTRY(table, i);
+        
+        if (table->freefn != NULL) {
+            /* Call freefn() */
+            table->freefn(ent);
+        }
+        
+        htable_free_key(table, ent);
+        
+        if (table->flags & HT_FLAG_SEQLOCK) {
+            /* Readers see the key go at once, never half cleared */
+            HT_STORE_RELEASE(ent->key, NULL);
+        }
+        
+        if (    !table->deleted &&
+                (fresh == NULL || fresh[table->entries[i] / HT_PAGE_SLOTS] == NULL)) {
+            memset(ent, 0, table->slot_size);
+        }
+    }
+    
+    for (k = 0; k < npages; k++) {
+        if (fresh[k] != NULL) {
+            htable_page_release(table->pages[k]);
+            table->pages[k] = fresh[k];
+        }
+    }
+    
+    free(fresh);
+    
+    if (table->deleted) {
+        /* Tombstones are not tracked, so reset every slot */
+        if (table->pages != NULL) {
+            for (k = 0; k < npages; k++) {
+                memset(table->pages[k], 0, htable_page_bytes(table, k));
+            }
+        } else {
+            memset(table->table, 0, (size_t)table->slot_size * table->size);
+        }
+    }
+    
+    if (table->bloom != NULL) {
+        memset(table->bloom->blocks, 0, (size_t)table->bloom->nblocks * HT_BLOOM_BLOCK);
+    }
+    
+    table->used = 0;
+    table->deleted = 0;
+    
+    HT_EXPORT(htable_write_end)(table);
+    return 1;
+}
+
+/**
+* htable_entry_at()
+*
+* Get the i'th entry of the table, in the order of table->entries.
+*
+* @param    struct htable *table
+* @param    uint32_t i
+*               - Must be less than table->used
+* @return   struct htable_entry *
+**/
+HT_STRUCT(htable_entry) *
+HT_EXPORT(htable_entry_at)
+HT_ARGS((
+    HT_STRUCT(htable) *table,
+    uint32_t i
+)) {
+    return HT_ENTRY(table, i);
+}
+
+/**
+* htable_value()
+*
+* Get pointer to the value of an entry. For tables created with
+* HT_VALUE_WIDTH() this points into the slot, and stays valid until the
+* table is resized or the entry removed. Otherwise it is ent->data, or
+* NULL for sets.
+*
+* @param    struct htable *table
+* @param    struct htable_entry *ent
+* @return   void *
+**/
+void *
+HT_EXPORT(htable_value)
+HT_ARGS((
+    HT_STRUCT(htable) *table,
+    HT_STRUCT(htable_entry) *ent
+)) {
+    return HT_DATA(table, ent);
+}
+
+/**
+* htable_resize()
+*
+* Resize hash table, normally for growing, but can also be used to
+* shrink the size of the table.
+*
+* @param    struct htable *table
+* @param    uint8_t load_thresh
+*               Number between 0 and 100. If load factor is below it,
+*               then resize won't trigger. Use 0 to disable.
+*
+* @param    uint32_t new_size
+* @return   0 on error, 1 on success
+**/
+int
+HT_EXPORT(htable_resize)
+HT_ARGS((
+    HT_STRUCT(htable) *table,
+    uint8_t load_thresh,
+    uint32_t new_size
+)) {
+    
+    float load_calc;
+    
+    /* Check load_thresh before proceeding */
+    load_calc = 100.0f * ((float)table->used / (float)table->size);
+    if (load_thresh && load_calc < load_thresh) {
+        return 1;
+    }
+    
+    return htable_rebuild(table, new_size, 1);
+}
+
+/**
+* htable_resize_parallel()
+*
+* Like htable_resize(), with the work split over nthreads threads, the
+* calling one included. The table comes out exactly as htable_resize()
+* would leave it, whatever the number of threads. Only worth it for
+* large tables, each call starts its own threads. Without USE_PTHREAD,
+* and with nthreads of 0 or 1, it is htable_resize().
+*
+* @param    struct htable *table
+* @param    uint8_t load_thresh
+*               Number between 0 and 100. If load factor is below it,
+*               then resize won't trigger. Use 0 to disable.
+*
+* @param    uint32_t new_size
+* @param    uint32_t nthreads
+* @return   0 on error, 1 on success
+**/
+int
+HT_EXPORT(htable_resize_parallel)
+HT_ARGS((
+    HT_STRUCT(htable) *table,
+    uint8_t load_thresh,
+    uint32_t new_size,
+    uint32_t nthreads
+)) {
+    
+    float load_calc;
+    
+    /* Check load_thresh before proceeding */
+    load_calc = 100.0f * ((float)table->used / (float)table->size);
+    if (load_thresh && load_calc < load_thresh) {
+        return 1;
+    }
+    
+    return htable_rebuild(table, new_size, nthreads);
+}
+
+/**
+* htable_shrink_to_fit()
+*
+* Rebuild hash table into the smallest power-of-two capacity that keeps
+* the load factor at or below HT_MAX_LOAD. Slots left behind by
+* htable_remove() are dropped in the process, and the old arrays are
+* released. Stored hashes are reused, so keys are not hashed again.
+* Pointers previously returned by htable_get() are invalidated.
+*
+* @param    struct htable *table
+* @return   0 on error, 1 on success
+**/
+int
+HT_EXPORT(htable_shrink_to_fit)
+HT_ARGS((
+    HT_STRUCT(htable) *table
+)) {
+    uint32_t new_size = htable_fit_size(table);
+    
+    if (new_size >= table->size) {
+        if (table->deleted == 0) {
+            /* Nothing to reclaim in the slot array */
+            htable_entries_trim(table);
+            return 1;
+        }
+        
+        /* Compact in place, dropping tombstones */
+        new_size = table->size;
+    }
+    
+    if (!htable_rebuild(table, new_size, 1)) {
+        return 0;
+    }
+    
+    htable_entries_trim(table);
+    return 1;
+}
+
+/**
+* htable_set_shrink_thresh()
+*
+* Set automatic shrink threshold. When htable_remove() brings the load
+* factor below the threshold, and a smaller power-of-two size would hold
+* the entries, the table is rebuilt as by htable_shrink_to_fit().
+* Removals never compact the table at its current size.
+*
+* @param    struct htable *table
+* @param    uint8_t shrink_thresh
+*               Percentage, use 0 to disable (default). Clamped to
+*               HT_MAX_LOAD / 2: above that, the table could not shrink
+*               without going over HT_MAX_LOAD.
+*
+* @return   void
+**/
+void
+HT_EXPORT(htable_set_shrink_thresh)
+HT_ARGS((
+    HT_STRUCT(htable) *table,
+    uint8_t shrink_thresh
+)) {
+    if (shrink_thresh > HT_MAX_LOAD / 2) {
+        shrink_thresh = HT_MAX_LOAD / 2;
+    }
+    
+    table->shrink_thresh = shrink_thresh;
+}
+
+/**
+* htable_write_begin()
+*
+* Start a write section of a HT_FLAG_SEQLOCK table, making readers retry
+* until the matching htable_write_end(). The table functions do this
+* themselves. Use it around writes through entries returned by
+* htable_find_or_insert() or htable_emplace(). Sections nest. Does
+* nothing for other tables.
+*
+* Lookups (htable_get(), htable_get_copy(), htable_get_iov()) wait for
+* the section to end, so the thread holding it must not make any on the
+* same table: they would never return. That includes callbacks run
+* inside a section, such as htable_remove_if() predicates.
+*
+* @param    struct htable *table
+* @return   void
+**/
+void
+HT_EXPORT(htable_write_begin)
+HT_ARGS((
+    HT_STRUCT(htable) *table
+)) {
+    if (!(table->flags & HT_FLAG_SEQLOCK) || table->writing++ > 0) {
+        return;
+    }
+    
+    /* Odd, and visible before any of the writes that follow */
+    HT_STORE_RELEASE(table->seq, table->seq + 1);
+    HT_FENCE_RELEASE();
+}
+
+/**
+* htable_write_end()
+*
+* End a write section. See htable_write_begin().
+*
+* @param    struct htable *table
+* @return   void
+**/
+void
+HT_EXPORT(htable_write_end)
+HT_ARGS((
+    HT_STRUCT(htable) *table
+)) {
+    if (!(table->flags & HT_FLAG_SEQLOCK) || --table->writing > 0) {
+        return;
+    }
+    
+    HT_STORE_RELEASE(table->seq, table->seq + 1);
+}
+
+/**
+* htable_reclaim()
+*
+* Free the slot arrays a HT_FLAG_SEQLOCK table kept when it was resized.
+* Only call this when no reader can be running, for example once reader
+* threads are joined, or when they're known to be between lookups.
+*
+* @param    struct htable *table
+* @return   void
+**/
+void
+HT_EXPORT(htable_reclaim)
+HT_ARGS((
+    HT_STRUCT(htable) *table
+)) {
+    HT_STRUCT(htable_retired) *retired;
+    
+    while (table->retired != NULL) {
+        retired = table->retired;
+        table->retired = retired->next;
+        
+        free(retired->table);
+        free(retired);
+    }
+}
+
+/**
+* Create new htable_collection object.
+*
+* @param    uint32_t size
+* @return   NULL on error
+**/
+HT_STRUCT(htable_collection) *
+HT_EXPORT(htable_collection_new)
+HT_ARGS((
+    uint32_t size
+)) {
+    HT_STRUCT(htable_collection) *collection
+        = malloc(sizeof(*collection));
+    
+    if (!collection) {
+        return NULL;
+    }
+    
+    memset(collection, 0, sizeof(*collection));
+    collection->list = malloc(sizeof(*(collection->list)) * size);
+    if (!collection->list) {
+        free(collection);
+        return NULL;
+    }
+    
+    collection->size = size;
+    collection->used = 0;
+    
+    return collection;
+}
+
+/**
+* Resize htable_collection object.
+*
+* @param    struct htable_collection *
+* @param    uint32_t size
+* @return   NULL on error
+**/
+int
+HT_EXPORT(htable_collection_resize)
+HT_ARGS((
+    HT_STRUCT(htable_collection) *collection,
+    uint32_t size
+)) {
+    HT_STRUCT(htable_entry) **new_list;
+    
+    if (size < collection->used) {
+        /* Elements wont fit */
+        return 0;
+    }
+    
+    new_list = malloc(sizeof(*new_list) * (size + 1));
+    if (!new_list) {
+        return 0;
+    }
+    
+    memcpy(new_list, collection->list, sizeof(*new_list) * (collection->used + 1));
+    free(collection->list);
+    collection->list = new_list;
+    
+    return 1;
+}
+
+/**
+* Delete htable_collection object created by htable_collection_new
+*
+* @param    struct htable_collection *
+* @return   void
+**/
+void
+HT_EXPORT(htable_collection_delete)
+HT_ARGS((
+    HT_STRUCT(htable_collection) *collection
+)) {
+    if (!collection) {
+        return;
+    }
+    
+    if (collection->list) {
+        free(collection->list);
+    }
+    
+    free(collection);
+}
+
+/**
+* htable_add()
+*
+* Add item to hash table. 
+*
+* @param    struct htable *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+* @param    void *data
+*               - Ignored for sets (HT_FLAG_SET)
+*               - Pointer to the value bytes for HT_VALUE_WIDTH() tables
+*
+* @return   0 on error, 1 on success
+**/
+int
+HT_EXPORT(htable_add)
+HT_ARGS((
+    HT_STRUCT(htable) *table,
+    uint32_t key_size,
+    void *key,
+    void *data
+)) {
+    
+    uint32_t hash;
+    
+    uint32_t free_slot;
+    
+    HT_STRUCT(htable_entry) *ent;
+    
+    /* Get initial hash */
+    MurmurHash3_x86_32(key, key_size, table->seed, &hash);
+    
+    ent = htable_probe(table, hash, key_size, key, &free_slot);
+    HT_EXPORT(htable_write_begin)(table);
+    
+    if (ent != NULL) {
+        /* Replace */
+        ent = htable_slot_mut(table, table->entries[ent->entry]);
+        if (!ent) {
+            HT_EXPORT(htable_write_end)(table);
+            return 0;
+        }
+        
+        if (table->freefn != NULL) {
+            /* Call freefn() */
+            table->freefn(ent);
+        }
+    } else if (free_slot == HT_TOMBSTONE ||
+               !(ent = htable_claim(table, free_slot, hash, key_size, key))) {
+        /* Table is full, or out of memory */
+        HT_EXPORT(htable_write_end)(table);
+        return 0;
+    }
+    
+    htable_fill(table, ent, key_size, key, data);
+    HT_EXPORT(htable_write_end)(table);
+    return 1;
+}
+
+/**
+* htable_find_or_insert()
+*
+* Get entry from hash table, inserting key and data if it's not there,
+* with a single hash and probe. An existing entry is left untouched:
+* copyfn and freefn are not called for it.
+*
+* Usage:
+*
+* int inserted;
+* struct htable_entry *ent;
+*
+* ent = htable_find_or_insert(table, sizeof(key), &key, NULL, &inserted);
+* if (ent != NULL) {
+*     (*(uint64_t *)htable_value(table, ent))++;
+* }
+*
+* @param    struct htable *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+* @param    void *data
+*               - Only used if the key is inserted
+* @param    int *inserted
+*               - Set to 1 if key was inserted, 0 if it existed.
+*                 May be NULL.
+*
+* @return   NULL on error (table full or out of memory), pointer to
+*           the existing or new entry on success
+**/
+HT_STRUCT(htable_entry) *
+HT_EXPORT(htable_find_or_insert)
+HT_ARGS((
+    HT_STRUCT(htable) *table,
+    uint32_t key_size,
+    void *key,
+    void *data,
+    int *inserted
+)) {
+    
+    uint32_t hash, free_slot;
+    
+    HT_STRUCT(htable_entry) *ent;
+    
+    if (inserted != NULL) {
+        *inserted = 0;
+    }
+    
+    /* Get initial hash */
+    MurmurHash3_x86_32(key, key_size, table->seed, &hash);
+    
+    ent = htable_probe(table, hash, key_size, key, &free_slot);
+    if (ent != NULL) {
+        /* The caller may write to it */
+        return htable_slot_mut(table, table->entries[ent->entry]);
+    }
+    
+    HT_EXPORT(htable_write_begin)(table);
+    
+    if (    free_slot == HT_TOMBSTONE ||
+            !(ent = htable_claim(table, free_slot, hash, key_size, key))) {
+        HT_EXPORT(htable_write_end)(table);
+        return NULL;
+    }
+    
+    htable_fill(table, ent, key_size, key, data);
+    HT_EXPORT(htable_write_end)(table);
+    
+    if (inserted != NULL) {
+        *inserted = 1;
+    }
+    
+    return ent;
+}
+
+/**
+* htable_update_value()
+*
+* Replace the data of an existing entry, with a single hash and probe.
+* Unlike htable_add(), the key is kept as is, and copyfn and freefn are
+* not called; the previous data pointer is handed back instead. For
+* HT_VALUE_WIDTH() tables the value bytes are copied from data, and the
+* old value is overwritten.
+*
+* @param    struct htable *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+* @param    void *data
+* @param    void **old_data
+*               - Receives the previous data pointer. May be NULL.
+*
+* @return   0 if key was not found (or table is a set), 1 on success
+**/
+int
+HT_EXPORT(htable_update_value)
+HT_ARGS((
+    HT_STRUCT(htable) *table,
+    uint32_t key_size,
+    void *key,
+    void *data,
+    void **old_data
+)) {
+    
+    uint32_t hash;
+    
+    HT_STRUCT(htable_entry) *ent;
+    
+    if (old_data != NULL) {
+        *old_data = NULL;
+    }
+    
+    if (table->flags & HT_FLAG_SET) {
+        return 0;
+    }
+    
+    /* Get initial hash */
+    MurmurHash3_x86_32(key, key_size, table->seed, &hash);
+    
+    ent = htable_probe(table, hash, key_size, key, NULL);
+    if (ent == NULL) {
+        return 0;
+    }
+    
+    ent = htable_slot_mut(table, table->entries[ent->entry]);
+    if (!ent) {
+        return 0;
+    }
+    
+    HT_EXPORT(htable_write_begin)(table);
+    
+    if (table->flags & HT_FLAG_INLINE_VALUES) {
+        htable_store_value(table, ent, data);
+    } else {
+        if (old_data != NULL) {
+            *old_data = ent->data;
+        }
+        
+        ent->data = data;
+    }
+    
+    HT_EXPORT(htable_write_end)(table);
+    return 1;
+}
+
+/**
+* htable_emplace()
+*
+* Reserve a slot for key, so its value can be constructed in place
+* instead of being built elsewhere and copied in. Hashes and probes once.
+* copyfn is not called.
+*
+* For a new slot, ent->key points at the key: a table owned copy for
+* HT_FLAG_INLINE_KEYS tables, otherwise key_hash_source itself, which
+* the caller may swap for a pointer to an equal key that outlives the
+* entry. The value starts zeroed: write HT_VALUE_WIDTH() values
+* through htable_value(), or set ent->data.
+*
+* Usage:
+*
+* struct htable_entry *ent;
+*
+* if (htable_emplace(table, strlen(id), id, &ent) == HT_EMPLACE_NEW) {
+*     build_record((struct record *)htable_value(table, ent), id);
+* }
+*
+* @param    struct htable *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key_hash_source
+*               - Key bytes, hashed and compared to find the slot
+* @param    struct htable_entry **slot
+*               - Receives the new or existing entry
+*
+* @return   0 on error (table full or out of memory),
+*           HT_EMPLACE_NEW if a slot was reserved,
+*           HT_EMPLACE_EXISTS if key was already in the table
+**/
+int
+HT_EXPORT(htable_emplace)
+HT_ARGS((
+    HT_STRUCT(htable) *table,
+    uint32_t key_size,
+    void *key_hash_source,
+    HT_STRUCT(htable_entry) **slot
+)) {
+    
+    uint32_t hash, free_slot;
+    
+    HT_STRUCT(htable_entry) *ent;
+    
+    *slot = NULL;
+    
+    /* Get initial hash */
+    MurmurHash3_x86_32(key_hash_source, key_size, table->seed, &hash);
+    
+    ent = htable_probe(table, hash, key_size, key_hash_source, &free_slot);
+    if (ent != NULL) {
+        /* The caller may write to it */
+        *slot = htable_slot_mut(table, table->entries[ent->entry]);
+        return (*slot != NULL) ? HT_EMPLACE_EXISTS : 0;
+    }
+    
+    HT_EXPORT(htable_write_begin)(table);
+    
+    if (    free_slot == HT_TOMBSTONE ||
+            !(ent = htable_claim(table, free_slot, hash, key_size, key_hash_source))) {
+        HT_EXPORT(htable_write_end)(table);
+        return 0;
+    }
+    
+    if (table->flags & HT_FLAG_SEQLOCK) {
+        /* Published with its zeroed value, fill it in a write section */
+        HT_STORE_RELEASE(ent->key, key_hash_source);
+    } else if (!(table->flags & HT_FLAG_INLINE_KEYS)) {
+        ent->key = key_hash_source;
+    }
+    
+    HT_EXPORT(htable_write_end)(table);
+    *slot = ent;
+    return HT_EMPLACE_NEW;
+}
+
+/**
+* htable_add_loop()
+*
+* Unlink htable_add(), which will fail on its first try, htable_add_loop()
+* will try a maximum of "max_loops" times to add an item before giving up.
+* It uses a quadratic resizing algorithm, so its best to keep max_loops
+* relatively small.
+*
+* @param    struct htable *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+* @param    void *data
+* @param    int max_loops
+*
+* @return   0 on failure, otherwise the number of loops it took to
+*           successfully add item.
+**/
+int
+HT_EXPORT(htable_add_loop)
+HT_ARGS((
+    HT_STRUCT(htable) *table,
+    uint32_t key_size,
+    void *key,
+    void *data,
+    int max_loops
+)) {
+    int loop;
+    int chunk = table->size;
+    int size = table->size;
+    
+    max_loops++;
+    for (loop = 1; loop < max_loops; loop++) {
+        if (HT_EXPORT(htable_add)(table, key_size, key, data)) {
+            return loop;
+        }
+        
+        size += chunk;
+        chunk += (chunk / 2);
+        
+        if (!HT_EXPORT(htable_resize)(table, 0, size)) {
+            return 0;
+        }
+    }
+    
+    return 0;
+}
+
+/**
+* htable_remove()
+*
+* Remove item from hash table.
+*
+*
+* @param    struct htable *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+*
+* @return   0 on error, 1 on success
+**/
+int
+HT_EXPORT(htable_remove)
+HT_ARGS((
+    HT_STRUCT(htable) *table,
+    uint32_t key_size,
+    void *key
+)) {
+    
+    uint32_t hash;
+    
+    HT_STRUCT(htable_entry) *ent;
+    
+    /* Get initial hash */
+    MurmurHash3_x86_32(key, key_size, table->seed, &hash);
+    
+    ent = htable_probe(table, hash, key_size, key, NULL);
+    if (ent == NULL) {
+        return 0;
+    }
+    
+    return htable_unlink(table, ent);
+}
+
+/**
+* htable_remove_if()
+*
+* Remove every entry for which predicate returns non-zero, in a single
+* pass over table->entries, without hashing or probing keys again.
+* Entries that are kept stay densely packed, in their previous relative
+* order. freefn is called for all removed entries once the pass is done.
+* The automatic shrink threshold applies as in htable_remove().
+* On a HT_FLAG_SEQLOCK table predicate runs inside a write section, and
+* must not look the table up (see htable_write_begin()).
+*
+* @param    struct htable *table
+* @param    htable_predfn predicate
+* @param    void *ctx
+*               - Passed to predicate unchanged
+*
+* @return   number of entries removed, 0 on error
+**/
+uint32_t
+HT_EXPORT(htable_remove_if)
+HT_ARGS((
+    HT_STRUCT(htable) *table,
+    HT_EXPORT(htable_predfn) predicate,
+    void *ctx
+)) {
+    
+    uint32_t i, k, kept, removed, idx, hash;
+    
+    HT_STRUCT(htable_entry) *ent;
+    
+    if (table->pages != NULL) {
+        /* Any slot may be written to, so take every page up front */
+        for (k = 0; k < HT_PAGES(table->size); k++) {
+            if (!htable_page_own(table, k)) {
+                return 0;
+            }
+        }
+    }
+    
+    HT_EXPORT(htable_write_begin)(table);
+    
+    /* Partition entries: kept ones are moved down to [0, kept), removed
+       ones collect in [kept, used). */
+    kept = 0;
+    for (i = 0; i < table->used; i++) {
+        HT_PREFETCH_ENTRY(table, i);
+        
+        if (predicate(HT_ENTRY(table, i), ctx)) {
+            continue;
+        }
+        
+        if (kept != i) {
+            idx = table->entries[kept];
+            hash = table->hashes[kept];
+            table->entries[kept] = table->entries[i];
+            table->hashes[kept] = table->hashes[i];
+            table->entries[i] = idx;
+            table->hashes[i] = hash;
+            htable_set_entry(table, HT_ENTRY(table, kept), kept);
+        }
+        
+        kept++;
+    }
+    
+    if (kept == table->used) {
+        HT_EXPORT(htable_write_end)(table);
+        return 0;
+    }
+    
+    if (table->freefn != NULL) {
+        for (i = kept; i < table->used; i++) {
+            HT_PREFETCH_ENTRY(table, i);
+            
+            /* Call freefn() */
+            table->freefn(HT_ENTRY(table, i));
+        }
+    }
+    
+    for (i = kept; i < table->used; i++) {
+        ent = HT_ENTRY(table, i);
+        htable_free_key(table, ent);
+        
+        /* Leave a tombstone, as htable_remove() does */
+        htable_tombstone(table, ent);
+    }
+    
+    removed = table->used - kept;
+    table->deleted += removed;
+    table->used = kept;
+    
+    htable_auto_shrink(table);
+    
+    HT_EXPORT(htable_write_end)(table);
+    return removed;
+}
+
+/**
+* Copy the value of entry ent to "value". See htable_get_copy().
+*
+* @param    struct htable *table
+* @param    struct htable_entry *ent
+* @param    void *value
+* @return   void
+**/
+static void
+htable_copy_value(
+    HT_STRUCT(htable) *table,
+    HT_STRUCT(htable_entry) *ent,
+    void *value
+) {
+    if (value == NULL || (table->flags & HT_FLAG_SET)) {
+        return;
+    }
+    
+    if (table->flags & HT_FLAG_INLINE_VALUES) {
+        memcpy(value, HT_INLINE_VALUE(ent), table->value_size);
+    } else {
+        *(void **)value = ent->data;
+    }
+}
+
+/**
+* Look up key in a HT_FLAG_SEQLOCK table, and copy its value to "value"
+* if it's not NULL. Retried until table->seq was even and unchanged for
+* the whole read, so nothing seen came from a write in progress. See
+* htable_probe_rcu() for key, iov and iovcnt.
+*
+* @param    struct htable *table
+* @param    uint32_t hash
+* @param    uint32_t key_size
+* @param    void *key
+* @param    struct htable_iovec *iov
+* @param    int iovcnt
+* @param    void *value
+* @return   pointer to matching entry, NULL if not found
+**/
+static HT_STRUCT(htable_entry) *
+htable_get_seq(
+    HT_STRUCT(htable) *table,
+    uint32_t hash,
+    uint32_t key_size,
+    void *key,
+    const HT_STRUCT(htable_iovec) *iov,
+    int iovcnt,
+    void *value
+) {
+    uint32_t seq, size;
+    
+    HT_STRUCT(htable_entry) *slots, *ent;
+    
+    for (;;) {
+        seq = HT_LOAD_ACQUIRE(table->seq);
+        if (seq & 1) {
+            /* The writer may be waiting for this CPU to finish */
+            HT_YIELD();
+            continue;
+        }
+        
+        /* A resize replaces both, check they go together before
+           probing */
+        slots = HT_LOAD_ACQUIRE(table->table);
+        size = HT_LOAD_ACQUIRE(table->size);
+        
+        HT_FENCE_ACQUIRE();
+        if (HT_LOAD_ACQUIRE(table->seq) != seq) {
+            continue;
+        }
+        
+        ent = htable_probe_rcu(table, slots, size, hash, key_size, key,
+                               iov, iovcnt);
+        if (ent != NULL) {
+            htable_copy_value(table, ent, value);
+        }
+        
+        HT_FENCE_ACQUIRE();
+        if (HT_LOAD_ACQUIRE(table->seq) == seq) {
+            return ent;
+        }
+    }
+}
+
+/**
+* Look key up by its hash, with the probe that suits the table, behind
+* its Bloom filter if it has one. The key is contiguous (key) or made
+* of fragments (iov and iovcnt, with key NULL). See htable_get().
+*
+* @param    struct htable *table
+* @param    uint32_t hash
+* @param    uint32_t key_size
+* @param    void *key
+* @param    struct htable_iovec *iov
+* @param    int iovcnt
+* @return   pointer to matching entry, NULL if not found
+**/
+static HT_STRUCT(htable_entry) *
+htable_get_hashed(
+    HT_STRUCT(htable) *table,
+    uint32_t hash,
+    uint32_t key_size,
+    void *key,
+    const HT_STRUCT(htable_iovec) *iov,
+    int iovcnt
+) {
+    HT_STRUCT(htable_entry) *ent;
+    
+    if (table->flags & HT_FLAG_RCU) {
+        return htable_probe_rcu(table, table->table, table->size,
+                                hash, key_size, key, iov, iovcnt);
+    }
+    
+    if (table->flags & HT_FLAG_SEQLOCK) {
+        return htable_get_seq(table, hash, key_size, key, iov, iovcnt, NULL);
+    }
+    
+    if (table->bloom != NULL) {
+        HT_COUNT(table->bloom->checks);
+        
+        if (!htable_bloom_test(table->bloom, hash)) {
+            HT_COUNT(table->bloom->skipped);
+            return NULL;
+        }
+        
+        ent = htable_probe_ex(table, hash, key_size, key, iov, iovcnt, NULL);
+        if (ent == NULL) {
+            HT_COUNT(table->bloom->false_positives);
+        }
+        
+        return ent;
+    }
+    
+    return htable_probe_ex(table, hash, key_size, key, iov, iovcnt, NULL);
+}
+
+/**
+* htable_get()
+*
+* Get entry from hash table. On HT_FLAG_SEQLOCK tables the lookup is
+* retried until it didn't overlap a write, but the entry may change as
+* soon as it's returned: use htable_get_copy() to read its value.
+*
+* @param    struct htable *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+*
+* @return   NULL on error, pointer on success
+**/
+HT_STRUCT(htable_entry) *
+HT_EXPORT(htable_get)
+HT_ARGS((
+    HT_STRUCT(htable) *table,
+    uint32_t key_size,
+    void *key
+)) {
+    
+    uint32_t hash;
+    
+    /* Get initial hash */
+    MurmurHash3_x86_32(key, key_size, table->seed, &hash);
+    
+    return htable_get_hashed(table, hash, key_size, key, NULL, 0);
+}
+
+/**
+* htable_get_copy()
+*
+* Look up key, and copy its value out: the data pointer, or the value
+* bytes of HT_VALUE_WIDTH() tables. On HT_FLAG_SEQLOCK tables, the
+* lookup and the copy are one read, retried until it didn't overlap a
+* write, so the value is never torn.
+*
+* Usage:
+*
+* struct point p;
+*
+* if (htable_get_copy(table, sizeof(id), &id, &p)) {
+*     draw(&p);
+* }
+*
+* @param    struct htable *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+* @param    void *value
+*               - Receives the value: a void * for plain tables, the
+*                 value width for HT_VALUE_WIDTH() tables. Ignored for
+*                 sets, and may be NULL.
+*
+* @return   0 if not found, 1 if found
+**/
+int
+HT_EXPORT(htable_get_copy)
+HT_ARGS((
+    HT_STRUCT(htable) *table,
+    uint32_t key_size,
+    void *key,
+    void *value
+)) {
+    
+    uint32_t hash;
+    
+    HT_STRUCT(htable_entry) *ent;
+    
+    if (table->flags & HT_FLAG_SEQLOCK) {
+        MurmurHash3_x86_32(key, key_size, table->seed, &hash);
+        return htable_get_seq(table, hash, key_size, key,
+                              NULL, 0, value) != NULL;
+    }
+    
+    ent = HT_EXPORT(htable_get)(table, key_size, key);
+    if (ent == NULL) {
+        return 0;
+    }
+    
+    htable_copy_value(table, ent, value);
+    return 1;
+}
+
+/**
+* htable_add_iov()
+*
+* Add item to hash table, with a key made of fragments, such as the
+* fields of a composite key, without concatenating them first. The key
+* is hashed as the fragments concatenated, so it matches the same bytes
+* passed to htable_add() or htable_get() as one buffer. Only for
+* HT_FLAG_INLINE_KEYS tables, which gather the fragments into their own
+* copy of the key. copyfn receives that copy as key.
+*
+* Usage:
+*
+* struct htable_iovec key[3];
+*
+* key[0].base = &tenant_id; key[0].len = sizeof(tenant_id);
+* key[1].base = &user_id;   key[1].len = sizeof(user_id);
+* key[2].base = object;     key[2].len = strlen(object);
+* htable_add_iov(table, key, 3, data);
+*
+* @param    struct htable *table
+* @param    struct htable_iovec *iov
+* @param    int iovcnt
+*               - Number of fragments, at least 1
+* @param    void *data
+*
+* @return   0 on error, 1 on success
+**/
+int
+HT_EXPORT(htable_add_iov)
+HT_ARGS((
+    HT_STRUCT(htable) *table,
+    const HT_STRUCT(htable_iovec) *iov,
+    int iovcnt,
+    void *data
+)) {
+    
+    uint32_t hash, key_size, free_slot;
+    
+    HT_STRUCT(htable_entry) *ent;
+    
+    if (!(table->flags & HT_FLAG_INLINE_KEYS) || iovcnt < 1) {
+        return 0;
+    }
+    
+    hash = htable_hash_iov(table, iov, iovcnt, &key_size);
+    
+    ent = htable_probe_ex(table, hash, key_size, NULL, iov, iovcnt, &free_slot);
+    if (ent != NULL) {
+        /* Replace */
+        ent = htable_slot_mut(table, table->entries[ent->entry]);
+        if (!ent) {
+            return 0;
+        }
+        
+        if (table->freefn != NULL) {
+            /* Call freefn() */
+            table->freefn(ent);
+        }
+    } else if (
+            free_slot != HT_TOMBSTONE &&
+            htable_entries_reserve(table, table->used + 1) &&
+            (ent = htable_slot_mut(table, free_slot)) != NULL &&
+            htable_store_key_iov(table, ent, key_size, iov, iovcnt)) {
+        
+        /* Key is in place and room reserved, so this can't fail */
+        htable_claim(table, free_slot, hash, key_size, NULL);
+    } else {
+        /* Table is full, or out of memory */
+        return 0;
+    }
+    
+    htable_fill(table, ent, key_size, ent->key, data);
+    return 1;
+}
+
+/**
+* htable_get_iov()
+*
+* Get entry from hash table, by a key made of fragments (see
+* htable_add_iov()). Fragments are compared against the stored key one
+* by one. Only for tables that compare keys as bytes (HT_FLAG_MEMCMP or
+* HT_FLAG_INLINE_KEYS), NULL otherwise. Safe against a concurrent writer
+* on HT_FLAG_RCU and HT_FLAG_SEQLOCK tables, as htable_get() is.
+*
+* @param    struct htable *table
+* @param    struct htable_iovec *iov
+* @param    int iovcnt
+*               - Number of fragments, at least 1
+*
+* @return   NULL on error, pointer on success
+**/
+HT_STRUCT(htable_entry) *
+HT_EXPORT(htable_get_iov)
+HT_ARGS((
+    HT_STRUCT(htable) *table,
+    const HT_STRUCT(htable_iovec) *iov,
+    int iovcnt
+)) {
+    
+    uint32_t hash, key_size;
+    
+    if (!(table->flags & (HT_FLAG_MEMCMP | HT_FLAG_INLINE_KEYS)) || iovcnt < 1) {
+        return NULL;
+    }
+    
+    hash = htable_hash_iov(table, iov, iovcnt, &key_size);
+    return htable_get_hashed(table, hash, key_size, NULL, iov, iovcnt);
+}
+
+/**
+* htable_remove_iov()
+*
+* Remove item from hash table, by a key made of fragments (see
+* htable_add_iov() and htable_get_iov()).
+*
+* @param    struct htable *table
+* @param    struct htable_iovec *iov
+* @param    int iovcnt
+*               - Number of fragments, at least 1
+*
+* @return   0 on error, 1 on success
+**/
+int
+HT_EXPORT(htable_remove_iov)
+HT_ARGS((
+    HT_STRUCT(htable) *table,
+    const HT_STRUCT(htable_iovec) *iov,
+    int iovcnt
+)) {
+    
+    HT_STRUCT(htable_entry) *ent;
+    
+    ent = HT_EXPORT(htable_get_iov)(table, iov, iovcnt);
+    if (ent == NULL) {
+        return 0;
+    }
+    
+    return htable_unlink(table, ent);
+}
+
+/**
+* htable_scan()
+*
+* Incrementally iterate hash table, one home bucket per call, using
+* reverse binary cursors (as Redis SCAN does). Start with cursor 0 and
+* pass the returned cursor to the next call, until 0 is returned again.
+* fn is called for every entry whose hash maps to the bucket.
+*
+* The table may be modified between calls, including htable_resize() and
+* htable_shrink_to_fit(). Entries present for the whole scan are returned
+* at least once. Entries added or removed during the scan may or may not
+* be returned, and shrinking may return some entries more than once. This
+* holds as long as table->size stays a power of two (htable_new() with a
+* power of two size, then htable_resize() to powers of two, or
+* htable_shrink_to_fit()). For other sizes, buckets are visited in order,
+* and the guarantee only holds without resizes.
+*
+* Usage:
+*
+* uint32_t cursor = 0;
+*
+* do {
+*     cursor = htable_scan(table, cursor, &visit, ctx);
+* } while (cursor != 0);
+*
+* @param    struct htable *table
+* @param    uint32_t cursor
+* @param    htable_scanfn fn
+* @param    void *ctx
+*               - Passed to fn unchanged
+*
+* @return   next cursor, 0 when the scan is complete
+**/
+uint32_t
+HT_EXPORT(htable_scan)
+HT_ARGS((
+    HT_STRUCT(htable) *table,
+    uint32_t cursor,
+    HT_EXPORT(htable_scanfn) fn,
+    void *ctx
+)) {
+    
+    uint32_t mask, home, slot, step;
+    int pow2;
+    
+    HT_STRUCT(htable_entry) *ent;
+    
+    if (table->used == 0) {
+        return 0;
+    }
+    
+    pow2 = (table->size & (table->size - 1)) == 0;
+    mask = table->size - 1;
+    
+    if (pow2) {
+        home = cursor & mask;
+    } else if (cursor < table->size) {
+        home = cursor;
+    } else {
+        return 0;
+    }
+    
+    /* Entries hashing to home all live on its probe chain, which ends at
+       the first never used slot */
+    slot = home;
+    step = 0;
+    
+    while (step < table->size) {
+        ent = HT_SLOT(table, slot);
+        
+        if (ent->key == NULL) {
+            if (ent->entry != HT_TOMBSTONE) {
+                break;
+            }
+        } else if (table->hashes[ent->entry] % table->size == home) {
+            fn(ent, ctx);
+        }
+        
+        step += 1;
+        slot = (slot + step) % table->size;
+    }
+    
+    if (!pow2) {
+        cursor = home + 1;
+        return (cursor < table->size) ? cursor : 0;
+    }
+    
+    /* Increment the reversed cursor, so buckets already visited map to
+       buckets already visited after the table grows or shrinks */
+    cursor |= ~mask;
+    cursor = htable_reverse_bits(cursor);
+    cursor++;
+    cursor = htable_reverse_bits(cursor);
+    
+    return cursor;
+}
+
+/**
+* htable_foreach()
+*
+* Call fn for every entry, in the order of table->entries. Slots are
+* prefetched HT_PREFETCH_DISTANCE entries ahead, so walking a large table
+* is not bound by a cache miss per entry, as indexing it through
+* htable_entry_at() is.
+*
+* @param    struct htable *table
+* @param    htable_scanfn fn
+* @param    void *ctx
+*               - Passed to fn unchanged
+*
+* @return   void
+**/
+void
+HT_EXPORT(htable_foreach)
+HT_ARGS((
+    HT_STRUCT(htable) *table,
+    HT_EXPORT(htable_scanfn) fn,
+    void *ctx
+)) {
+    
+    uint32_t i;
+    
+    for (i = 0; i < table->used; i++) {
+        HT_PREFETCH_ENTRY(table, i);
+        fn(HT_ENTRY(table, i), ctx);
+    }
+}
+
+/**
+* Hash of the i'th key of "from", for table "in". Tables with the same
+* seed hash keys alike, so the stored hash is reused.
+*
+* @param    struct htable *from
+* @param    uint32_t i
+* @param    struct htable *in
+* @return   uint32_t
+**/
+static uint32_t
+htable_hash_for(
+    HT_STRUCT(htable) *from,
+    uint32_t i,
+    HT_STRUCT(htable) *in
+) {
+    uint32_t hash;
+    
+    HT_STRUCT(htable_entry) *ent;
+    
+    if (from->seed == in->seed) {
+        return from->hashes[i];
+    }
+    
+    ent = HT_ENTRY(from, i);
+    MurmurHash3_x86_32(ent->key, ent->key_size, in->seed, &hash);
+    return hash;
+}
+
+/**
+* Look the i'th key of "from" up in "in".
+*
+* @param    struct htable *from
+* @param    uint32_t i
+* @param    struct htable *in
+* @return   pointer to the entry of "in", NULL if not found
+**/
+static HT_STRUCT(htable_entry) *
+htable_lookup(
+    HT_STRUCT(htable) *from,
+    uint32_t i,
+    HT_STRUCT(htable) *in
+) {
+    HT_STRUCT(htable_entry) *ent = HT_ENTRY(from, i);
+    
+    return htable_get_hashed(in, htable_hash_for(from, i, in),
+                             ent->key_size, ent->key, NULL, 0);
+}
+
+/**
+* Count the keys of "from" that "in" has. With stop_on_miss, counting
+* stops at the first one it doesn't have.
+*
+* @param    struct htable *from
+* @param    struct htable *in
+* @param    int stop_on_miss
+* @return   uint32_t
+**/
+static uint32_t
+htable_set_count(
+    HT_STRUCT(htable) *from,
+    HT_STRUCT(htable) *in,
+    int stop_on_miss
+) {
+    uint32_t i, count = 0;
+    
+    for (i = 0; i < from->used; i++) {
+        HT_PREFETCH_ENTRY(from, i);
+        
+        if (htable_lookup(from, i, in) != NULL) {
+            count++;
+        } else if (stop_on_miss) {
+            break;
+        }
+    }
+    
+    return count;
+}
+
+/**
+* Go over entries [begin, end) of "from", looking their keys up in "in",
+* and add to list the entries that were found there, or if "found" is 0
+* the ones that were not. "own" picks what is added: the entry of "from"
+* if set, else the one found in "in".
+*
+* @param    struct htable *from
+* @param    struct htable *in
+* @param    uint32_t begin
+* @param    uint32_t end
+* @param    int found
+* @param    int own
+* @param    struct htable_entry **list
+* @return   number of entries added to list
+**/
+static uint32_t
+htable_set_filter(
+    HT_STRUCT(htable) *from,
+    HT_STRUCT(htable) *in,
+    uint32_t begin,
+    uint32_t end,
+    int found,
+    int own,
+    HT_STRUCT(htable_entry) **list
+) {
+    uint32_t i, used = 0;
+    
+    HT_STRUCT(htable_entry) *tmp;
+    
+    for (i = begin; i < end; i++) {
+        HT_PREFETCH_ENTRY(from, i);
+        
+        tmp = htable_lookup(from, i, in);
+        if ((tmp != NULL) == found) {
+            list[used++] = own ? HT_ENTRY(from, i) : tmp;
+        }
+    }
+    
+    return used;
+}
+
+/**
+* Go over the entries of "from" from *cursor on, like
+* htable_set_filter(), passing the kept ones to fn until it returns
+* non-zero. *cursor is left at the entry after the last one looked at.
+*
+* @param    struct htable *from
+* @param    struct htable *in
+* @param    uint32_t *cursor
+* @param    int found
+* @param    int own
+* @param    htable_visitfn fn
+* @param    void *ctx
+* @return   number of entries passed to fn
+**/
+static uint32_t
+htable_set_visit(
+    HT_STRUCT(htable) *from,
+    HT_STRUCT(htable) *in,
+    uint32_t *cursor,
+    int found,
+    int own,
+    HT_EXPORT(htable_visitfn) fn,
+    void *ctx
+) {
+    uint32_t i = *cursor, visited = 0;
+    
+    HT_STRUCT(htable_entry) *tmp;
+    
+    while (i < from->used) {
+        HT_PREFETCH_ENTRY(from, i);
+        
+        tmp = htable_lookup(from, i, in);
+        i++;
+        
+        if ((tmp != NULL) == found) {
+            visited++;
+            if (fn(own ? HT_ENTRY(from, i - 1) : tmp, ctx)) {
+                break;
+            }
+        }
+    }
+    
+    *cursor = i;
+    return visited;
+}
+
+/* Caller's buffer being filled by htable_set_next() */
+struct HT_EXPORT(htable_set_buffer) {
+    HT_STRUCT(htable_entry) **list;
+    uint32_t used;
+    uint32_t max;
+};
+
+/**
+* Add ent to the buffer, stopping the visit once it is full.
+*
+* @param    struct htable_entry *ent
+* @param    void *ctx
+*               - struct htable_set_buffer *
+* @return   1 if full, 0 if not
+**/
+static int
+htable_set_buffer_add(
+    HT_STRUCT(htable_entry) *ent,
+    void *ctx
+) {
+    HT_STRUCT(htable_set_buffer) *buffer = ctx;
+    
+    buffer->list[buffer->used++] = ent;
+    return buffer->used == buffer->max;
+}
+
+/**
+* Fill list with up to max entries, as htable_set_visit() would pass
+* them to fn.
+*
+* @param    struct htable *from
+* @param    struct htable *in
+* @param    uint32_t *cursor
+* @param    int found
+* @param    int own
+* @param    struct htable_entry **list
+* @param    uint32_t max
+* @return   number of entries written to list
+**/
+static uint32_t
+htable_set_next(
+    HT_STRUCT(htable) *from,
+    HT_STRUCT(htable) *in,
+    uint32_t *cursor,
+    int found,
+    int own,
+    HT_STRUCT(htable_entry) **list,
+    uint32_t max
+) {
+    HT_STRUCT(htable_set_buffer) buffer;
+    
+    if (max == 0) {
+        return 0;
+    }
+    
+    buffer.list = list;
+    buffer.used = 0;
+    buffer.max = max;
+    
+    return htable_set_visit(from, in, cursor, found, own,
+                            &htable_set_buffer_add, &buffer);
+}
+
+#ifdef HT_PARALLEL
+
+/* One thread's share of a parallel set operation: entries [begin, end)
+   of "from", with what it keeps going to "list". */
+struct HT_EXPORT(htable_set_job) {
+    HT_STRUCT(htable_worker) worker;
+    HT_STRUCT(htable) *from;
+    HT_STRUCT(htable) *in;
+    uint32_t begin;
+    uint32_t end;
+    int found;
+    int own;
+    HT_STRUCT(htable_entry) **list;
+    uint32_t used;
+};
+
+/**
+* Run htable_set_filter() for one job.
+*
+* @param    void *arg
+*               - struct htable_set_job *
+* @return   NULL
+**/
+static void *
+htable_set_worker(
+    void *arg
+) {
+    HT_STRUCT(htable_set_job) *job = arg;
+    
+    job->used = htable_set_filter(job->from, job->in, job->begin, job->end,
+                                  job->found, job->own, job->list);
+    return NULL;
+}
+
+/**
+* htable_set_filter() over all of "from", on nthreads threads, into
+* collection. The first thread writes straight into the collection, the
+* others into chunks of their own, which are then moved in behind it.
+*
+* @param    struct htable_collection *collection
+* @param    struct htable *from
+* @param    struct htable *in
+* @param    int found
+* @param    int own
+* @param    uint32_t nthreads
+* @return   0 on error, 1 on success
+**/
+static int
+htable_set_parallel(
+    HT_STRUCT(htable_collection) *collection,
+    HT_STRUCT(htable) *from,
+    HT_STRUCT(htable) *in,
+    int found,
+    int own,
+    uint32_t nthreads
+) {
+    uint32_t t;
+    
+    HT_STRUCT(htable_set_job) *jobs;
+    
+    jobs = malloc(sizeof(*jobs) * nthreads);
+    if (!jobs) {
+        return 0;
+    }
+    
+    for (t = 0; t < nthreads; t++) {
+        jobs[t].from = from;
+        jobs[t].in = in;
+        jobs[t].found = found;
+        jobs[t].own = own;
+        jobs[t].begin = (uint32_t)((uint64_t)from->used * t / nthreads);
+        jobs[t].end = (uint32_t)((uint64_t)from->used * (t + 1) / nthreads);
+        jobs[t].list = collection->list;
+        
+        if (t > 0) {
+            jobs[t].list = malloc(sizeof(*jobs[t].list) * (jobs[t].end - jobs[t].begin + 1));
+            if (!jobs[t].list) {
+                while (--t > 0) {
+                    free(jobs[t].list);
+                }
+                
+                free(jobs);
+                return 0;
+            }
+        }
+    }
+    
+    htable_run_jobs(&htable_set_worker, jobs, sizeof(*jobs), nthreads);
+    
+    collection->used = jobs[0].used;
+    for (t = 1; t < nthreads; t++) {
+        memcpy(collection->list + collection->used, jobs[t].list,
+               sizeof(*jobs[t].list) * jobs[t].used);
+        collection->used += jobs[t].used;
+        free(jobs[t].list);
+    }
+    
+    free(jobs);
+    return 1;
+}
+
+#endif
+
+/**
+* Collect entries of "from" by whether "in" has their key, as in
+* htable_set_filter(), on nthreads threads.
+*
+* @param    struct htable *from
+* @param    struct htable *in
+* @param    int found
+* @param    int own
+* @param    uint32_t nthreads
+* @return   struct htable_collection *
+*               NULL on error
+**/
+static HT_STRUCT(htable_collection) *
+htable_set_op(
+    HT_STRUCT(htable) *from,
+    HT_STRUCT(htable) *in,
+    int found,
+    int own,
+    uint32_t nthreads
+) {
+    HT_STRUCT(htable_collection) *collection;
+    
+    collection = HT_EXPORT(htable_collection_new)(from->used + 1);
+    if (!collection) {
+        return NULL;
+    }
+
+#ifdef HT_PARALLEL
+    if (nthreads > from->used) {
+        /* Not worth the threads */
+        nthreads = 1;
+    }
+    
+    if (nthreads > 1) {
+        if (!htable_set_parallel(collection, from, in, found, own, nthreads)) {
+            HT_EXPORT(htable_collection_delete)(collection);
+            return NULL;
+        }
+    } else
+#endif
+    collection->used = htable_set_filter(from, in, 0, from->used,
+                                         found, own, collection->list);
+    
+    collection->list[collection->used] = NULL;
+    return collection;
+}
+
+/**
+* htable_intersect()
+*
+* Get intersection of two hash tables, by key. Entries in the list
 * are pointers to elements in b, thus free()'ing b and then trying
 * to access elements in the list will likely cause a segfault. The
 * returned list can be freed via the htable_collection_delete()
@@ -765,6 +4125,77 @@ HT_ARGS((
 * Usage:
 *
 * uint32_t i;
+* struct htable_collection *list = htable_intersect(a, b);
+* 
+* for (i = 0; i < list->used; i++) {
+*     printf("%s\n", (char *)(list->list[i]->key));
+* }
+*
+* htable_collection_delete(list);
+*
+* @param    struct htable *a
+* @param    struct htable *b
+* @return   struct htable_collection *
+*               NULL on error
+**/
+HT_STRUCT(htable_collection) *
+HT_EXPORT(htable_intersect)
+HT_ARGS((
+    HT_STRUCT(htable) *a,
+    HT_STRUCT(htable) *b
+)) {
+    return htable_set_op(a, b, 1, 0, 1);
+}
+
+/**
+* htable_intersect_parallel()
+*
+* Like htable_intersect(), with a's entries split over nthreads threads,
+* the calling one included. Each thread collects its share into a chunk
+* of its own, and the chunks are joined in order, so the list is the
+* same as htable_intersect() returns, whatever the number of threads.
+* Without USE_PTHREAD, and with nthreads of 0 or 1, it runs on the
+* calling thread only. Neither table may change until the call returns.
+*
+* @param    struct htable *a
+* @param    struct htable *b
+* @param    uint32_t nthreads
+* @param    uint32_t flags
+*               - HT_SET_SMALLER: go over whichever table has fewer
+*                 entries, and look its keys up in the other. The list
+*                 holds the same entries of b, in b's order if b is the
+*                 smaller one.
+* @return   struct htable_collection *
+*               NULL on error
+**/
+HT_STRUCT(htable_collection) *
+HT_EXPORT(htable_intersect_parallel)
+HT_ARGS((
+    HT_STRUCT(htable) *a,
+    HT_STRUCT(htable) *b,
+    uint32_t nthreads,
+    uint32_t flags
+)) {
+    if ((flags & HT_SET_SMALLER) && b->used < a->used) {
+        /* b's entries that a has are the ones it would return */
+        return htable_set_op(b, a, 1, 1, nthreads);
+    }
+    
+    return htable_set_op(a, b, 1, 0, nthreads);
+}
+
+/**
+* htable_difference()
+*
+* Get difference of two hash tables, by key: the entries of a whose key
+* is not in b. Entries in the list are pointers to elements in a, thus
+* free()'ing a and then trying to access elements in the list will
+* likely cause a segfault. The returned list can be freed via the
+* htable_collection_delete() function.
+*
+* Usage:
+*
+* uint32_t i;
 * struct htable_collection *list = htable_difference(a, b);
 * 
 * for (i = 0; i < list->used; i++) {
@@ -784,32 +4215,414 @@ HT_ARGS((
     HT_STRUCT(htable) *a,
     HT_STRUCT(htable) *b
 )) {
+    return htable_set_op(a, b, 0, 1, 1);
+}
+
+/**
+* htable_difference_parallel()
+*
+* Like htable_difference(), with a's entries split over nthreads threads,
+* the calling one included. The list is the same as htable_difference()
+* returns, whatever the number of threads. See
+* htable_intersect_parallel().
+*
+* @param    struct htable *a
+* @param    struct htable *b
+* @param    uint32_t nthreads
+* @return   struct htable_collection *
+*               NULL on error
+**/
+HT_STRUCT(htable_collection) *
+HT_EXPORT(htable_difference_parallel)
+HT_ARGS((
+    HT_STRUCT(htable) *a,
+    HT_STRUCT(htable) *b,
+    uint32_t nthreads
+)) {
+    return htable_set_op(a, b, 0, 1, nthreads);
+}
 
-    uint32_t max_size, i;
+/**
+* htable_union_into()
+*
+* Add the keys of src that dst doesn't have to dst, in src's order, with
+* their data (or value bytes). Entries dst already has are left as they
+* are. Keys and data go through dst's copyfn, as with htable_add(). dst
+* is rebuilt into a larger table whenever it would pass HT_MAX_LOAD,
+* which invalidates pointers previously returned by htable_get().
+*
+* Tables with the same seed share hashes, which are then not computed
+* again. If either table has inline values, both must have the same
+* value width, unless dst is a set. Keys src stores inline can only go
+* to a table that stores them inline too, or copies them with copyfn.
+*
+* @param    struct htable *dst
+* @param    struct htable *src
+* @return   0 on error, 1 on success. On error dst holds the keys added
+*           so far.
+**/
+int
+HT_EXPORT(htable_union_into)
+HT_ARGS((
+    HT_STRUCT(htable) *dst,
+    HT_STRUCT(htable) *src
+)) {
     
-    HT_STRUCT(htable_collection) *collection;
-    HT_STRUCT(htable_entry) **list, *tmp;
+    uint32_t i, hash, free_slot, new_size;
     
-    if (a->used > b->used) {
-        max_size = a->used;
-    } else {
-        max_size = b->used;
+    HT_STRUCT(htable_entry) *ent, *added;
+    
+    if (    !(dst->flags & HT_FLAG_SET) &&
+            ((dst->flags | src->flags) & HT_FLAG_INLINE_VALUES) &&
+            (!(dst->flags & src->flags & HT_FLAG_INLINE_VALUES) ||
+             dst->value_size != src->value_size)) {
+        /* Values would be read past their end, or point into src */
+        return 0;
     }
     
-    collection = HT_EXPORT(htable_collection_new)(max_size+1);
-    if (!collection) {
-        return NULL;
+    if (    (src->flags & HT_FLAG_INLINE_KEYS) &&
+            !(dst->flags & HT_FLAG_INLINE_KEYS) && dst->copyfn == NULL) {
+        /* Keys would point into src */
+        return 0;
     }
     
-    list = collection->list;
-    for (i = 0; i < a->used; i++) {
-        tmp = HT_EXPORT(htable_get)(b, a->entries[i]->key_size, a->entries[i]->key);
-        if (!tmp) {
-            list[0] = a->entries[i];
-            list++;
+    for (i = 0; i < src->used; i++) {
+        HT_PREFETCH_ENTRY(src, i);
+        
+        if ((uint64_t)(dst->used + dst->deleted + 1) * 100 >
+                (uint64_t)dst->size * HT_MAX_LOAD) {
+            /* Make room, or just drop tombstones if that's enough */
+            new_size = dst->size;
+            while ((uint64_t)(dst->used + 1) * 100 >
+                    (uint64_t)new_size * HT_MAX_LOAD && new_size <= UINT32_MAX / 2) {
+                new_size *= 2;
+            }
+            
+            if (!htable_rebuild(dst, new_size, 1)) {
+                return 0;
+            }
         }
+        
+        ent = HT_ENTRY(src, i);
+        hash = htable_hash_for(src, i, dst);
+        
+        if (htable_probe(dst, hash, ent->key_size, ent->key, &free_slot) != NULL) {
+            continue;
+        }
+        
+        HT_EXPORT(htable_write_begin)(dst);
+        
+        if (    free_slot == HT_TOMBSTONE ||
+                !(added = htable_claim(dst, free_slot, hash, ent->key_size, ent->key))) {
+            /* Table is full, or out of memory */
+            HT_EXPORT(htable_write_end)(dst);
+            return 0;
+        }
+        
+        htable_fill(dst, added, ent->key_size, ent->key, HT_DATA(src, ent));
+        HT_EXPORT(htable_write_end)(dst);
+    }
+    
+    return 1;
+}
+
+/**
+* htable_symmetric_difference()
+*
+* Get the entries of a whose key is not in b, followed by the entries
+* of b whose key is not in a, each in their table's order. Entries in
+* the list point into a and b. See htable_difference().
+*
+* @param    struct htable *a
+* @param    struct htable *b
+* @return   struct htable_collection *
+*               NULL on error
+**/
+HT_STRUCT(htable_collection) *
+HT_EXPORT(htable_symmetric_difference)
+HT_ARGS((
+    HT_STRUCT(htable) *a,
+    HT_STRUCT(htable) *b
+)) {
+    
+    HT_STRUCT(htable_collection) *collection;
+    
+    collection = HT_EXPORT(htable_collection_new)(a->used + b->used + 1);
+    if (!collection) {
+        return NULL;
     }
     
-    list[0] = NULL;
+    collection->used = htable_set_filter(a, b, 0, a->used, 0, 1,
+                                         collection->list);
+    collection->used += htable_set_filter(b, a, 0, b->used, 0, 1,
+                                          collection->list + collection->used);
+    
+    collection->list[collection->used] = NULL;
     return collection;
 }
+
+/**
+* htable_is_subset()
+*
+* Check whether every key of a is in b. Stops at the first key that
+* isn't, and returns right away if a has more entries than b.
+*
+* @param    struct htable *a
+* @param    struct htable *b
+* @return   1 if a is a subset of b, 0 if not
+**/
+int
+HT_EXPORT(htable_is_subset)
+HT_ARGS((
+    HT_STRUCT(htable) *a,
+    HT_STRUCT(htable) *b
+)) {
+    if (a->used > b->used) {
+        return 0;
+    }
+    
+    return htable_set_count(a, b, 1) == a->used;
+}
+
+/**
+* htable_equal()
+*
+* Check whether a and b have the same keys. Data is not compared.
+*
+* @param    struct htable *a
+* @param    struct htable *b
+* @return   1 if equal, 0 if not
+**/
+int
+HT_EXPORT(htable_equal)
+HT_ARGS((
+    HT_STRUCT(htable) *a,
+    HT_STRUCT(htable) *b
+)) {
+    if (a->used != b->used) {
+        return 0;
+    }
+    
+    return htable_set_count(a, b, 1) == a->used;
+}
+
+/**
+* htable_intersect_count()
+*
+* Count the keys a and b have in common, without building a list. Goes
+* over whichever table has fewer entries.
+*
+* @param    struct htable *a
+* @param    struct htable *b
+* @return   uint32_t
+**/
+uint32_t
+HT_EXPORT(htable_intersect_count)
+HT_ARGS((
+    HT_STRUCT(htable) *a,
+    HT_STRUCT(htable) *b
+)) {
+    if (b->used < a->used) {
+        return htable_set_count(b, a, 0);
+    }
+    
+    return htable_set_count(a, b, 0);
+}
+
+/**
+* htable_intersect_each()
+*
+* Pass the entries htable_intersect() would list to fn, one at a time,
+* without allocating. fn gets the entries of b, in a's order, and may
+* stop the walk by returning non-zero.
+*
+* Usage:
+*
+* static int
+* print_key(struct htable_entry *ent, void *ctx)
+* {
+*     printf("%s\n", (char *)ent->key);
+*     return 0;
+* }
+*
+* htable_intersect_each(a, b, &print_key, NULL);
+*
+* @param    struct htable *a
+* @param    struct htable *b
+* @param    htable_visitfn fn
+* @param    void *ctx
+*               - Passed to fn unchanged
+*
+* @return   number of entries passed to fn
+**/
+uint32_t
+HT_EXPORT(htable_intersect_each)
+HT_ARGS((
+    HT_STRUCT(htable) *a,
+    HT_STRUCT(htable) *b,
+    HT_EXPORT(htable_visitfn) fn,
+    void *ctx
+)) {
+    uint32_t cursor = 0;
+    
+    return htable_set_visit(a, b, &cursor, 1, 0, fn, ctx);
+}
+
+/**
+* htable_difference_each()
+*
+* Pass the entries htable_difference() would list to fn, one at a time,
+* without allocating. fn gets the entries of a whose key is not in b,
+* and may stop the walk by returning non-zero. See
+* htable_intersect_each().
+*
+* @param    struct htable *a
+* @param    struct htable *b
+* @param    htable_visitfn fn
+* @param    void *ctx
+*               - Passed to fn unchanged
+*
+* @return   number of entries passed to fn
+**/
+uint32_t
+HT_EXPORT(htable_difference_each)
+HT_ARGS((
+    HT_STRUCT(htable) *a,
+    HT_STRUCT(htable) *b,
+    HT_EXPORT(htable_visitfn) fn,
+    void *ctx
+)) {
+    uint32_t cursor = 0;
+    
+    return htable_set_visit(a, b, &cursor, 0, 1, fn, ctx);
+}
+
+/**
+* htable_intersect_next()
+*
+* Get the intersection of a and b a bufferful at a time: write up to
+* max of the entries htable_intersect() would list to list, and move
+* cursor past them. Start with cursor 0, and call until 0 is returned.
+* The cursor is a position in a's entries, so neither table may change
+* until the walk is done, or entries may be skipped or seen twice.
+*
+* Usage:
+*
+* uint32_t i, n, cursor = 0;
+* struct htable_entry *list[256];
+*
+* while ((n = htable_intersect_next(a, b, &cursor, list, 256)) > 0) {
+*     for (i = 0; i < n; i++) {
+*         printf("%s\n", (char *)(list[i]->key));
+*     }
+* }
+*
+* @param    struct htable *a
+* @param    struct htable *b
+* @param    uint32_t *cursor
+* @param    struct htable_entry **list
+* @param    uint32_t max
+*
+* @return   number of entries written to list, 0 when done
+**/
+uint32_t
+HT_EXPORT(htable_intersect_next)
+HT_ARGS((
+    HT_STRUCT(htable) *a,
+    HT_STRUCT(htable) *b,
+    uint32_t *cursor,
+    HT_STRUCT(htable_entry) **list,
+    uint32_t max
+)) {
+    return htable_set_next(a, b, cursor, 1, 0, list, max);
+}
+
+/**
+* htable_difference_next()
+*
+* Get the difference of a and b a bufferful at a time. See
+* htable_intersect_next() and htable_difference().
+*
+* @param    struct htable *a
+* @param    struct htable *b
+* @param    uint32_t *cursor
+* @param    struct htable_entry **list
+* @param    uint32_t max
+*
+* @return   number of entries written to list, 0 when done
+**/
+uint32_t
+HT_EXPORT(htable_difference_next)
+HT_ARGS((
+    HT_STRUCT(htable) *a,
+    HT_STRUCT(htable) *b,
+    uint32_t *cursor,
+    HT_STRUCT(htable_entry) **list,
+    uint32_t max
+)) {
+    return htable_set_next(a, b, cursor, 0, 1, list, max);
+}
+
+/**
+* htable_bloom_attach()
+*
+* Put a blocked Bloom filter in front of the table's lookups, so most
+* lookups of absent keys return without probing. htable_get(),
+* htable_get_copy(), htable_get_iov(), and the set operations looking
+* keys up in the table check it first. It is kept up to date by every
+* insert, and rebuilt along with the table by htable_resize() and
+* htable_shrink_to_fit(), sized for HT_MAX_LOAD percent of the new
+* slots. htable_clone() copies it. See struct htable_bloom for its
+* statistics.
+*
+* The filter costs about -1.44 * log2(fp_rate) bits per key: 10 for 1%.
+* Attaching to a table that has one replaces it, resetting statistics.
+* Not for HT_FLAG_RCU and HT_FLAG_SEQLOCK tables, whose readers would
+* race the writer on the filter's bits.
+*
+* @param    struct htable *table
+* @param    double fp_rate
+*               - Target false positive rate, between 0 and 1
+* @return   0 on error, 1 on success
+**/
+int
+HT_EXPORT(htable_bloom_attach)
+HT_ARGS((
+    HT_STRUCT(htable) *table,
+    double fp_rate
+)) {
+    
+    HT_STRUCT(htable_bloom) *bloom;
+    
+    if (    !(fp_rate > 0 && fp_rate < 1) ||
+            (table->flags & (HT_FLAG_RCU | HT_FLAG_SEQLOCK))) {
+        return 0;
+    }
+    
+    HT_EXPORT(htable_bloom_detach)(table);
+    
+    bloom = htable_bloom_build(table, table->size, fp_rate);
+    if (!bloom) {
+        return 0;
+    }
+    
+    table->bloom = bloom;
+    return 1;
+}
+
+/**
+* htable_bloom_detach()
+*
+* Remove and free the table's Bloom filter, if it has one.
+*
+* @param    struct htable *table
+* @return   void
+**/
+void
+HT_EXPORT(htable_bloom_detach)
+HT_ARGS((
+    HT_STRUCT(htable) *table
+)) {
+    htable_bloom_free(table->bloom);
+    table->bloom = NULL;
+}
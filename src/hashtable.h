@@ -16,8 +16,156 @@
 
 #define HT_ARGS(SYM) SYM
 
+#ifdef __HT_INTERNAL
+    #define HT_STRUCT(in) struct HT_EXPORT(in)
+    
+    /* Reference counts that may be dropped from other threads */
+    #if defined(__GNUC__)
+        #define HT_ATOMIC_INC(x) __sync_add_and_fetch(&(x), 1)
+        #define HT_ATOMIC_DEC(x) __sync_sub_and_fetch(&(x), 1)
+        #define HT_ATOMIC_CAS(x, old, new) \
+            __sync_bool_compare_and_swap(&(x), (old), (new))
+    #else
+        #define HT_ATOMIC_INC(x) (++(x))
+        #define HT_ATOMIC_DEC(x) (--(x))
+        #define HT_ATOMIC_CAS(x, old, new) \
+            ((x) == (old) ? ((x) = (new), 1) : 0)
+    #endif
+    
+    /* Ordered loads and stores, for readers running alongside a writer */
+    #if defined(__ATOMIC_ACQUIRE)
+        #define HT_LOAD_ACQUIRE(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+        #define HT_STORE_RELEASE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+        #define HT_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+        #define HT_FENCE_ACQUIRE() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+        #define HT_FENCE_RELEASE() __atomic_thread_fence(__ATOMIC_RELEASE)
+    #elif defined(__GNUC__)
+        #define HT_LOAD_ACQUIRE(x) (*(volatile __typeof__(x) *)&(x))
+        #define HT_STORE_RELEASE(x, v) \
+            (__sync_synchronize(), *(volatile __typeof__(x) *)&(x) = (v))
+        #define HT_FENCE() __sync_synchronize()
+        #define HT_FENCE_ACQUIRE() __sync_synchronize()
+        #define HT_FENCE_RELEASE() __sync_synchronize()
+    #else
+        #define HT_LOAD_ACQUIRE(x) (x)
+        #define HT_STORE_RELEASE(x, v) ((x) = (v))
+        #define HT_FENCE()
+        #define HT_FENCE_ACQUIRE()
+        #define HT_FENCE_RELEASE()
+    #endif
+    
+    /* Statistics bumped by readers that may run on several threads */
+    #if defined(__ATOMIC_RELAXED)
+        #define HT_COUNT(x) __atomic_fetch_add(&(x), 1, __ATOMIC_RELAXED)
+    #elif defined(__GNUC__)
+        #define HT_COUNT(x) __sync_fetch_and_add(&(x), 1)
+    #else
+        #define HT_COUNT(x) ((x)++)
+    #endif
+#endif
+
+/* Maximum load factor (percent) targeted when a table is rebuilt by
+   htable_shrink_to_fit(). */
+#ifndef HT_MAX_LOAD
+    #define HT_MAX_LOAD 75
+#endif
+
+/* Smallest capacity htable_shrink_to_fit() will shrink a table to. */
+#ifndef HT_MIN_SIZE
+    #define HT_MIN_SIZE 8
+#endif
+
+/* Flags for htable_new_ex() */
+
+/* Key-only table (set). Slots end before htable_entry.data, which must
+   not be accessed, including from copyfn and freefn. */
+#define HT_FLAG_SET 0x1
+
+/* Table owned keys. Keys shorter than HT_INLINE_KEY_SIZE are stored in
+   the slot itself, longer keys are copied to the heap. Either copy is
+   NUL terminated and pointed to by htable_entry.key. Keys are compared
+   by key_size and memcmp(), so cmpfn may be NULL. copyfn and freefn
+   must not set or free htable_entry.key. */
+#define HT_FLAG_INLINE_KEYS 0x2
+
+/* Fixed width values stored in the slot, starting at htable_entry.data.
+   Use HT_VALUE_WIDTH() to set the width. htable_add() copies that many
+   bytes from its data argument (zero fills if it is NULL), and
+   htable_value() returns a pointer to the stored copy. copyfn and
+   freefn must not set or free htable_entry.data. Can't be combined
+   with HT_FLAG_SET. */
+#define HT_FLAG_INLINE_VALUES 0x4
+
+/* Flags for inline values of "width" bytes, up to 65535 */
+#define HT_VALUE_WIDTH(width) \
+    (HT_FLAG_INLINE_VALUES | ((uint32_t)(width) << 16))
+
+/* Keys are compared by key_size, then memcmp(), instead of cmpfn. Keys
+   need not be NUL terminated, and cmpfn may be NULL. */
+#define HT_FLAG_MEMCMP 0x8
+
+/* Slots are stored in reference counted pages of HT_PAGE_SLOTS slots, so
+   htable_snapshot() can share them. Once a snapshot exists, modify
+   entries through the table functions only, not through pointers from
+   htable_get() or htable_entry_at(): a shared page is copied before the
+   table writes to it. Pointers returned by htable_find_or_insert() and
+   htable_emplace() are safe to write. Snapshots don't own keys or data,
+   so freefn must be NULL, and HT_FLAG_INLINE_KEYS can't be used. */
+#define HT_FLAG_COW 0x10
+
+/* htable_get() may run on other threads, without locks, alongside one
+   thread calling htable_add() and htable_remove(). Entries are published
+   with release stores, and slots freed by htable_remove() are not reused
+   until the table is rebuilt, so a reader never sees a slot change keys.
+   Replacing a key stores its new data with release ordering too, so
+   readers load ent->data with acquire ordering (htable_rcu_data()).
+   Keys and data must stay valid while readers may still see them, which
+   is why copyfn and freefn must be NULL, and inline keys, inline values
+   and HT_FLAG_COW can't be used. Nothing else may modify the table while
+   readers run. htable_rcu (hashtable-rcu.h) manages all of this. */
+#define HT_FLAG_RCU 0x20
+
+/* One thread modifies the table, and others may call htable_get() and
+   htable_get_copy() at the same time, without locks. Writers make
+   table->seq odd while they change the table (see htable_write_begin()),
+   and readers retry when it was odd, or changed, during their lookup.
+   Readers store nothing to shared memory. Slot arrays replaced by a
+   resize are kept until htable_reclaim() or htable_delete(), so a reader
+   that overlaps one reads stale slots, never freed ones, before it
+   retries. Keys must stay valid while readers may see them, so copyfn
+   and freefn must be NULL, and inline keys and HT_FLAG_COW can't be
+   used. Inline values can, and htable_get_copy() reads them whole. */
+#define HT_FLAG_SEQLOCK 0x40
+
+/* Set operations may go over whichever table is smaller, see
+   htable_intersect_parallel(). */
+#define HT_SET_SMALLER 0x1
+
+/* Slots per page of HT_FLAG_COW tables. Must be a power of two. */
+#ifndef HT_PAGE_SLOTS
+    #define HT_PAGE_SLOTS 1024
+#endif
+
+/* How many entries ahead loops over table->entries prefetch slots. */
+#ifndef HT_PREFETCH_DISTANCE
+    #define HT_PREFETCH_DISTANCE 8
+#endif
+
+/* Bytes per block of htable_bloom_attach() filters: one cache line.
+   Must be a power of two, and a multiple of 8. */
+#ifndef HT_BLOOM_BLOCK
+    #define HT_BLOOM_BLOCK 64
+#endif
+
+/* Inline key capacity of HT_FLAG_INLINE_KEYS slots, in bytes. */
+#ifndef HT_INLINE_KEY_SIZE
+    #define HT_INLINE_KEY_SIZE 16
+#endif
+
 struct HT_EXPORT(htable_entry);
 struct HT_EXPORT(htable);
+struct HT_EXPORT(htable_retired);
+struct HT_EXPORT(htable_bloom);
 
 /* htable_copyfn type definition */
 typedef
@@ -43,28 +191,123 @@ HT_ARGS((
     void *B
 ));
 
-/* Hash Table Entry */
+/* Key fragment, for htable_add_iov() and friends */
+struct HT_EXPORT(htable_iovec) {
+    const void *base;
+    uint32_t len;
+};
+
+/* htable_predfn type definition, for htable_remove_if(). Returns non-zero
+   to select ent. Must not modify the table, nor look anything up in a
+   HT_FLAG_SEQLOCK table: it runs inside a write section, which such a
+   lookup would wait on forever (see htable_write_begin()). */
+typedef
+int (* HT_EXPORT(htable_predfn))
+HT_ARGS((
+    struct HT_EXPORT(htable_entry) *ent,
+    void *ctx
+));
+
+/* htable_scanfn type definition, for htable_scan() and htable_foreach().
+   Must not modify the table. */
+typedef
+void (* HT_EXPORT(htable_scanfn))
+HT_ARGS((
+    struct HT_EXPORT(htable_entry) *ent,
+    void *ctx
+));
+
+/* htable_visitfn type definition, for htable_intersect_each() and
+   htable_difference_each(). Returns non-zero to stop the walk. Must not
+   modify either table. */
+typedef
+int (* HT_EXPORT(htable_visitfn))
+HT_ARGS((
+    struct HT_EXPORT(htable_entry) *ent,
+    void *ctx
+));
+
+/* Return values of htable_emplace() */
+#define HT_EMPLACE_NEW 1
+#define HT_EMPLACE_EXISTS 2
+
+/* Hash Table Entry (slot). Fields are ordered so the slot packs into
+   24 bytes on 64-bit platforms, 16 bytes on 32-bit. "entry" is the
+   position of the slot in htable.entries. "data" must stay last: sets
+   (HT_FLAG_SET) allocate slots without it. */
 struct HT_EXPORT(htable_entry) {
-    uint32_t key_size;
     void *key;
-    void *data;
+    uint32_t key_size;
     uint32_t entry;
-    uint32_t hash;
+    void *data;
 };
 
-/* Hash Table */
+/* Hash Table. "entries" is a dense array of slot indices, in insertion
+   order (modulo removals), and "hashes" holds the full MurmurHash3 of
+   each of those entries, so the table can be rebuilt without hashing
+   keys again. Both are sized to "used", not "size". Slots are
+   "slot_size" bytes apart, so index "table" through htable_entry_at()
+   rather than directly. HT_FLAG_COW tables keep slots in "pages"
+   instead, and "table" is NULL. "seq", "writing" and "retired" are only
+   used by HT_FLAG_SEQLOCK tables. "bloom" is NULL unless a filter was
+   attached with htable_bloom_attach(). */
 struct HT_EXPORT(htable) {
     struct HT_EXPORT(htable_entry) *table;
-    struct HT_EXPORT(htable_entry) **entries;
+    void **pages;
+    struct HT_EXPORT(htable_retired) *retired;
+    struct HT_EXPORT(htable_bloom) *bloom;
+    uint32_t *entries;
+    uint32_t *hashes;
+    uint32_t entries_size;
     uint32_t size;
     uint32_t used;
+    uint32_t deleted;
     uint32_t seed;
+    uint32_t flags;
+    uint32_t slot_size;
+    uint32_t key_offset;
+    uint32_t value_size;
+    uint32_t seq;
+    uint32_t writing;
+    uint8_t shrink_thresh;
     
     HT_EXPORT(htable_copyfn) copyfn;
     HT_EXPORT(htable_freefn) freefn;
     HT_EXPORT(htable_cmpfn) cmpfn;
 };
 
+/* Blocked Bloom filter in front of a table's lookups. Each key sets "k"
+   bits in one of "nblocks" blocks of HT_BLOOM_BLOCK bytes, all picked
+   from its stored hash, so checking a key touches a single cache line.
+   "blocks" is aligned to HT_BLOOM_BLOCK within "mem". Bits are only
+   cleared when the table is rebuilt or cleared, so removed keys still
+   pass the filter until then.
+   
+   "checks" counts lookups the filter was asked about, "skipped" the ones
+   it turned away (the key is surely not there), and "false_positives"
+   the ones it let through that then found nothing. The observed false
+   positive rate is false_positives / (false_positives + skipped). They
+   are bumped with relaxed atomic adds, and may lag behind lookups still
+   running on other threads. */
+struct HT_EXPORT(htable_bloom) {
+    uint64_t *blocks;
+    void *mem;
+    uint32_t nblocks;
+    uint32_t k;
+    double fp_rate;
+    uint64_t checks;
+    uint64_t skipped;
+    uint64_t false_positives;
+};
+
+/* Read-only, copy-on-write view of a HT_FLAG_COW table, taken by
+   htable_snapshot(). "view" shares the slot pages of the table; it has no
+   entries or hashes arrays, so only use it through the htable_snapshot_*
+   functions. */
+struct HT_EXPORT(htable_snapshot) {
+    struct HT_EXPORT(htable) view;
+};
+
 /* A collection of hash table entries */
 struct HT_EXPORT(htable_collection) {
     uint32_t size;
@@ -180,6 +423,65 @@ HT_ARGS((
     HT_EXPORT(htable_freefn) freefn
 ));
 
+/**
+* htable_new_ex()
+*
+* Create a new hash table, with flags. See htable_new().
+*
+* @param    uint32_t size
+* @param    uint32_t seed
+* @param    htable_cmpfn cmpfn
+* @param    htable_copyfn copyfn
+* @param    htable_freefn freefn
+* @param    uint32_t flags
+*               - HT_FLAG_SET: key-only table, slots have no data field
+*               - HT_FLAG_INLINE_KEYS: table owned keys, short ones
+*                 stored in the slot
+*               - HT_VALUE_WIDTH(width): values of "width" bytes
+*                 stored in the slot
+*               - HT_FLAG_MEMCMP: compare keys by size and bytes
+* @return   struct htable *
+*               NULL on error
+**/
+HT_EXTERN struct HT_EXPORT(htable) *
+HT_EXPORT(htable_new_ex)
+HT_ARGS((
+    uint32_t size,
+    uint32_t random_seed,
+    HT_EXPORT(htable_cmpfn) cmpfn,
+    HT_EXPORT(htable_copyfn) copyfn,
+    HT_EXPORT(htable_freefn) freefn,
+    uint32_t flags
+));
+
+/**
+* htable_set_new()
+*
+* Create a new key-only hash table (set). Equivalent to calling
+* htable_new_ex() with HT_FLAG_SET. Pass NULL as data to htable_add().
+* htable_intersect() and htable_difference() work on sets as on any
+* other table.
+*
+* @param    uint32_t size
+* @param    uint32_t seed
+* @param    htable_cmpfn cmpfn
+* @param    htable_copyfn copyfn
+*               - Receives NULL data, and must not set dst->data
+* @param    htable_freefn freefn
+*               - Must not access ptr->data
+* @return   struct htable *
+*               NULL on error
+**/
+HT_EXTERN struct HT_EXPORT(htable) *
+HT_EXPORT(htable_set_new)
+HT_ARGS((
+    uint32_t size,
+    uint32_t random_seed,
+    HT_EXPORT(htable_cmpfn) cmpfn,
+    HT_EXPORT(htable_copyfn) copyfn,
+    HT_EXPORT(htable_freefn) freefn
+));
+
 /**
 * htable_clone()
 *
@@ -197,207 +499,823 @@ HT_ARGS((
 ));
 
 /**
-* htable_delete()
+* htable_clone_ex()
 *
-* Delete hash table created by htable_new(). If table->freefn is not NULL,
-* it will be called for each element, so allocated memory can be freed.
+* Clone hash table into a table of "size" slots. Entries are placed by
+* their stored hash, in the same dense order, so keys are not hashed or
+* compared again and tombstones are left behind: cloning to a new size
+* costs one copy, where htable_clone() followed by htable_resize() costs
+* two. With size 0, slots are copied as they are, as by htable_clone().
 *
-* @param    struct htable *table
-* @return   void
+* @param    struct htable *src
+* @param    uint32_t size
+*               - Power of two, at least src->used, or 0 to keep
+*                 src->size and its tombstones
+* @return   struct htable *
+*               NULL on error
 **/
-HT_EXTERN void
-HT_EXPORT(htable_delete)
+HT_EXTERN struct HT_EXPORT(htable) *
+HT_EXPORT(htable_clone_ex)
 HT_ARGS((
-    struct HT_EXPORT(htable) *table
+    struct HT_EXPORT(htable) *src,
+    uint32_t size
 ));
 
 /**
-* htable_resize()
+* htable_snapshot()
 *
-* Resize hash table, normally for growing, but can also be used to
-* shrink the size of the table.
+* Take a read-only, point in time snapshot of a HT_FLAG_COW table, in
+* O(pages) time: slot pages are shared, not copied. A page is copied when
+* the table first writes to it afterwards, so the snapshot keeps seeing
+* the entries as they were. Neither copyfn nor any other callback is
+* called, so keys and data pointed to by entries must stay valid until
+* the snapshot is deleted.
 *
-* @param    struct htable *table
-* @param    uint8_t load_thresh
-*               Number between 0 and 100. If load factor is below it,
-*               then resize won't trigger. Use 0 to disable.
+* The snapshot may be read and deleted on another thread, while the
+* table keeps being used on its own.
 *
-* @param    uint32_t new_size
-* @return   0 on error, 1 on success
+* @param    struct htable *table
+* @return   struct htable_snapshot *
+*               NULL on error, or if table is not HT_FLAG_COW
 **/
-HT_EXTERN int
-HT_EXPORT(htable_resize)
+HT_EXTERN struct HT_EXPORT(htable_snapshot) *
+HT_EXPORT(htable_snapshot)
 HT_ARGS((
-    struct HT_EXPORT(htable) *table,
-    uint8_t load_thresh,
-    uint32_t new_size
+    struct HT_EXPORT(htable) *table
 ));
 
 /**
-* Create new htable_collection object.
+* htable_snapshot_get()
 *
-* @param    uint32_t size
-* @return   NULL on error
+* Get entry from snapshot. The entry must not be modified.
+*
+* @param    struct htable_snapshot *snap
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+*
+* @return   NULL on error, pointer on success
 **/
-HT_EXTERN
-struct HT_EXPORT(htable_collection) *
-HT_EXPORT(htable_collection_new)
+HT_EXTERN struct HT_EXPORT(htable_entry) *
+HT_EXPORT(htable_snapshot_get)
 HT_ARGS((
-    uint32_t size
+    struct HT_EXPORT(htable_snapshot) *snap,
+    uint32_t key_size,
+    void *key
 ));
 
 /**
-* Delete htable_collection object created by htable_collection_new
+* htable_snapshot_foreach()
+*
+* Call fn for every entry of snapshot, in slot order. Pages are walked
+* sequentially. fn must not modify the entries.
+*
+* @param    struct htable_snapshot *snap
+* @param    htable_scanfn fn
+* @param    void *ctx
+*               - Passed to fn unchanged
 *
-* @param    struct htable_collection *
 * @return   void
 **/
 HT_EXTERN void
-HT_EXPORT(htable_collection_delete)
+HT_EXPORT(htable_snapshot_foreach)
 HT_ARGS((
-    struct HT_EXPORT(htable_collection) *collection
+    struct HT_EXPORT(htable_snapshot) *snap,
+    HT_EXPORT(htable_scanfn) fn,
+    void *ctx
 ));
 
 /**
-* Resize htable_collection object.
+* htable_snapshot_delete()
 *
-* @param    struct htable_collection *
-* @param    uint32_t size
-* @return   NULL on error
+* Delete snapshot created by htable_snapshot(), releasing the pages it
+* shares. The table it was taken from is not affected.
+*
+* @param    struct htable_snapshot *snap
+* @return   void
 **/
-int
-HT_EXPORT(htable_collection_resize)
+HT_EXTERN void
+HT_EXPORT(htable_snapshot_delete)
 HT_ARGS((
-    struct HT_EXPORT(htable_collection) *collection,
-    uint32_t size
+    struct HT_EXPORT(htable_snapshot) *snap
 ));
 
-/************************************************************************
-* Manipulation functions
-************************************************************************/
-
 /**
-* htable_add()
+* htable_delete()
 *
-* Add item to hash table. 
+* Delete hash table created by htable_new(). If table->freefn is not NULL,
+* it will be called for each element, so allocated memory can be freed.
 *
 * @param    struct htable *table
-* @param    uint32_t key_size
-*               - sizeof(key) for ints
-*               - strlen(key) for strings
-* @param    void *key
-* @param    void *data
-*
-* @return   0 on error, 1 on success
+* @return   void
 **/
-HT_EXTERN int
-HT_EXPORT(htable_add)
+HT_EXTERN void
+HT_EXPORT(htable_delete)
 HT_ARGS((
-    struct HT_EXPORT(htable) *table,
-    uint32_t key_size,
-    void *key,
-    void *data
+    struct HT_EXPORT(htable) *table
 ));
 
 /**
-* htable_add_loop()
+* htable_clear()
 *
-* Unlink htable_add(), which will fail on its first try, htable_add_loop()
-* will try a maximum of "max_loops" times to add an item before giving up.
-* It uses a quadratic resizing algorithm, so its best to keep max_loops
-* relatively small.
+* Remove all entries, keeping the allocated capacity, so the table can be
+* reused. If table->freefn is not NULL, it will be called for each
+* element. Only the used slots are visited, so the cost is O(used) rather
+* than O(size), unless htable_remove() has left tombstones, in which case
+* the whole slot array is reset. Pages of HT_FLAG_COW tables that are
+* shared with a snapshot are replaced by new, empty pages.
 *
 * @param    struct htable *table
-* @param    uint32_t key_size
-*               - sizeof(key) for ints
-*               - strlen(key) for strings
-* @param    void *key
-* @param    void *data
-* @param    int max_loops
-*
-* @return   0 on failure, otherwise the number of loops it took to
-*           successfully add item.
+* @return   0 on error, 1 on success
 **/
 HT_EXTERN int
-HT_EXPORT(htable_add_loop)
+HT_EXPORT(htable_clear)
 HT_ARGS((
-    struct HT_EXPORT(htable) *table,
-    uint32_t key_size,
-    void *key,
-    void *data,
-    int max_loops
+    struct HT_EXPORT(htable) *table
 ));
 
 /**
-* htable_remove()
-*
-* Remove item from hash table.
+* htable_resize()
 *
+* Resize hash table, normally for growing, but can also be used to
+* shrink the size of the table.
 *
 * @param    struct htable *table
-* @param    uint32_t key_size
-*               - sizeof(key) for ints
-*               - strlen(key) for strings
-* @param    void *key
+* @param    uint8_t load_thresh
+*               Number between 0 and 100. If load factor is below it,
+*               then resize won't trigger. Use 0 to disable.
 *
+* @param    uint32_t new_size
 * @return   0 on error, 1 on success
 **/
 HT_EXTERN int
-HT_EXPORT(htable_remove)
+HT_EXPORT(htable_resize)
 HT_ARGS((
     struct HT_EXPORT(htable) *table,
-    uint32_t key_size,
-    void *key
+    uint8_t load_thresh,
+    uint32_t new_size
 ));
 
 /**
-* htable_get()
+* htable_resize_parallel()
 *
-* Get entry from hash table.
+* Like htable_resize(), with the work split over nthreads threads, the
+* calling one included. The table comes out exactly as htable_resize()
+* would leave it, whatever the number of threads. Only worth it for
+* large tables, each call starts its own threads. Without USE_PTHREAD,
+* and with nthreads of 0 or 1, it is htable_resize().
 *
 * @param    struct htable *table
-* @param    uint32_t key_size
-*               - sizeof(key) for ints
-*               - strlen(key) for strings
-* @param    void *key
+* @param    uint8_t load_thresh
+*               Number between 0 and 100. If load factor is below it,
+*               then resize won't trigger. Use 0 to disable.
 *
-* @return   NULL on error, pointer on success
+* @param    uint32_t new_size
+* @param    uint32_t nthreads
+* @return   0 on error, 1 on success
 **/
-HT_EXTERN struct HT_EXPORT(htable_entry) *
-HT_EXPORT(htable_get)
+HT_EXTERN int
+HT_EXPORT(htable_resize_parallel)
 HT_ARGS((
     struct HT_EXPORT(htable) *table,
-    uint32_t key_size,
-    void *key
+    uint8_t load_thresh,
+    uint32_t new_size,
+    uint32_t nthreads
 ));
 
-/************************************************************************
-* Utility functions
-************************************************************************/
-
 /**
-* htable_intersect()
+* htable_entry_at()
 *
-* Get intersection of two hash tables, by key. Entries in the list
-* are pointers to elements in b, thus free()'ing b and then trying
-* to access elements in the list will likely cause a segfault. The
-* returned list can be freed via the htable_collection_delete()
-* function.
+* Get the i'th entry of the table, in the order of table->entries.
 *
 * Usage:
 *
 * uint32_t i;
-* struct htable_collection *list = htable_difference(a, b);
 * 
-* for (i = 0; i < list->used; i++) {
-*     printf("%s\n", (char *)(list->list[i]->key));
+* for (i = 0; i < table->used; i++) {
+*     printf("%s\n", (char *)(htable_entry_at(table, i)->key));
 * }
 *
-* htable_collection_delete(list);
-*
-* @param    struct htable *a
-* @param    struct htable *b
-* @return   struct htable_collection *
+* @param    struct htable *table
+* @param    uint32_t i
+*               - Must be less than table->used
+* @return   struct htable_entry *
+**/
+HT_EXTERN struct HT_EXPORT(htable_entry) *
+HT_EXPORT(htable_entry_at)
+HT_ARGS((
+    struct HT_EXPORT(htable) *table,
+    uint32_t i
+));
+
+/**
+* htable_value()
+*
+* Get pointer to the value of an entry. For tables created with
+* HT_VALUE_WIDTH() this points into the slot, and stays valid until the
+* table is resized or the entry removed. Otherwise it is ent->data, or
+* NULL for sets.
+*
+* @param    struct htable *table
+* @param    struct htable_entry *ent
+* @return   void *
+**/
+HT_EXTERN void *
+HT_EXPORT(htable_value)
+HT_ARGS((
+    struct HT_EXPORT(htable) *table,
+    struct HT_EXPORT(htable_entry) *ent
+));
+
+/**
+* htable_shrink_to_fit()
+*
+* Rebuild hash table into the smallest power-of-two capacity that keeps
+* the load factor at or below HT_MAX_LOAD. Slots left behind by
+* htable_remove() are dropped in the process, the old slot array is
+* released, and table->entries is trimmed to table->used. Stored hashes
+* are reused, so keys are not hashed again.
+* Pointers previously returned by htable_get() are invalidated.
+*
+* @param    struct htable *table
+* @return   0 on error, 1 on success
+**/
+HT_EXTERN int
+HT_EXPORT(htable_shrink_to_fit)
+HT_ARGS((
+    struct HT_EXPORT(htable) *table
+));
+
+/**
+* htable_set_shrink_thresh()
+*
+* Set automatic shrink threshold. When htable_remove() brings the load
+* factor below the threshold, and a smaller power-of-two size would hold
+* the entries, the table is rebuilt as by htable_shrink_to_fit().
+* Removals never compact the table at its current size.
+*
+* @param    struct htable *table
+* @param    uint8_t shrink_thresh
+*               Percentage, use 0 to disable (default). Clamped to
+*               HT_MAX_LOAD / 2: above that, the table could not shrink
+*               without going over HT_MAX_LOAD.
+*
+* @return   void
+**/
+HT_EXTERN void
+HT_EXPORT(htable_set_shrink_thresh)
+HT_ARGS((
+    struct HT_EXPORT(htable) *table,
+    uint8_t shrink_thresh
+));
+
+/**
+* htable_write_begin()
+*
+* Start a write section of a HT_FLAG_SEQLOCK table, making readers retry
+* until the matching htable_write_end(). The table functions do this
+* themselves. Use it around writes through entries returned by
+* htable_find_or_insert() or htable_emplace(). Sections nest. Does
+* nothing for other tables.
+*
+* Lookups (htable_get(), htable_get_copy(), htable_get_iov()) wait for
+* the section to end, so the thread holding it must not make any on the
+* same table: they would never return. That includes callbacks run
+* inside a section, such as htable_remove_if() predicates.
+*
+* @param    struct htable *table
+* @return   void
+**/
+HT_EXTERN void
+HT_EXPORT(htable_write_begin)
+HT_ARGS((
+    struct HT_EXPORT(htable) *table
+));
+
+/**
+* htable_write_end()
+*
+* End a write section. See htable_write_begin().
+*
+* @param    struct htable *table
+* @return   void
+**/
+HT_EXTERN void
+HT_EXPORT(htable_write_end)
+HT_ARGS((
+    struct HT_EXPORT(htable) *table
+));
+
+/**
+* htable_reclaim()
+*
+* Free the slot arrays a HT_FLAG_SEQLOCK table kept when it was resized.
+* Only call this when no reader can be running, for example once reader
+* threads are joined, or when they're known to be between lookups.
+*
+* @param    struct htable *table
+* @return   void
+**/
+HT_EXTERN void
+HT_EXPORT(htable_reclaim)
+HT_ARGS((
+    struct HT_EXPORT(htable) *table
+));
+
+/**
+* Create new htable_collection object.
+*
+* @param    uint32_t size
+* @return   NULL on error
+**/
+HT_EXTERN
+struct HT_EXPORT(htable_collection) *
+HT_EXPORT(htable_collection_new)
+HT_ARGS((
+    uint32_t size
+));
+
+/**
+* Delete htable_collection object created by htable_collection_new
+*
+* @param    struct htable_collection *
+* @return   void
+**/
+HT_EXTERN void
+HT_EXPORT(htable_collection_delete)
+HT_ARGS((
+    struct HT_EXPORT(htable_collection) *collection
+));
+
+/**
+* Resize htable_collection object.
+*
+* @param    struct htable_collection *
+* @param    uint32_t size
+* @return   NULL on error
+**/
+int
+HT_EXPORT(htable_collection_resize)
+HT_ARGS((
+    struct HT_EXPORT(htable_collection) *collection,
+    uint32_t size
+));
+
+/************************************************************************
+* Manipulation functions
+************************************************************************/
+
+/**
+* htable_add()
+*
+* Add item to hash table. 
+*
+* @param    struct htable *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+* @param    void *data
+*               - Ignored for sets (HT_FLAG_SET)
+*               - Pointer to the value bytes for HT_VALUE_WIDTH() tables
+*
+* @return   0 on error, 1 on success
+**/
+HT_EXTERN int
+HT_EXPORT(htable_add)
+HT_ARGS((
+    struct HT_EXPORT(htable) *table,
+    uint32_t key_size,
+    void *key,
+    void *data
+));
+
+/**
+* htable_find_or_insert()
+*
+* Get entry from hash table, inserting key and data if it's not there,
+* with a single hash and probe. An existing entry is left untouched:
+* copyfn and freefn are not called for it.
+*
+* Usage:
+*
+* int inserted;
+* struct htable_entry *ent;
+*
+* ent = htable_find_or_insert(table, sizeof(key), &key, NULL, &inserted);
+* if (ent != NULL) {
+*     (*(uint64_t *)htable_value(table, ent))++;
+* }
+*
+* @param    struct htable *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+* @param    void *data
+*               - Only used if the key is inserted
+* @param    int *inserted
+*               - Set to 1 if key was inserted, 0 if it existed.
+*                 May be NULL.
+*
+* @return   NULL on error (table full or out of memory), pointer to
+*           the existing or new entry on success
+**/
+HT_EXTERN struct HT_EXPORT(htable_entry) *
+HT_EXPORT(htable_find_or_insert)
+HT_ARGS((
+    struct HT_EXPORT(htable) *table,
+    uint32_t key_size,
+    void *key,
+    void *data,
+    int *inserted
+));
+
+/**
+* htable_update_value()
+*
+* Replace the data of an existing entry, with a single hash and probe.
+* Unlike htable_add(), the key is kept as is, and copyfn and freefn are
+* not called; the previous data pointer is handed back instead. For
+* HT_VALUE_WIDTH() tables the value bytes are copied from data, and the
+* old value is overwritten.
+*
+* @param    struct htable *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+* @param    void *data
+* @param    void **old_data
+*               - Receives the previous data pointer. May be NULL.
+*
+* @return   0 if key was not found (or table is a set), 1 on success
+**/
+HT_EXTERN int
+HT_EXPORT(htable_update_value)
+HT_ARGS((
+    struct HT_EXPORT(htable) *table,
+    uint32_t key_size,
+    void *key,
+    void *data,
+    void **old_data
+));
+
+/**
+* htable_emplace()
+*
+* Reserve a slot for key, so its value can be constructed in place
+* instead of being built elsewhere and copied in. Hashes and probes once.
+* copyfn is not called.
+*
+* For a new slot, ent->key points at the key: a table owned copy for
+* HT_FLAG_INLINE_KEYS tables, otherwise key_hash_source itself, which
+* the caller may swap for a pointer to an equal key that outlives the
+* entry. The value starts zeroed: write HT_VALUE_WIDTH() values
+* through htable_value(), or set ent->data.
+*
+* Usage:
+*
+* struct htable_entry *ent;
+*
+* if (htable_emplace(table, strlen(id), id, &ent) == HT_EMPLACE_NEW) {
+*     build_record((struct record *)htable_value(table, ent), id);
+* }
+*
+* @param    struct htable *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key_hash_source
+*               - Key bytes, hashed and compared to find the slot
+* @param    struct htable_entry **slot
+*               - Receives the new or existing entry
+*
+* @return   0 on error (table full or out of memory),
+*           HT_EMPLACE_NEW if a slot was reserved,
+*           HT_EMPLACE_EXISTS if key was already in the table
+**/
+HT_EXTERN int
+HT_EXPORT(htable_emplace)
+HT_ARGS((
+    struct HT_EXPORT(htable) *table,
+    uint32_t key_size,
+    void *key_hash_source,
+    struct HT_EXPORT(htable_entry) **slot
+));
+
+/**
+* htable_add_loop()
+*
+* Unlink htable_add(), which will fail on its first try, htable_add_loop()
+* will try a maximum of "max_loops" times to add an item before giving up.
+* It uses a quadratic resizing algorithm, so its best to keep max_loops
+* relatively small.
+*
+* @param    struct htable *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+* @param    void *data
+* @param    int max_loops
+*
+* @return   0 on failure, otherwise the number of loops it took to
+*           successfully add item.
+**/
+HT_EXTERN int
+HT_EXPORT(htable_add_loop)
+HT_ARGS((
+    struct HT_EXPORT(htable) *table,
+    uint32_t key_size,
+    void *key,
+    void *data,
+    int max_loops
+));
+
+/**
+* htable_remove()
+*
+* Remove item from hash table. If an automatic shrink threshold is set
+* (see htable_set_shrink_thresh()), the table may be rebuilt, which
+* invalidates pointers previously returned by htable_get().
+*
+* @param    struct htable *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+*
+* @return   0 on error, 1 on success
+**/
+HT_EXTERN int
+HT_EXPORT(htable_remove)
+HT_ARGS((
+    struct HT_EXPORT(htable) *table,
+    uint32_t key_size,
+    void *key
+));
+
+/**
+* htable_remove_if()
+*
+* Remove every entry for which predicate returns non-zero, in a single
+* pass over table->entries, without hashing or probing keys again.
+* Entries that are kept stay densely packed, in their previous relative
+* order. freefn is called for all removed entries once the pass is done.
+* The automatic shrink threshold applies as in htable_remove().
+* On a HT_FLAG_SEQLOCK table predicate runs inside a write section, and
+* must not look the table up (see htable_write_begin()).
+*
+* @param    struct htable *table
+* @param    htable_predfn predicate
+* @param    void *ctx
+*               - Passed to predicate unchanged
+*
+* @return   number of entries removed, 0 on error
+**/
+HT_EXTERN uint32_t
+HT_EXPORT(htable_remove_if)
+HT_ARGS((
+    struct HT_EXPORT(htable) *table,
+    HT_EXPORT(htable_predfn) predicate,
+    void *ctx
+));
+
+/**
+* htable_get()
+*
+* Get entry from hash table. On HT_FLAG_SEQLOCK tables the lookup is
+* retried until it didn't overlap a write, but the entry may change as
+* soon as it's returned: use htable_get_copy() to read its value.
+*
+* @param    struct htable *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+*
+* @return   NULL on error, pointer on success
+**/
+HT_EXTERN struct HT_EXPORT(htable_entry) *
+HT_EXPORT(htable_get)
+HT_ARGS((
+    struct HT_EXPORT(htable) *table,
+    uint32_t key_size,
+    void *key
+));
+
+/**
+* htable_get_copy()
+*
+* Look up key, and copy its value out: the data pointer, or the value
+* bytes of HT_VALUE_WIDTH() tables. On HT_FLAG_SEQLOCK tables, the
+* lookup and the copy are one read, retried until it didn't overlap a
+* write, so the value is never torn.
+*
+* Usage:
+*
+* struct point p;
+*
+* if (htable_get_copy(table, sizeof(id), &id, &p)) {
+*     draw(&p);
+* }
+*
+* @param    struct htable *table
+* @param    uint32_t key_size
+*               - sizeof(key) for ints
+*               - strlen(key) for strings
+* @param    void *key
+* @param    void *value
+*               - Receives the value: a void * for plain tables, the
+*                 value width for HT_VALUE_WIDTH() tables. Ignored for
+*                 sets, and may be NULL.
+*
+* @return   0 if not found, 1 if found
+**/
+HT_EXTERN int
+HT_EXPORT(htable_get_copy)
+HT_ARGS((
+    struct HT_EXPORT(htable) *table,
+    uint32_t key_size,
+    void *key,
+    void *value
+));
+
+/**
+* htable_add_iov()
+*
+* Add item to hash table, with a key made of fragments, such as the
+* fields of a composite key, without concatenating them first. The key
+* is hashed as the fragments concatenated, so it matches the same bytes
+* passed to htable_add() or htable_get() as one buffer. Only for
+* HT_FLAG_INLINE_KEYS tables, which gather the fragments into their own
+* copy of the key. copyfn receives that copy as key.
+*
+* Usage:
+*
+* struct htable_iovec key[3];
+*
+* key[0].base = &tenant_id; key[0].len = sizeof(tenant_id);
+* key[1].base = &user_id;   key[1].len = sizeof(user_id);
+* key[2].base = object;     key[2].len = strlen(object);
+* htable_add_iov(table, key, 3, data);
+*
+* @param    struct htable *table
+* @param    struct htable_iovec *iov
+* @param    int iovcnt
+*               - Number of fragments, at least 1
+* @param    void *data
+*
+* @return   0 on error, 1 on success
+**/
+HT_EXTERN int
+HT_EXPORT(htable_add_iov)
+HT_ARGS((
+    struct HT_EXPORT(htable) *table,
+    const struct HT_EXPORT(htable_iovec) *iov,
+    int iovcnt,
+    void *data
+));
+
+/**
+* htable_get_iov()
+*
+* Get entry from hash table, by a key made of fragments (see
+* htable_add_iov()). Fragments are compared against the stored key one
+* by one. Only for tables that compare keys as bytes (HT_FLAG_MEMCMP or
+* HT_FLAG_INLINE_KEYS), NULL otherwise. Safe against a concurrent writer
+* on HT_FLAG_RCU and HT_FLAG_SEQLOCK tables, as htable_get() is.
+*
+* @param    struct htable *table
+* @param    struct htable_iovec *iov
+* @param    int iovcnt
+*               - Number of fragments, at least 1
+*
+* @return   NULL on error, pointer on success
+**/
+HT_EXTERN struct HT_EXPORT(htable_entry) *
+HT_EXPORT(htable_get_iov)
+HT_ARGS((
+    struct HT_EXPORT(htable) *table,
+    const struct HT_EXPORT(htable_iovec) *iov,
+    int iovcnt
+));
+
+/**
+* htable_remove_iov()
+*
+* Remove item from hash table, by a key made of fragments (see
+* htable_add_iov() and htable_get_iov()).
+*
+* @param    struct htable *table
+* @param    struct htable_iovec *iov
+* @param    int iovcnt
+*               - Number of fragments, at least 1
+*
+* @return   0 on error, 1 on success
+**/
+HT_EXTERN int
+HT_EXPORT(htable_remove_iov)
+HT_ARGS((
+    struct HT_EXPORT(htable) *table,
+    const struct HT_EXPORT(htable_iovec) *iov,
+    int iovcnt
+));
+
+/************************************************************************
+* Utility functions
+************************************************************************/
+
+/**
+* htable_scan()
+*
+* Incrementally iterate hash table, one home bucket per call, using
+* reverse binary cursors (as Redis SCAN does). Start with cursor 0 and
+* pass the returned cursor to the next call, until 0 is returned again.
+* fn is called for every entry whose hash maps to the bucket.
+*
+* The table may be modified between calls, including htable_resize() and
+* htable_shrink_to_fit(). Entries present for the whole scan are returned
+* at least once. Entries added or removed during the scan may or may not
+* be returned, and shrinking may return some entries more than once. This
+* holds as long as table->size stays a power of two (htable_new() with a
+* power of two size, then htable_resize() to powers of two, or
+* htable_shrink_to_fit()). For other sizes, buckets are visited in order,
+* and the guarantee only holds without resizes.
+*
+* Usage:
+*
+* uint32_t cursor = 0;
+*
+* do {
+*     cursor = htable_scan(table, cursor, &visit, ctx);
+* } while (cursor != 0);
+*
+* @param    struct htable *table
+* @param    uint32_t cursor
+* @param    htable_scanfn fn
+* @param    void *ctx
+*               - Passed to fn unchanged
+*
+* @return   next cursor, 0 when the scan is complete
+**/
+HT_EXTERN uint32_t
+HT_EXPORT(htable_scan)
+HT_ARGS((
+    struct HT_EXPORT(htable) *table,
+    uint32_t cursor,
+    HT_EXPORT(htable_scanfn) fn,
+    void *ctx
+));
+
+/**
+* htable_foreach()
+*
+* Call fn for every entry, in the order of table->entries. Slots are
+* prefetched HT_PREFETCH_DISTANCE entries ahead, so walking a large table
+* is not bound by a cache miss per entry, as indexing it through
+* htable_entry_at() is.
+*
+* @param    struct htable *table
+* @param    htable_scanfn fn
+* @param    void *ctx
+*               - Passed to fn unchanged
+*
+* @return   void
+**/
+HT_EXTERN void
+HT_EXPORT(htable_foreach)
+HT_ARGS((
+    struct HT_EXPORT(htable) *table,
+    HT_EXPORT(htable_scanfn) fn,
+    void *ctx
+));
+
+/**
+* htable_intersect()
+*
+* Get intersection of two hash tables, by key. Entries in the list
+* are pointers to elements in b, thus free()'ing b and then trying
+* to access elements in the list will likely cause a segfault. The
+* returned list can be freed via the htable_collection_delete()
+* function.
+*
+* Usage:
+*
+* uint32_t i;
+* struct htable_collection *list = htable_difference(a, b);
+* 
+* for (i = 0; i < list->used; i++) {
+*     printf("%s\n", (char *)(list->list[i]->key));
+* }
+*
+* htable_collection_delete(list);
+*
+* @param    struct htable *a
+* @param    struct htable *b
+* @return   struct htable_collection *
 *               NULL on error
 **/
 HT_EXTERN struct HT_EXPORT(htable_collection) *
@@ -407,14 +1325,44 @@ HT_ARGS((
     struct HT_EXPORT(htable) *b
 ));
 
+/**
+* htable_intersect_parallel()
+*
+* Like htable_intersect(), with a's entries split over nthreads threads,
+* the calling one included. Each thread collects its share into a chunk
+* of its own, and the chunks are joined in order, so the list is the
+* same as htable_intersect() returns, whatever the number of threads.
+* Without USE_PTHREAD, and with nthreads of 0 or 1, it runs on the
+* calling thread only. Neither table may change until the call returns.
+*
+* @param    struct htable *a
+* @param    struct htable *b
+* @param    uint32_t nthreads
+* @param    uint32_t flags
+*               - HT_SET_SMALLER: go over whichever table has fewer
+*                 entries, and look its keys up in the other. The list
+*                 holds the same entries of b, in b's order if b is the
+*                 smaller one.
+* @return   struct htable_collection *
+*               NULL on error
+**/
+HT_EXTERN struct HT_EXPORT(htable_collection) *
+HT_EXPORT(htable_intersect_parallel)
+HT_ARGS((
+    struct HT_EXPORT(htable) *a,
+    struct HT_EXPORT(htable) *b,
+    uint32_t nthreads,
+    uint32_t flags
+));
+
 /**
 * htable_difference()
 *
-* Get difference of two hash tables, by key. Entries in the list
-* are pointers to elements in b, thus free()'ing b and then trying
-* to access elements in the list will likely cause a segfault. The
-* returned list can be freed via the htable_collection_delete()
-* function.
+* Get difference of two hash tables, by key: the entries of a whose key
+* is not in b. Entries in the list are pointers to elements in a, thus
+* free()'ing a and then trying to access elements in the list will
+* likely cause a segfault. The returned list can be freed via the
+* htable_collection_delete() function.
 *
 * Usage:
 *
@@ -439,6 +1387,288 @@ HT_ARGS((
     struct HT_EXPORT(htable) *b
 ));
 
+/**
+* htable_difference_parallel()
+*
+* Like htable_difference(), with a's entries split over nthreads threads,
+* the calling one included. The list is the same as htable_difference()
+* returns, whatever the number of threads. See
+* htable_intersect_parallel().
+*
+* @param    struct htable *a
+* @param    struct htable *b
+* @param    uint32_t nthreads
+* @return   struct htable_collection *
+*               NULL on error
+**/
+HT_EXTERN struct HT_EXPORT(htable_collection) *
+HT_EXPORT(htable_difference_parallel)
+HT_ARGS((
+    struct HT_EXPORT(htable) *a,
+    struct HT_EXPORT(htable) *b,
+    uint32_t nthreads
+));
+
+/**
+* htable_union_into()
+*
+* Add the keys of src that dst doesn't have to dst, in src's order, with
+* their data (or value bytes). Entries dst already has are left as they
+* are. Keys and data go through dst's copyfn, as with htable_add(). dst
+* is rebuilt into a larger table whenever it would pass HT_MAX_LOAD,
+* which invalidates pointers previously returned by htable_get().
+*
+* Tables with the same seed share hashes, which are then not computed
+* again. If either table has inline values, both must have the same
+* value width, unless dst is a set. Keys src stores inline can only go
+* to a table that stores them inline too, or copies them with copyfn.
+*
+* @param    struct htable *dst
+* @param    struct htable *src
+* @return   0 on error, 1 on success. On error dst holds the keys added
+*           so far.
+**/
+HT_EXTERN int
+HT_EXPORT(htable_union_into)
+HT_ARGS((
+    struct HT_EXPORT(htable) *dst,
+    struct HT_EXPORT(htable) *src
+));
+
+/**
+* htable_symmetric_difference()
+*
+* Get the entries of a whose key is not in b, followed by the entries
+* of b whose key is not in a, each in their table's order. Entries in
+* the list point into a and b. See htable_difference().
+*
+* @param    struct htable *a
+* @param    struct htable *b
+* @return   struct htable_collection *
+*               NULL on error
+**/
+HT_EXTERN struct HT_EXPORT(htable_collection) *
+HT_EXPORT(htable_symmetric_difference)
+HT_ARGS((
+    struct HT_EXPORT(htable) *a,
+    struct HT_EXPORT(htable) *b
+));
+
+/**
+* htable_is_subset()
+*
+* Check whether every key of a is in b. Stops at the first key that
+* isn't, and returns right away if a has more entries than b.
+*
+* @param    struct htable *a
+* @param    struct htable *b
+* @return   1 if a is a subset of b, 0 if not
+**/
+HT_EXTERN int
+HT_EXPORT(htable_is_subset)
+HT_ARGS((
+    struct HT_EXPORT(htable) *a,
+    struct HT_EXPORT(htable) *b
+));
+
+/**
+* htable_equal()
+*
+* Check whether a and b have the same keys. Data is not compared.
+*
+* @param    struct htable *a
+* @param    struct htable *b
+* @return   1 if equal, 0 if not
+**/
+HT_EXTERN int
+HT_EXPORT(htable_equal)
+HT_ARGS((
+    struct HT_EXPORT(htable) *a,
+    struct HT_EXPORT(htable) *b
+));
+
+/**
+* htable_intersect_count()
+*
+* Count the keys a and b have in common, without building a list. Goes
+* over whichever table has fewer entries.
+*
+* @param    struct htable *a
+* @param    struct htable *b
+* @return   uint32_t
+**/
+HT_EXTERN uint32_t
+HT_EXPORT(htable_intersect_count)
+HT_ARGS((
+    struct HT_EXPORT(htable) *a,
+    struct HT_EXPORT(htable) *b
+));
+
+/**
+* htable_intersect_each()
+*
+* Pass the entries htable_intersect() would list to fn, one at a time,
+* without allocating. fn gets the entries of b, in a's order, and may
+* stop the walk by returning non-zero.
+*
+* Usage:
+*
+* static int
+* print_key(struct htable_entry *ent, void *ctx)
+* {
+*     printf("%s\n", (char *)ent->key);
+*     return 0;
+* }
+*
+* htable_intersect_each(a, b, &print_key, NULL);
+*
+* @param    struct htable *a
+* @param    struct htable *b
+* @param    htable_visitfn fn
+* @param    void *ctx
+*               - Passed to fn unchanged
+*
+* @return   number of entries passed to fn
+**/
+HT_EXTERN uint32_t
+HT_EXPORT(htable_intersect_each)
+HT_ARGS((
+    struct HT_EXPORT(htable) *a,
+    struct HT_EXPORT(htable) *b,
+    HT_EXPORT(htable_visitfn) fn,
+    void *ctx
+));
+
+/**
+* htable_difference_each()
+*
+* Pass the entries htable_difference() would list to fn, one at a time,
+* without allocating. fn gets the entries of a whose key is not in b,
+* and may stop the walk by returning non-zero. See
+* htable_intersect_each().
+*
+* @param    struct htable *a
+* @param    struct htable *b
+* @param    htable_visitfn fn
+* @param    void *ctx
+*               - Passed to fn unchanged
+*
+* @return   number of entries passed to fn
+**/
+HT_EXTERN uint32_t
+HT_EXPORT(htable_difference_each)
+HT_ARGS((
+    struct HT_EXPORT(htable) *a,
+    struct HT_EXPORT(htable) *b,
+    HT_EXPORT(htable_visitfn) fn,
+    void *ctx
+));
+
+/**
+* htable_intersect_next()
+*
+* Get the intersection of a and b a bufferful at a time: write up to
+* max of the entries htable_intersect() would list to list, and move
+* cursor past them. Start with cursor 0, and call until 0 is returned.
+* The cursor is a position in a's entries, so neither table may change
+* until the walk is done, or entries may be skipped or seen twice.
+*
+* Usage:
+*
+* uint32_t i, n, cursor = 0;
+* struct htable_entry *list[256];
+*
+* while ((n = htable_intersect_next(a, b, &cursor, list, 256)) > 0) {
+*     for (i = 0; i < n; i++) {
+*         printf("%s\n", (char *)(list[i]->key));
+*     }
+* }
+*
+* @param    struct htable *a
+* @param    struct htable *b
+* @param    uint32_t *cursor
+* @param    struct htable_entry **list
+* @param    uint32_t max
+*
+* @return   number of entries written to list, 0 when done
+**/
+HT_EXTERN uint32_t
+HT_EXPORT(htable_intersect_next)
+HT_ARGS((
+    struct HT_EXPORT(htable) *a,
+    struct HT_EXPORT(htable) *b,
+    uint32_t *cursor,
+    struct HT_EXPORT(htable_entry) **list,
+    uint32_t max
+));
+
+/**
+* htable_difference_next()
+*
+* Get the difference of a and b a bufferful at a time. See
+* htable_intersect_next() and htable_difference().
+*
+* @param    struct htable *a
+* @param    struct htable *b
+* @param    uint32_t *cursor
+* @param    struct htable_entry **list
+* @param    uint32_t max
+*
+* @return   number of entries written to list, 0 when done
+**/
+HT_EXTERN uint32_t
+HT_EXPORT(htable_difference_next)
+HT_ARGS((
+    struct HT_EXPORT(htable) *a,
+    struct HT_EXPORT(htable) *b,
+    uint32_t *cursor,
+    struct HT_EXPORT(htable_entry) **list,
+    uint32_t max
+));
+
+/**
+* htable_bloom_attach()
+*
+* Put a blocked Bloom filter in front of the table's lookups, so most
+* lookups of absent keys return without probing. htable_get(),
+* htable_get_copy(), htable_get_iov(), and the set operations looking
+* keys up in the table check it first. It is kept up to date by every
+* insert, and rebuilt along with the table by htable_resize() and
+* htable_shrink_to_fit(), sized for HT_MAX_LOAD percent of the new
+* slots. htable_clone() copies it. See struct htable_bloom for its
+* statistics.
+*
+* The filter costs about -1.44 * log2(fp_rate) bits per key: 10 for 1%.
+* Attaching to a table that has one replaces it, resetting statistics.
+* Not for HT_FLAG_RCU and HT_FLAG_SEQLOCK tables, whose readers would
+* race the writer on the filter's bits.
+*
+* @param    struct htable *table
+* @param    double fp_rate
+*               - Target false positive rate, between 0 and 1
+* @return   0 on error, 1 on success
+**/
+HT_EXTERN int
+HT_EXPORT(htable_bloom_attach)
+HT_ARGS((
+    struct HT_EXPORT(htable) *table,
+    double fp_rate
+));
+
+/**
+* htable_bloom_detach()
+*
+* Remove and free the table's Bloom filter, if it has one.
+*
+* @param    struct htable *table
+* @return   void
+**/
+HT_EXTERN void
+HT_EXPORT(htable_bloom_detach)
+HT_ARGS((
+    struct HT_EXPORT(htable) *table
+));
+
 #ifndef __HT_INTERNAL
   #undef HT_EXTERN
   #undef HT_ARGS
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "config.h"
+#include "hashtable.h"
+
+/*
+* Lookups of absent keys, with and without a Bloom filter in front of
+* the table, at a few load factors. Misses walk a whole probe sequence,
+* which gets longer as the table fills up, while the filter answers
+* most of them from one cache line.
+*
+* Usage: bench-bloom [entries]
+*/
+
+static uint32_t nkeys = 1000000;
+
+double elapsed(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Million lookups per second of keys [nkeys, 2 * nkeys) */
+double run(struct htable *table, uint32_t *keys)
+{
+    uint32_t i;
+    struct timespec start, end;
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    for (i = nkeys; i < nkeys * 2; i++) {
+        assert(htable_get(table, sizeof(uint32_t), &keys[i]) == NULL);
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return nkeys / elapsed(&start, &end) / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t i, load, *keys;
+    double plain, filtered;
+    struct htable *table;
+    
+    if (argc > 1) {
+        nkeys = atoi(argv[1]);
+    }
+    
+    keys = malloc(sizeof(uint32_t) * nkeys * 2);
+    assert(keys != NULL);
+    
+    for (i = 0; i < nkeys * 2; i++) {
+        keys[i] = i;
+    }
+    
+    printf("%6s %16s %16s %8s %10s\n", "load", "plain Mops/s", "bloom Mops/s",
+           "speedup", "fp rate");
+    
+    for (load = 50; load <= 90; load += 20) {
+        table = htable_new((uint32_t)((uint64_t)nkeys * 100 / load), 0,
+                           &htable_int32_cmpfn, NULL, NULL);
+        assert(table != NULL);
+        
+        for (i = 0; i < nkeys; i++) {
+            assert(htable_add(table, sizeof(uint32_t), &keys[i], NULL));
+        }
+        
+        plain = run(table, keys);
+        assert(htable_bloom_attach(table, 0.01));
+        filtered = run(table, keys);
+        
+        printf("%5u%% %16.2f %16.2f %7.2fx %10.4f\n", load, plain, filtered,
+               filtered / plain, (double)table->bloom->false_positives / nkeys);
+        
+        htable_delete(table);
+    }
+    
+    free(keys);
+    return 0;
+}
@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "config.h"
+#include "hashtable.h"
+#include "hashtable-cas.h"
+
+/*
+* Deduplication throughput of a single table behind one mutex, against
+* a lock-free table, for 1 to 64 threads. Every thread calls
+* find_or_insert on random keys from a shared key space, so most calls
+* find a key another thread put there. The last column starts the
+* lock-free table small, so it's resized, by all threads together,
+* about a dozen times along the way.
+*
+* Usage: bench-cas [ops per thread]
+*/
+
+#define MAX_THREADS 64
+#define NKEYS (1 << 20)
+
+static uint32_t keys[NKEYS];
+static uint32_t ops = 1000000;
+
+static struct htable *locked;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct htable_cas *cas;
+
+struct worker {
+    uint32_t seed;
+    uint32_t inserted;
+};
+
+uint32_t xorshift(uint32_t *state)
+{
+    uint32_t x = *state;
+    
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    
+    return *state = x;
+}
+
+void *run_locked(void *arg)
+{
+    uint32_t i, r;
+    int inserted;
+    struct worker *w = arg;
+    
+    for (i = 0; i < ops; i++) {
+        r = xorshift(&w->seed);
+        pthread_mutex_lock(&lock);
+        htable_find_or_insert(locked, sizeof(uint32_t), &keys[r % NKEYS], NULL, &inserted);
+        pthread_mutex_unlock(&lock);
+        w->inserted += inserted;
+    }
+    
+    return NULL;
+}
+
+void *run_cas(void *arg)
+{
+    uint32_t i, r;
+    int inserted;
+    struct worker *w = arg;
+    
+    for (i = 0; i < ops; i++) {
+        r = xorshift(&w->seed);
+        htable_cas_find_or_insert(cas, sizeof(uint32_t), &keys[r % NKEYS], NULL, &inserted);
+        w->inserted += inserted;
+    }
+    
+    return NULL;
+}
+
+double run(void *(*fn)(void *), uint32_t nthreads, uint32_t *inserted)
+{
+    uint32_t i;
+    double secs;
+    struct timespec start, end;
+    pthread_t threads[MAX_THREADS];
+    struct worker workers[MAX_THREADS];
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    for (i = 0; i < nthreads; i++) {
+        workers[i].seed = 2463534242U + i * 7919;
+        workers[i].inserted = 0;
+        assert(pthread_create(&threads[i], NULL, fn, &workers[i]) == 0);
+    }
+    
+    *inserted = 0;
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+        *inserted += workers[i].inserted;
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    
+    /* Million operations per second */
+    return (double)ops * nthreads / secs / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t i, nthreads, locked_inserted, cas_inserted, grow_inserted, wasted;
+    double mutex_mops, cas_mops, grow_mops;
+    
+    if (argc > 1) {
+        ops = atoi(argv[1]);
+    }
+    
+    for (i = 0; i < NKEYS; i++) {
+        keys[i] = i;
+    }
+    
+    printf("%8s %14s %14s %8s %10s %14s\n", "threads", "mutex Mops/s", "cas Mops/s",
+           "speedup", "wasted", "grow Mops/s");
+    
+    for (nthreads = 1; nthreads <= MAX_THREADS; nthreads *= 2) {
+        locked = htable_new(NKEYS * 2, 0, &htable_int32_cmpfn, NULL, NULL);
+        cas = htable_cas_new(NKEYS * 2, 0, &htable_int32_cmpfn, NULL, NULL, 0);
+        assert(locked != NULL && cas != NULL);
+        
+        mutex_mops = run(&run_locked, nthreads, &locked_inserted);
+        cas_mops = run(&run_cas, nthreads, &cas_inserted);
+        
+        /* Same seeds, so both saw the same distinct keys */
+        assert(locked_inserted == cas_inserted);
+        assert(locked->used == cas->used);
+        
+        wasted = cas->wasted;
+        htable_cas_delete(cas);
+        
+        cas = htable_cas_new(1024, 0, &htable_int32_cmpfn, NULL, NULL, 0);
+        assert(cas != NULL);
+        
+        grow_mops = run(&run_cas, nthreads, &grow_inserted);
+        assert(grow_inserted == cas_inserted);
+        
+        printf("%8u %14.2f %14.2f %7.2fx %10u %14.2f\n", nthreads, mutex_mops, cas_mops,
+               cas_mops / mutex_mops, wasted, grow_mops);
+        
+        htable_delete(locked);
+        htable_cas_delete(cas);
+    }
+    
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "config.h"
+#include "hashtable.h"
+
+/*
+* Time to double a table, with htable_resize() and with
+* htable_resize_parallel() on 1 to 16 threads. Each run resizes a fresh
+* clone, and every result is checked against the serial one.
+*
+* Usage: bench-resize [entries]
+*/
+
+#define MAX_THREADS 16
+
+static uint32_t nkeys = 4000000;
+
+double elapsed(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Seconds to double a clone of table, on nthreads threads (0: serial) */
+double run(struct htable *table, struct htable *serial, uint32_t nthreads)
+{
+    double secs;
+    struct timespec start, end;
+    struct htable *copy;
+    
+    copy = htable_clone(table);
+    assert(copy != NULL);
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    if (nthreads == 0) {
+        assert(htable_resize(copy, 0, table->size * 2));
+    } else {
+        assert(htable_resize_parallel(copy, 0, table->size * 2, nthreads));
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    secs = elapsed(&start, &end);
+    
+    if (serial != NULL) {
+        assert(memcmp(copy->entries, serial->entries, sizeof(uint32_t) * copy->used) == 0);
+    }
+    
+    htable_delete(copy);
+    return secs;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t i, nthreads, *keys;
+    double serial_secs, secs;
+    struct htable *table, *serial;
+    
+    if (argc > 1) {
+        nkeys = atoi(argv[1]);
+    }
+    
+    keys = malloc(sizeof(uint32_t) * nkeys);
+    assert(keys != NULL);
+    
+    table = htable_new(nkeys + nkeys / 4, 0, &htable_int32_cmpfn, NULL, NULL);
+    assert(table != NULL);
+    
+    for (i = 0; i < nkeys; i++) {
+        keys[i] = i;
+        assert(htable_add(table, sizeof(uint32_t), &keys[i], NULL));
+    }
+    
+    serial = htable_clone(table);
+    assert(serial != NULL);
+    assert(htable_resize(serial, 0, table->size * 2));
+    
+    serial_secs = run(table, NULL, 0);
+    
+    printf("%8s %10s %8s\n", "threads", "ms", "speedup");
+    printf("%8s %10.2f %8s\n", "serial", serial_secs * 1e3, "-");
+    
+    for (nthreads = 1; nthreads <= MAX_THREADS; nthreads *= 2) {
+        secs = run(table, serial, nthreads);
+        printf("%8u %10.2f %7.2fx\n", nthreads, secs * 1e3, serial_secs / secs);
+    }
+    
+    htable_delete(serial);
+    htable_delete(table);
+    free(keys);
+    
+    return 0;
+}
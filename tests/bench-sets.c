@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "config.h"
+#include "hashtable.h"
+
+/*
+* Time of htable_intersect() and htable_difference() against their
+* parallel versions on 1 to 16 threads, for a table of "entries" keys
+* and one a quarter of its size sharing half of its keys. The last
+* column intersects going over the smaller table.
+*
+* Usage: bench-sets [entries]
+*/
+
+#define MAX_THREADS 16
+
+static uint32_t nkeys = 4000000;
+
+double elapsed(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Milliseconds for one set operation; nthreads 0 is the serial one */
+double run(struct htable *a, struct htable *b, uint32_t nthreads, int op, uint32_t *used)
+{
+    struct timespec start, end;
+    struct htable_collection *list;
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    if (op == 0) {
+        list = nthreads ? htable_intersect_parallel(a, b, nthreads, 0) : htable_intersect(a, b);
+    } else if (op == 1) {
+        list = nthreads ? htable_difference_parallel(a, b, nthreads) : htable_difference(a, b);
+    } else {
+        list = htable_intersect_parallel(a, b, nthreads, HT_SET_SMALLER);
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    
+    assert(list != NULL);
+    *used = list->used;
+    htable_collection_delete(list);
+    
+    return elapsed(&start, &end) * 1e3;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t i, nthreads, *keys, used, expect[3];
+    double ms[3];
+    struct htable *a, *b;
+    
+    if (argc > 1) {
+        nkeys = atoi(argv[1]);
+    }
+    
+    keys = malloc(sizeof(uint32_t) * (nkeys + nkeys / 8));
+    assert(keys != NULL);
+    
+    a = htable_new(nkeys * 2, 0, &htable_int32_cmpfn, NULL, NULL);
+    b = htable_new(nkeys / 2, 0, &htable_int32_cmpfn, NULL, NULL);
+    assert(a != NULL && b != NULL);
+    
+    for (i = 0; i < nkeys + nkeys / 8; i++) {
+        keys[i] = i;
+        
+        if (i < nkeys) {
+            assert(htable_add(a, sizeof(uint32_t), &keys[i], NULL));
+        }
+        
+        if (i >= nkeys - nkeys / 8) {
+            assert(htable_add(b, sizeof(uint32_t), &keys[i], NULL));
+        }
+    }
+    
+    printf("%8s %14s %14s %14s\n", "threads", "intersect ms", "difference ms", "smaller ms");
+    
+    ms[0] = run(a, b, 0, 0, &expect[0]);
+    ms[1] = run(a, b, 0, 1, &expect[1]);
+    ms[2] = run(a, b, 1, 2, &expect[2]);
+    assert(expect[0] == expect[2]);
+    printf("%8s %14.2f %14.2f %14.2f\n", "serial", ms[0], ms[1], ms[2]);
+    
+    for (nthreads = 1; nthreads <= MAX_THREADS; nthreads *= 2) {
+        for (i = 0; i < 3; i++) {
+            ms[i] = run(a, b, nthreads, i, &used);
+            assert(used == expect[i]);
+        }
+        
+        printf("%8u %14.2f %14.2f %14.2f\n", nthreads, ms[0], ms[1], ms[2]);
+    }
+    
+    htable_delete(a);
+    htable_delete(b);
+    free(keys);
+    
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "config.h"
+#include "hashtable.h"
+#include "hashtable-sharded.h"
+
+/*
+* Throughput of a single table behind one mutex, against a sharded
+* table, for 1 to 64 threads. Each thread runs a 90% get, 10% add mix
+* over a shared key space.
+*
+* Usage: bench-sharded [ops per thread] [shards]
+*/
+
+#define MAX_THREADS 64
+#define NKEYS (1 << 20)
+
+static uint32_t keys[NKEYS];
+static uint32_t ops = 1000000;
+
+static struct htable *locked;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct htable_sharded *sharded;
+
+struct worker {
+    uint32_t seed;
+    uint32_t hits;
+};
+
+uint32_t xorshift(uint32_t *state)
+{
+    uint32_t x = *state;
+    
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    
+    return *state = x;
+}
+
+void *run_locked(void *arg)
+{
+    uint32_t i, r;
+    struct worker *w = arg;
+    
+    for (i = 0; i < ops; i++) {
+        r = xorshift(&w->seed);
+        pthread_mutex_lock(&lock);
+        
+        if (r % 10 == 0) {
+            htable_add_loop(locked, sizeof(uint32_t), &keys[r % NKEYS], NULL, 16);
+        } else if (htable_get(locked, sizeof(uint32_t), &keys[r % NKEYS]) != NULL) {
+            w->hits++;
+        }
+        
+        pthread_mutex_unlock(&lock);
+    }
+    
+    return NULL;
+}
+
+void *run_sharded(void *arg)
+{
+    uint32_t i, r;
+    struct worker *w = arg;
+    
+    for (i = 0; i < ops; i++) {
+        r = xorshift(&w->seed);
+        
+        if (r % 10 == 0) {
+            htable_sharded_add(sharded, sizeof(uint32_t), &keys[r % NKEYS], NULL);
+        } else if (htable_sharded_get(sharded, sizeof(uint32_t), &keys[r % NKEYS], NULL)) {
+            w->hits++;
+        }
+    }
+    
+    return NULL;
+}
+
+double run(void *(*fn)(void *), uint32_t nthreads)
+{
+    uint32_t i;
+    double secs;
+    struct timespec start, end;
+    pthread_t threads[MAX_THREADS];
+    struct worker workers[MAX_THREADS];
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    for (i = 0; i < nthreads; i++) {
+        workers[i].seed = 2463534242U + i * 7919;
+        workers[i].hits = 0;
+        assert(pthread_create(&threads[i], NULL, fn, &workers[i]) == 0);
+    }
+    
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    
+    /* Million operations per second */
+    return (double)ops * nthreads / secs / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t i, nthreads, nshards = 64;
+    double mutex_mops, sharded_mops;
+    
+    if (argc > 1) {
+        ops = atoi(argv[1]);
+    }
+    
+    if (argc > 2) {
+        nshards = atoi(argv[2]);
+    }
+    
+    for (i = 0; i < NKEYS; i++) {
+        keys[i] = i;
+    }
+    
+    printf("%8s %14s %14s %8s\n", "threads", "mutex Mops/s", "sharded Mops/s", "speedup");
+    
+    for (nthreads = 1; nthreads <= MAX_THREADS; nthreads *= 2) {
+        locked = htable_new(NKEYS * 2, 0, &htable_int32_cmpfn, NULL, NULL);
+        sharded = htable_sharded_new(nshards, NKEYS * 2, 0, &htable_int32_cmpfn, NULL, NULL, 0);
+        assert(locked != NULL && sharded != NULL);
+        
+        /* Half the key space present up front */
+        for (i = 0; i < NKEYS; i += 2) {
+            htable_add(locked, sizeof(uint32_t), &keys[i], NULL);
+            htable_sharded_add(sharded, sizeof(uint32_t), &keys[i], NULL);
+        }
+        
+        mutex_mops = run(&run_locked, nthreads);
+        sharded_mops = run(&run_sharded, nthreads);
+        
+        printf("%8u %14.2f %14.2f %7.2fx\n", nthreads, mutex_mops, sharded_mops,
+               sharded_mops / mutex_mops);
+        
+        htable_delete(locked);
+        htable_sharded_delete(sharded);
+    }
+    
+    return 0;
+}
@@ -39,7 +39,7 @@ void test_memory_ref()
     for (i = 0; i < len; i++) {
         res = htable_add(table, strlen(string_data[i]), string_data[i], NULL);
         assert(res == 1);
-        assert((char *)table->entries[i]->key == string_data[i]);
+        assert((char *)htable_entry_at(table, i)->key == string_data[i]);
     }
     
     htable_delete(table);
@@ -57,7 +57,7 @@ void test_memory_copy()
     for (i = 0; i < len; i++) {
         res = htable_add(table, strlen(string_data[i]), string_data[i], NULL);
         assert(res == 1);
-        assert(strcmp((char *)table->entries[i]->key, string_data[i]) == 0);
+        assert(strcmp((char *)htable_entry_at(table, i)->key, string_data[i]) == 0);
     }
     
     htable_delete(table);
@@ -40,15 +40,39 @@ int main(int argc, char **argv)
     for (i = 0; i < len; i++) {
         res = htable_add(table, strlen(string_data[i]), string_data[i], NULL);
         assert(res == 1);
-        assert(strcmp((char *)table->entries[i]->key, string_data[i]) == 0);
+        assert(strcmp((char *)htable_entry_at(table, i)->key, string_data[i]) == 0);
     }
     
     clone = htable_clone(table);
     assert(clone != NULL);
     
     for (i = 0; i < clone->used; i++) {
-        assert(clone->entries[i]->key != table->entries[i]->key);
-        assert(strcmp((char *)clone->entries[i]->key, (char *)table->entries[i]->key) == 0);
+        assert(htable_entry_at(clone, i)->key != htable_entry_at(table, i)->key);
+        assert(strcmp((char *)htable_entry_at(clone, i)->key, (char *)htable_entry_at(table, i)->key) == 0);
+    }
+    
+    htable_delete(clone);
+    
+    /* Cloned to a new size, without the tombstones, in the same order */
+    for (i = 0; i < len; i += 3) {
+        res = htable_remove(table, strlen(string_data[i]), string_data[i]);
+        assert(res == 1);
+    }
+    
+    assert(htable_clone_ex(table, 16) == NULL);
+    
+    clone = htable_clone_ex(table, 32);
+    assert(clone != NULL);
+    assert(clone->size == 32 && clone->used == table->used);
+    assert(clone->deleted == 0);
+    
+    for (i = 0; i < clone->used; i++) {
+        assert(htable_entry_at(clone, i)->key != htable_entry_at(table, i)->key);
+        assert(strcmp((char *)htable_entry_at(clone, i)->key, (char *)htable_entry_at(table, i)->key) == 0);
+    }
+    
+    for (i = 0; i < len; i++) {
+        assert((htable_get(clone, strlen(string_data[i]), string_data[i]) != NULL) == (i % 3 != 0));
     }
     
     htable_delete(clone);
@@ -39,19 +39,19 @@ int main(int argc, char **argv)
     for (i = 0; i < 4; i++) {
         res = htable_add(table, strlen(string_data[i]), string_data[i], NULL);
         assert(res == 1);
-        assert(strcmp(table->entries[i]->key, string_data[i]) == 0);
+        assert(strcmp(htable_entry_at(table, i)->key, string_data[i]) == 0);
     }
     
     assert(htable_resize(table, 0, 1024) == 1);
     for (i = 4; i < len; i++) {
         res = htable_add(table, strlen(string_data[i]), string_data[i], NULL);
         assert(res == 1);
-        assert(strcmp(table->entries[i]->key, string_data[i]) == 0);
+        assert(strcmp(htable_entry_at(table, i)->key, string_data[i]) == 0);
     }
     
     assert(htable_resize(table, 0, 512) == 1);
     for (i = 0; i < len; i++) {
-        assert(strcmp(table->entries[i]->key, string_data[i]) == 0);
+        assert(strcmp(htable_entry_at(table, i)->key, string_data[i]) == 0);
     }
     
     htable_delete(table);
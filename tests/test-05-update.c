@@ -44,26 +44,26 @@ int main(int argc, char **argv)
         data = strlen(string_data[i]);
         res = htable_add(table, strlen(string_data[i]), string_data[i], &data);
         assert(res == 1);
-        assert(strcmp(table->entries[i]->key, string_data[i]) == 0);
+        assert(strcmp(htable_entry_at(table, i)->key, string_data[i]) == 0);
     }
     
     for (i = 0; i < len; i++) {
         data = strlen(string_data[i]);
-        assert(strcmp(table->entries[i]->key, string_data[i]) == 0);
-        assert(*(int *)table->entries[i]->data == strlen(string_data[i]));
+        assert(strcmp(htable_entry_at(table, i)->key, string_data[i]) == 0);
+        assert(*(int *)htable_entry_at(table, i)->data == strlen(string_data[i]));
     }
     
     for (i = 0; i < len; i++) {
         data = strlen(string_data[i]) * 2;
         res = htable_add(table, strlen(string_data[i]), string_data[i], &data);
         assert(res == 1);
-        assert(strcmp(table->entries[i]->key, string_data[i]) == 0);
+        assert(strcmp(htable_entry_at(table, i)->key, string_data[i]) == 0);
     }
     
     for (i = 0; i < len; i++) {
         data = strlen(string_data[i]);
-        assert(strcmp(table->entries[i]->key, string_data[i]) == 0);
-        assert(*(int *)table->entries[i]->data == strlen(string_data[i]) * 2);
+        assert(strcmp(htable_entry_at(table, i)->key, string_data[i]) == 0);
+        assert(*(int *)htable_entry_at(table, i)->data == strlen(string_data[i]) * 2);
     }
     
     htable_delete(table);
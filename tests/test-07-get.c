@@ -40,7 +40,7 @@ int main(int argc, char **argv)
     for (i = 0; i < len; i++) {
         res = htable_add(table, strlen(string_data[i]), string_data[i], NULL);
         assert(res == 1);
-        assert(strcmp(table->entries[i]->key, string_data[i]) == 0);
+        assert(strcmp(htable_entry_at(table, i)->key, string_data[i]) == 0);
     }
     
     for (i = 0; i < len; i++) {
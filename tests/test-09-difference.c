@@ -53,14 +53,14 @@ int main(int argc, char **argv)
     for (i = 0; i < len; i++) {
         res = htable_add(table, strlen(string_data[i]), string_data[i], NULL);
         assert(res == 1);
-        assert(strcmp(table->entries[i]->key, string_data[i]) == 0);
+        assert(strcmp(htable_entry_at(table, i)->key, string_data[i]) == 0);
     }
     
     len = sizeof(string_data2)/sizeof(string_data2[0]);
     for (i = 0; i < len; i++) {
         res = htable_add(table2, strlen(string_data2[i]), string_data2[i], NULL);
         assert(res == 1);
-        assert(strcmp(table2->entries[i]->key, string_data2[i]) == 0);
+        assert(strcmp(htable_entry_at(table2, i)->key, string_data2[i]) == 0);
     }
     
     collection = htable_difference(table, table2);
@@ -36,7 +36,7 @@ int main(int argc, char **argv)
     for (i = 0; i < len; i++) {
         res = htable_add(table, 4, &data[i], NULL);
         assert(res == 1);
-        assert(*(int*)table->entries[i]->key == data[i]);
+        assert(*(int*)htable_entry_at(table, i)->key == data[i]);
     }
     
     htable_delete(table);
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "config.h"
+#include "hashtable.h"
+
+char *string_data[] = {
+        "foo", "bar", "baz", "biz", "zap", "meow",
+        "camel", "consise", "zebra", "zephyr",
+        "bellpepper", "paprika", "meatball", "bmx",
+        "tomatoe", "avacado", "trex", "cereal",
+        "cheesesteak", "rump", "last-stand", "wild",
+        "turkey", "bourbon", "laughter", "white",
+        "scotch", "rye"
+};
+
+void string_copyfn(struct htable_entry *dst, void *key, void *data)
+{
+    dst->key = strdup((char *)key);
+}
+
+void string_freefn(struct htable_entry *ent)
+{
+    free(ent->key);
+}
+
+void test_shrink_to_fit()
+{
+    int i, len, res;
+    struct htable *table;
+    
+    table = htable_new(4096, 0, &htable_cstring_cmpfn, &string_copyfn, &string_freefn);
+    assert(table != NULL);
+    
+    len = sizeof(string_data)/sizeof(string_data[0]);
+    for (i = 0; i < len; i++) {
+        res = htable_add(table, strlen(string_data[i]), string_data[i], NULL);
+        assert(res == 1);
+    }
+    
+    /* Remove all but the first 4 entries */
+    for (i = 4; i < len; i++) {
+        res = htable_remove(table, strlen(string_data[i]), string_data[i]);
+        assert(res == 1);
+    }
+    
+    assert(table->size == 4096);
+    assert(htable_shrink_to_fit(table) == 1);
+    assert(table->size == 8);
+    assert(table->used == 4);
+    assert(table->deleted == 0);
+    
+    for (i = 0; i < 4; i++) {
+        assert(strcmp(htable_entry_at(table, i)->key, string_data[i]) == 0);
+        assert(htable_get(table, strlen(string_data[i]), string_data[i]) != NULL);
+    }
+    
+    for (i = 4; i < len; i++) {
+        assert(htable_get(table, strlen(string_data[i]), string_data[i]) == NULL);
+    }
+    
+    htable_delete(table);
+}
+
+void test_shrink_thresh()
+{
+    int i, len, res;
+    struct htable *table;
+    
+    table = htable_new(1024, 0, &htable_cstring_cmpfn, NULL, NULL);
+    assert(table != NULL);
+    
+    len = sizeof(string_data)/sizeof(string_data[0]);
+    for (i = 0; i < len; i++) {
+        res = htable_add(table, strlen(string_data[i]), string_data[i], NULL);
+        assert(res == 1);
+    }
+    
+    /* Load is below 10% already, but shrinking only happens on remove */
+    htable_set_shrink_thresh(table, 10);
+    assert(table->size == 1024);
+    
+    res = htable_remove(table, strlen(string_data[0]), string_data[0]);
+    assert(res == 1);
+    assert(table->size == 64);
+    
+    for (i = 1; i < len; i++) {
+        assert(htable_get(table, strlen(string_data[i]), string_data[i]) != NULL);
+        res = htable_remove(table, strlen(string_data[i]), string_data[i]);
+        assert(res == 1);
+    }
+    
+    assert(table->used == 0);
+    assert(table->size == HT_MIN_SIZE);
+    
+    htable_delete(table);
+}
+
+void test_shrink_band()
+{
+    uint32_t i, size, deleted, shrinks = 0;
+    uint32_t *keys;
+    struct htable *table;
+    
+    keys = malloc(sizeof(uint32_t) * 40000);
+    assert(keys != NULL);
+    
+    table = htable_new(65536, 0, &htable_int32_cmpfn, NULL, NULL);
+    assert(table != NULL);
+    
+    for (i = 0; i < 40000; i++) {
+        keys[i] = i;
+        assert(htable_add(table, sizeof(uint32_t), &keys[i], NULL));
+    }
+    
+    /* Too high to ever shrink under, so it is clamped */
+    htable_set_shrink_thresh(table, 60);
+    assert(table->shrink_thresh == HT_MAX_LOAD / 2);
+    
+    /* Removals below the threshold leave tombstones, until the table can
+       halve; only then is it rebuilt */
+    for (i = 0; i < 39990; i++) {
+        size = table->size;
+        deleted = table->deleted;
+        
+        assert(htable_remove(table, sizeof(uint32_t), &keys[i]));
+        
+        if (table->size == size) {
+            assert(table->deleted == deleted + 1);
+        } else {
+            assert(table->size < size);
+            assert(table->deleted == 0);
+            assert((uint64_t)table->used * 100 <= (uint64_t)table->size * HT_MAX_LOAD);
+            shrinks++;
+        }
+    }
+    
+    /* One rebuild per halving, 65536 down to 16 */
+    assert(shrinks == 12);
+    assert(table->size == 16);
+    
+    for (i = 39990; i < 40000; i++) {
+        assert(htable_get(table, sizeof(uint32_t), &keys[i]) != NULL);
+    }
+    
+    htable_delete(table);
+    free(keys);
+}
+
+void test_tombstones()
+{
+    int i, len, res;
+    struct htable *table;
+    
+    /* Small table, so probe chains run through removed slots */
+    table = htable_new(32, 0, &htable_cstring_cmpfn, NULL, NULL);
+    assert(table != NULL);
+    
+    len = sizeof(string_data)/sizeof(string_data[0]);
+    for (i = 0; i < len; i++) {
+        res = htable_add(table, strlen(string_data[i]), string_data[i], NULL);
+        assert(res == 1);
+    }
+    
+    for (i = 0; i < len; i += 2) {
+        res = htable_remove(table, strlen(string_data[i]), string_data[i]);
+        assert(res == 1);
+    }
+    
+    for (i = 1; i < len; i += 2) {
+        assert(htable_get(table, strlen(string_data[i]), string_data[i]) != NULL);
+    }
+    
+    /* Compaction at the same size drops tombstones */
+    assert(htable_shrink_to_fit(table) == 1);
+    assert(table->deleted == 0);
+    
+    for (i = 1; i < len; i += 2) {
+        assert(htable_get(table, strlen(string_data[i]), string_data[i]) != NULL);
+    }
+    
+    htable_delete(table);
+}
+
+int main(int argc, char **argv)
+{
+    test_shrink_to_fit();
+    test_shrink_thresh();
+    test_shrink_band();
+    test_tombstones();
+    
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "config.h"
+#include "hashtable.h"
+
+int main(int argc, char **argv)
+{
+    uint32_t i, res;
+    uint32_t keys[1000];
+    struct htable *table;
+    struct htable_entry *ent;
+    
+    /* Slot holds two pointers and two 32-bit fields, nothing more */
+    assert(sizeof(struct htable_entry) == 2 * sizeof(void *) + 2 * sizeof(uint32_t));
+    
+    table = htable_new(4096, 0, &htable_int32_cmpfn, NULL, NULL);
+    assert(table != NULL);
+    
+    /* Dense arrays start small and grow with the number of entries */
+    assert(table->entries_size < table->size);
+    
+    for (i = 0; i < 1000; i++) {
+        keys[i] = i * 7;
+        res = htable_add(table, sizeof(keys[i]), &keys[i], NULL);
+        assert(res == 1);
+        assert(table->entries_size >= table->used);
+    }
+    
+    for (i = 0; i < table->used; i++) {
+        ent = htable_entry_at(table, i);
+        assert(ent->entry == i);
+        assert(*(uint32_t *)ent->key == keys[i]);
+    }
+    
+    /* Remove every other key, swap-with-last keeps indices consistent */
+    for (i = 0; i < 1000; i += 2) {
+        res = htable_remove(table, sizeof(keys[i]), &keys[i]);
+        assert(res == 1);
+    }
+    
+    for (i = 0; i < table->used; i++) {
+        ent = htable_entry_at(table, i);
+        assert(ent->entry == i);
+        assert(htable_get(table, sizeof(uint32_t), ent->key) == ent);
+    }
+    
+    assert(htable_shrink_to_fit(table) == 1);
+    assert(table->used == 500);
+    assert(table->entries_size == 500);
+    
+    for (i = 1; i < 1000; i += 2) {
+        ent = htable_get(table, sizeof(keys[i]), &keys[i]);
+        assert(ent != NULL);
+        assert(htable_entry_at(table, ent->entry) == ent);
+    }
+    
+    htable_delete(table);
+    
+    return 0;
+}
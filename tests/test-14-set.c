@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "config.h"
+#include "hashtable.h"
+
+char *string_data[] = {
+        "foo", "bar", "baz", "biz", "zap", "meow",
+        "camel", "consise", "zebra", "zephyr",
+        "bellpepper", "paprika", "meatball", "bmx",
+        "tomatoe", "avacado", "trex", "cereal",
+        "cheesesteak", "rump", "last-stand", "wild",
+        "turkey", "bourbon", "laughter", "white",
+        "scotch", "rye"
+};
+
+char *string_data2[] = {
+        "foo", "bar", "baz", "biz", "zap", "meow",
+        "camel", "consise", "zebra", "zephyr"
+};
+
+void string_copyfn(struct htable_entry *dst, void *key, void *data)
+{
+    assert(data == NULL);
+    dst->key = strdup((char *)key);
+}
+
+void string_freefn(struct htable_entry *ent)
+{
+    free(ent->key);
+}
+
+int main(int argc, char **argv)
+{
+    int i, len, len2, res;
+    struct htable *set;
+    struct htable *set2;
+    struct htable *clone;
+    struct htable_collection *collection;
+    
+    set = htable_set_new(512, 0, &htable_cstring_cmpfn, &string_copyfn, &string_freefn);
+    assert(set != NULL);
+    assert(set->slot_size < sizeof(struct htable_entry));
+    
+    set2 = htable_set_new(16, 0, &htable_cstring_cmpfn, NULL, NULL);
+    assert(set2 != NULL);
+    
+    len = sizeof(string_data)/sizeof(string_data[0]);
+    for (i = 0; i < len; i++) {
+        res = htable_add(set, strlen(string_data[i]), string_data[i], NULL);
+        assert(res == 1);
+        assert(strcmp(htable_entry_at(set, i)->key, string_data[i]) == 0);
+    }
+    
+    /* Adding again replaces, and does not grow the set */
+    res = htable_add(set, strlen(string_data[0]), string_data[0], NULL);
+    assert(res == 1);
+    assert(set->used == len);
+    
+    len2 = sizeof(string_data2)/sizeof(string_data2[0]);
+    for (i = 0; i < len2; i++) {
+        res = htable_add_loop(set2, strlen(string_data2[i]), string_data2[i], NULL, 4);
+        assert(res > 0);
+    }
+    
+    for (i = 0; i < len2; i++) {
+        assert(htable_get(set2, strlen(string_data2[i]), string_data2[i]) != NULL);
+    }
+    
+    collection = htable_intersect(set, set2);
+    assert(collection != NULL);
+    assert(collection->used == len2);
+    
+    for (i = 0; i < collection->used; i++) {
+        assert(strcmp(string_data[i], collection->list[i]->key) == 0);
+    }
+    
+    htable_collection_delete(collection);
+    
+    clone = htable_clone(set);
+    assert(clone != NULL);
+    assert(clone->slot_size == set->slot_size);
+    
+    for (i = 0; i < len; i++) {
+        assert(htable_get(clone, strlen(string_data[i]), string_data[i]) != NULL);
+        res = htable_remove(clone, strlen(string_data[i]), string_data[i]);
+        assert(res == 1);
+    }
+    
+    assert(clone->used == 0);
+    
+    htable_delete(clone);
+    htable_delete(set);
+    htable_delete(set2);
+    
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "config.h"
+#include "hashtable.h"
+
+char *string_data[] = {
+        "foo", "bar", "baz", "biz", "zap", "meow",
+        "camel", "consise", "zebra", "zephyr",
+        "bellpepper", "paprika", "meatball", "bmx",
+        "tomatoe", "avacado", "trex", "cereal",
+        "cheesesteak", "rump", "last-stand", "wild",
+        "turkey", "bourbon", "laughter", "white",
+        "scotch", "rye",
+        "a-key-that-is-far-too-long-to-live-in-the-slot",
+        "another-key-that-spills-to-the-heap"
+};
+
+int is_inline(struct htable *table, struct htable_entry *ent)
+{
+    return (char *)ent->key > (char *)ent &&
+           (char *)ent->key < (char *)ent + table->slot_size;
+}
+
+void check_table(struct htable *table, int len)
+{
+    int i;
+    struct htable_entry *ent;
+    char buf[64];
+    
+    for (i = 0; i < len; i++) {
+        /* Lookup with a copy, so a pointer comparison can't succeed */
+        strcpy(buf, string_data[i]);
+        ent = htable_get(table, strlen(buf), buf);
+        assert(ent != NULL);
+        assert(ent->key != string_data[i]);
+        assert(strcmp(ent->key, string_data[i]) == 0);
+        assert(*(int *)ent->data == i);
+        assert(is_inline(table, ent) == (strlen(string_data[i]) < HT_INLINE_KEY_SIZE));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int i, len, res;
+    int values[64];
+    struct htable *table;
+    struct htable *clone;
+    
+    table = htable_new_ex(16, 0, NULL, NULL, NULL, HT_FLAG_INLINE_KEYS);
+    assert(table != NULL);
+    assert(table->slot_size >= sizeof(struct htable_entry) + HT_INLINE_KEY_SIZE);
+    
+    len = sizeof(string_data)/sizeof(string_data[0]);
+    for (i = 0; i < len; i++) {
+        values[i] = i;
+        res = htable_add_loop(table, strlen(string_data[i]), string_data[i], &values[i], 4);
+        assert(res > 0);
+    }
+    
+    /* Table was resized along the way, inline keys moved with slots */
+    assert(table->size > 16);
+    check_table(table, len);
+    
+    clone = htable_clone(table);
+    assert(clone != NULL);
+    check_table(clone, len);
+    htable_delete(clone);
+    
+    /* Inline keys move along with their slots */
+    clone = htable_clone_ex(table, table->size * 2);
+    assert(clone != NULL);
+    check_table(clone, len);
+    
+    for (i = 0; i < len; i += 2) {
+        res = htable_remove(table, strlen(string_data[i]), string_data[i]);
+        assert(res == 1);
+        assert(htable_get(table, strlen(string_data[i]), string_data[i]) == NULL);
+    }
+    
+    assert(htable_shrink_to_fit(table) == 1);
+    for (i = 1; i < len; i += 2) {
+        assert(htable_get(table, strlen(string_data[i]), string_data[i]) != NULL);
+    }
+    
+    /* Clone is unaffected */
+    check_table(clone, len);
+    
+    htable_delete(clone);
+    htable_delete(table);
+    
+    return 0;
+}
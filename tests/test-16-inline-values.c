@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "config.h"
+#include "hashtable.h"
+
+struct point {
+    double x;
+    double y;
+    int32_t z;
+};
+
+void test_counters()
+{
+    uint32_t i, res;
+    uint32_t keys[512];
+    uint64_t count;
+    struct htable *table;
+    struct htable *clone;
+    struct htable_entry *ent;
+    
+    table = htable_new_ex(64, 0, &htable_int32_cmpfn, NULL, NULL, HT_VALUE_WIDTH(8));
+    assert(table != NULL);
+    
+    /* An 8-byte value fits where the data pointer was */
+    assert(table->slot_size == sizeof(struct htable_entry));
+    
+    for (i = 0; i < 512; i++) {
+        keys[i] = i * 3;
+        count = i;
+        res = htable_add_loop(table, sizeof(keys[i]), &keys[i], &count, 8);
+        assert(res > 0);
+    }
+    
+    /* Bump counters in place */
+    for (i = 0; i < 512; i++) {
+        ent = htable_get(table, sizeof(keys[i]), &keys[i]);
+        assert(ent != NULL);
+        assert(htable_value(table, ent) == (void *)&ent->data);
+        *(uint64_t *)htable_value(table, ent) += 1000;
+    }
+    
+    clone = htable_clone(table);
+    assert(clone != NULL);
+    
+    for (i = 0; i < 512; i++) {
+        ent = htable_get(clone, sizeof(keys[i]), &keys[i]);
+        assert(ent != NULL);
+        memcpy(&count, htable_value(clone, ent), sizeof(count));
+        assert(count == i + 1000);
+    }
+    
+    /* NULL data zero fills */
+    res = htable_add(clone, sizeof(keys[0]), &keys[0], NULL);
+    assert(res == 1);
+    ent = htable_get(clone, sizeof(keys[0]), &keys[0]);
+    assert(*(uint64_t *)htable_value(clone, ent) == 0);
+    
+    htable_delete(clone);
+    htable_delete(table);
+}
+
+void test_structs()
+{
+    int i, res;
+    char key[32];
+    struct point p;
+    struct htable *table;
+    struct htable_entry *ent;
+    
+    table = htable_new_ex(
+                16,
+                0,
+                NULL,
+                NULL,
+                NULL,
+                HT_FLAG_INLINE_KEYS | HT_VALUE_WIDTH(sizeof(struct point)));
+    
+    assert(table != NULL);
+    assert(table->slot_size >= sizeof(void *) + 8 + sizeof(struct point) + HT_INLINE_KEY_SIZE);
+    
+    for (i = 0; i < 100; i++) {
+        sprintf(key, "point-%d", i);
+        p.x = i;
+        p.y = -i;
+        p.z = i * 2;
+        res = htable_add_loop(table, strlen(key), key, &p, 8);
+        assert(res > 0);
+    }
+    
+    for (i = 0; i < 100; i++) {
+        sprintf(key, "point-%d", i);
+        ent = htable_get(table, strlen(key), key);
+        assert(ent != NULL);
+        assert(strcmp(ent->key, key) == 0);
+        memcpy(&p, htable_value(table, ent), sizeof(p));
+        assert(p.x == i && p.y == -i && p.z == i * 2);
+    }
+    
+    htable_delete(table);
+}
+
+int main(int argc, char **argv)
+{
+    /* Sets have no value to inline */
+    assert(htable_new_ex(16, 0, &htable_int32_cmpfn, NULL, NULL,
+                         HT_FLAG_SET | HT_VALUE_WIDTH(8)) == NULL);
+    
+    test_counters();
+    test_structs();
+    
+    return 0;
+}
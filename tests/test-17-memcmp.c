@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "config.h"
+#include "hashtable.h"
+
+/* Binary keys, with embedded NUL bytes and no terminator */
+unsigned char binary_data[][6] = {
+    {0, 0, 0, 0, 0, 1},
+    {0, 0, 0, 0, 0, 2},
+    {0, 1, 0, 0, 0, 0},
+    {1, 0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0, 0}
+};
+
+void test_binary()
+{
+    int i, len, res;
+    struct htable *table;
+    struct htable_entry *ent;
+    
+    table = htable_new_ex(64, 0, NULL, NULL, NULL, HT_FLAG_MEMCMP);
+    assert(table != NULL);
+    
+    len = sizeof(binary_data)/sizeof(binary_data[0]);
+    for (i = 0; i < len; i++) {
+        res = htable_add(table, sizeof(binary_data[i]), binary_data[i], &binary_data[i]);
+        assert(res == 1);
+    }
+    
+    assert(table->used == len);
+    
+    for (i = 0; i < len; i++) {
+        ent = htable_get(table, sizeof(binary_data[i]), binary_data[i]);
+        assert(ent != NULL);
+        assert(ent->data == &binary_data[i]);
+    }
+    
+    /* Same bytes, shorter key is a different key */
+    assert(htable_get(table, 5, binary_data[0]) == NULL);
+    
+    htable_delete(table);
+}
+
+void test_urls()
+{
+    int i, res;
+    char url[128];
+    struct htable *table;
+    struct htable_entry *ent;
+    char *keys[200];
+    
+    table = htable_new_ex(512, 0, NULL, NULL, NULL, HT_FLAG_MEMCMP);
+    assert(table != NULL);
+    
+    /* Same length, long shared prefix */
+    for (i = 0; i < 200; i++) {
+        sprintf(url, "https://example.com/some/fairly/long/path/to/item/%03d", i);
+        keys[i] = strdup(url);
+        res = htable_add(table, strlen(keys[i]), keys[i], NULL);
+        assert(res == 1);
+    }
+    
+    for (i = 0; i < 200; i++) {
+        sprintf(url, "https://example.com/some/fairly/long/path/to/item/%03d", i);
+        ent = htable_get(table, strlen(url), url);
+        assert(ent != NULL);
+        assert(ent->key == keys[i]);
+    }
+    
+    sprintf(url, "https://example.com/some/fairly/long/path/to/item/%03d", 200);
+    assert(htable_get(table, strlen(url), url) == NULL);
+    
+    /* Differs at the front only */
+    sprintf(url, "http5://example.com/some/fairly/long/path/to/item/%03d", 7);
+    assert(htable_get(table, strlen(url), url) == NULL);
+    
+    htable_delete(table);
+    
+    for (i = 0; i < 200; i++) {
+        free(keys[i]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    /* cmpfn is required without HT_FLAG_MEMCMP */
+    assert(htable_new_ex(16, 0, NULL, NULL, NULL, 0) == NULL);
+    
+    test_binary();
+    test_urls();
+    
+    return 0;
+}
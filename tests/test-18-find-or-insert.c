@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "config.h"
+#include "hashtable.h"
+
+char *string_data[] = {
+        "foo", "bar", "baz", "foo", "zap", "bar",
+        "foo", "camel", "zebra", "foo"
+};
+
+int copies = 0;
+
+void string_copyfn(struct htable_entry *dst, void *key, void *data)
+{
+    copies++;
+    dst->key = strdup((char *)key);
+    dst->data = data;
+}
+
+void string_freefn(struct htable_entry *ent)
+{
+    free(ent->key);
+}
+
+void test_counting()
+{
+    int i, len, inserted;
+    uint64_t one = 1;
+    struct htable *table;
+    struct htable_entry *ent;
+    
+    table = htable_new_ex(64, 0, NULL, NULL, NULL, HT_FLAG_INLINE_KEYS | HT_VALUE_WIDTH(8));
+    assert(table != NULL);
+    
+    len = sizeof(string_data)/sizeof(string_data[0]);
+    for (i = 0; i < len; i++) {
+        ent = htable_find_or_insert(table, strlen(string_data[i]), string_data[i], &one, &inserted);
+        assert(ent != NULL);
+        
+        if (!inserted) {
+            (*(uint64_t *)htable_value(table, ent))++;
+        }
+    }
+    
+    assert(table->used == 6);
+    
+    ent = htable_get(table, 3, "foo");
+    assert(*(uint64_t *)htable_value(table, ent) == 4);
+    ent = htable_get(table, 3, "bar");
+    assert(*(uint64_t *)htable_value(table, ent) == 2);
+    ent = htable_get(table, 5, "zebra");
+    assert(*(uint64_t *)htable_value(table, ent) == 1);
+    
+    one = 42;
+    assert(htable_update_value(table, 3, "foo", &one, NULL) == 1);
+    ent = htable_get(table, 3, "foo");
+    assert(*(uint64_t *)htable_value(table, ent) == 42);
+    
+    htable_delete(table);
+}
+
+void test_update_value()
+{
+    int i, len, inserted;
+    int a = 1, b = 2;
+    void *old;
+    char *key;
+    struct htable *table;
+    struct htable_entry *ent;
+    
+    table = htable_new(64, 0, &htable_cstring_cmpfn, &string_copyfn, &string_freefn);
+    assert(table != NULL);
+    
+    len = sizeof(string_data)/sizeof(string_data[0]);
+    for (i = 0; i < len; i++) {
+        ent = htable_find_or_insert(table, strlen(string_data[i]), string_data[i], &a, &inserted);
+        assert(ent != NULL);
+        assert(ent->data == &a);
+    }
+    
+    /* copyfn only ran for new keys */
+    assert(copies == 6);
+    
+    ent = htable_get(table, 3, "foo");
+    key = ent->key;
+    
+    assert(htable_update_value(table, 3, "foo", &b, &old) == 1);
+    assert(old == &a);
+    
+    /* Key was not copied again */
+    assert(copies == 6);
+    ent = htable_get(table, 3, "foo");
+    assert(ent->key == key);
+    assert(ent->data == &b);
+    
+    assert(htable_update_value(table, 4, "nope", &b, &old) == 0);
+    assert(old == NULL);
+    
+    htable_delete(table);
+}
+
+int main(int argc, char **argv)
+{
+    test_counting();
+    test_update_value();
+    
+    return 0;
+}
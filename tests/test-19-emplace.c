@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "config.h"
+#include "hashtable.h"
+
+struct record {
+    uint32_t id;
+    uint32_t hits;
+    char name[16];
+};
+
+void string_freefn(struct htable_entry *ent)
+{
+    free(ent->key);
+    free(ent->data);
+}
+
+void test_inline()
+{
+    int i, res;
+    char key[32];
+    struct htable *table;
+    struct htable_entry *ent;
+    struct record *rec;
+    
+    table = htable_new_ex(
+                256,
+                0,
+                NULL,
+                NULL,
+                NULL,
+                HT_FLAG_INLINE_KEYS | HT_VALUE_WIDTH(sizeof(struct record)));
+    
+    assert(table != NULL);
+    
+    for (i = 0; i < 100; i++) {
+        sprintf(key, "id-%d", i);
+        res = htable_emplace(table, strlen(key), key, &ent);
+        assert(res == HT_EMPLACE_NEW);
+        
+        /* Construct the value in the slot */
+        rec = htable_value(table, ent);
+        assert(rec->id == 0 && rec->hits == 0);
+        rec->id = i;
+        strcpy(rec->name, key);
+    }
+    
+    for (i = 0; i < 100; i++) {
+        sprintf(key, "id-%d", i);
+        res = htable_emplace(table, strlen(key), key, &ent);
+        assert(res == HT_EMPLACE_EXISTS);
+        
+        rec = htable_value(table, ent);
+        assert(rec->id == i);
+        assert(strcmp(rec->name, key) == 0);
+        assert(strcmp(ent->key, key) == 0);
+        assert(ent->key != key);
+        rec->hits++;
+    }
+    
+    assert(table->used == 100);
+    
+    htable_delete(table);
+}
+
+void test_pointers()
+{
+    int i, res;
+    char key[32];
+    struct htable *table;
+    struct htable_entry *ent;
+    
+    table = htable_new(256, 0, &htable_cstring_cmpfn, NULL, &string_freefn);
+    assert(table != NULL);
+    
+    for (i = 0; i < 50; i++) {
+        sprintf(key, "key-%d", i);
+        res = htable_emplace(table, strlen(key), key, &ent);
+        assert(res == HT_EMPLACE_NEW);
+        assert(ent->key == key);
+        assert(ent->data == NULL);
+        
+        /* Swap the borrowed key for an owned one */
+        ent->key = strdup(key);
+        ent->data = malloc(sizeof(int));
+        *(int *)ent->data = i;
+    }
+    
+    for (i = 0; i < 50; i++) {
+        sprintf(key, "key-%d", i);
+        ent = htable_get(table, strlen(key), key);
+        assert(ent != NULL);
+        assert(*(int *)ent->data == i);
+    }
+    
+    htable_delete(table);
+}
+
+int main(int argc, char **argv)
+{
+    test_inline();
+    test_pointers();
+    
+    return 0;
+}
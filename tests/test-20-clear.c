@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "config.h"
+#include "hashtable.h"
+
+static int freed = 0;
+
+void counting_freefn(struct htable_entry *ent)
+{
+    freed++;
+}
+
+void test_clear()
+{
+    int i, round, res;
+    uint32_t keys[100];
+    struct htable *table;
+    
+    table = htable_new(4096, 0, &htable_int32_cmpfn, NULL, &counting_freefn);
+    assert(table != NULL);
+    
+    /* Recycle the same table across rounds */
+    for (round = 0; round < 4; round++) {
+        for (i = 0; i < 100; i++) {
+            keys[i] = round * 1000 + i;
+            res = htable_add(table, sizeof(keys[i]), &keys[i], NULL);
+            assert(res == 1);
+        }
+        
+        assert(table->used == 100);
+        
+        freed = 0;
+        htable_clear(table);
+        assert(freed == 100);
+        assert(table->used == 0);
+        assert(table->deleted == 0);
+        assert(table->size == 4096);
+        
+        for (i = 0; i < 100; i++) {
+            assert(htable_get(table, sizeof(keys[i]), &keys[i]) == NULL);
+        }
+    }
+    
+    /* All slots must be back to empty */
+    for (i = 0; i < (int)table->size; i++) {
+        struct htable_entry *ent;
+        
+        ent = (struct htable_entry *)((char *)table->table + i * table->slot_size);
+        assert(ent->key == NULL);
+        assert(ent->entry == 0);
+    }
+    
+    htable_delete(table);
+}
+
+void test_clear_tombstones()
+{
+    int i, res;
+    char key[32];
+    struct htable *table;
+    
+    table = htable_new_ex(64, 0, NULL, NULL, NULL, HT_FLAG_INLINE_KEYS);
+    assert(table != NULL);
+    
+    for (i = 0; i < 40; i++) {
+        sprintf(key, "%s-%d", (i % 2) ? "a-rather-long-spilled-key" : "k", i);
+        res = htable_add(table, strlen(key), key, NULL);
+        assert(res == 1);
+    }
+    
+    for (i = 0; i < 40; i += 3) {
+        sprintf(key, "%s-%d", (i % 2) ? "a-rather-long-spilled-key" : "k", i);
+        res = htable_remove(table, strlen(key), key);
+        assert(res == 1);
+    }
+    
+    assert(table->deleted > 0);
+    
+    htable_clear(table);
+    assert(table->used == 0);
+    assert(table->deleted == 0);
+    assert(table->size == 64);
+    
+    for (i = 0; i < 40; i++) {
+        sprintf(key, "%s-%d", (i % 2) ? "a-rather-long-spilled-key" : "k", i);
+        assert(htable_get(table, strlen(key), key) == NULL);
+        res = htable_add(table, strlen(key), key, NULL);
+        assert(res == 1);
+    }
+    
+    assert(table->used == 40);
+    assert(table->deleted == 0);
+    
+    htable_delete(table);
+}
+
+int main(int argc, char **argv)
+{
+    test_clear();
+    test_clear_tombstones();
+    
+    return 0;
+}
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "config.h"
+#include "hashtable.h"
+
+static int freed = 0;
+
+void counting_freefn(struct htable_entry *ent)
+{
+    freed++;
+}
+
+int is_multiple(struct htable_entry *ent, void *ctx)
+{
+    return (*(uint32_t *)ent->key % *(uint32_t *)ctx) == 0;
+}
+
+int never(struct htable_entry *ent, void *ctx)
+{
+    return 0;
+}
+
+void test_remove_if()
+{
+    int i, res;
+    uint32_t keys[1000], n, prev;
+    struct htable *table;
+    struct htable_entry *ent;
+    
+    table = htable_new(2048, 0, &htable_int32_cmpfn, NULL, &counting_freefn);
+    assert(table != NULL);
+    
+    for (i = 0; i < 1000; i++) {
+        keys[i] = i;
+        res = htable_add(table, sizeof(keys[i]), &keys[i], NULL);
+        assert(res == 1);
+    }
+    
+    assert(htable_remove_if(table, &never, NULL) == 0);
+    assert(table->used == 1000);
+    
+    n = 3;
+    freed = 0;
+    assert(htable_remove_if(table, &is_multiple, &n) == 334);
+    assert(freed == 334);
+    assert(table->used == 666);
+    assert(table->deleted == 334);
+    
+    /* Kept entries stay dense, in their previous order */
+    prev = 0;
+    for (i = 0; i < (int)table->used; i++) {
+        ent = htable_entry_at(table, i);
+        assert(ent->entry == (uint32_t)i);
+        assert(*(uint32_t *)ent->key % 3 != 0);
+        assert(i == 0 || *(uint32_t *)ent->key > prev);
+        prev = *(uint32_t *)ent->key;
+    }
+    
+    for (i = 0; i < 1000; i++) {
+        ent = htable_get(table, sizeof(keys[i]), &keys[i]);
+        assert((ent == NULL) == (i % 3 == 0));
+    }
+    
+    /* Probe chains survive the tombstones, and removal keeps working */
+    res = htable_remove(table, sizeof(keys[1]), &keys[1]);
+    assert(res == 1);
+    
+    n = 2;
+    assert(htable_remove_if(table, &is_multiple, &n) == 333);
+    assert(table->used == 332);
+    
+    for (i = 0; i < 1000; i++) {
+        ent = htable_get(table, sizeof(keys[i]), &keys[i]);
+        assert((ent != NULL) == (i != 1 && i % 2 != 0 && i % 3 != 0));
+    }
+    
+    htable_delete(table);
+}
+
+void test_remove_if_shrink()
+{
+    int i, res;
+    uint32_t keys[200], n;
+    struct htable *table;
+    
+    table = htable_new(1024, 0, &htable_int32_cmpfn, NULL, NULL);
+    assert(table != NULL);
+    
+    for (i = 0; i < 200; i++) {
+        keys[i] = i;
+        res = htable_add(table, sizeof(keys[i]), &keys[i], NULL);
+        assert(res == 1);
+    }
+    
+    htable_set_shrink_thresh(table, 10);
+    
+    n = 10;
+    assert(htable_remove_if(table, &is_multiple, &n) == 20);
+    assert(table->size == 1024);
+    
+    n = 1;
+    assert(htable_remove_if(table, &is_multiple, &n) == 180);
+    assert(table->used == 0);
+    assert(table->size == HT_MIN_SIZE);
+    assert(table->deleted == 0);
+    
+    htable_delete(table);
+}
+
+void test_remove_if_rcu()
+{
+    int i, res;
+    uint32_t keys[200], n;
+    struct htable *table;
+    struct htable_entry *slots;
+    
+    table = htable_new_ex(1024, 0, &htable_int32_cmpfn, NULL, NULL, HT_FLAG_RCU);
+    assert(table != NULL);
+    
+    for (i = 0; i < 200; i++) {
+        keys[i] = i;
+        res = htable_add(table, sizeof(keys[i]), &keys[i], NULL);
+        assert(res == 1);
+    }
+    
+    htable_set_shrink_thresh(table, 10);
+    slots = table->table;
+    
+    /* Readers may still be on the arrays, so they are never rebuilt */
+    n = 1;
+    assert(htable_remove_if(table, &is_multiple, &n) == 200);
+    assert(table->used == 0);
+    assert(table->size == 1024);
+    assert(table->deleted == 200);
+    assert(table->table == slots);
+    
+    htable_delete(table);
+}
+
+int main(int argc, char **argv)
+{
+    test_remove_if();
+    test_remove_if_shrink();
+    test_remove_if_rcu();
+    
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "config.h"
+#include "hashtable.h"
+
+#define NKEYS 500
+
+static uint32_t keys[NKEYS];
+static int seen[NKEYS];
+
+void count_seen(struct htable_entry *ent, void *ctx)
+{
+    seen[*(uint32_t *)ent->key]++;
+}
+
+void test_scan(uint32_t size)
+{
+    int i, res;
+    uint32_t cursor;
+    struct htable *table;
+    
+    table = htable_new(size, 0, &htable_int32_cmpfn, NULL, NULL);
+    assert(table != NULL);
+    
+    for (i = 0; i < NKEYS; i++) {
+        keys[i] = i;
+        res = htable_add(table, sizeof(keys[i]), &keys[i], NULL);
+        assert(res == 1);
+    }
+    
+    memset(seen, 0, sizeof(seen));
+    cursor = 0;
+    
+    do {
+        cursor = htable_scan(table, cursor, &count_seen, NULL);
+    } while (cursor != 0);
+    
+    /* No mutation, so each entry exactly once */
+    for (i = 0; i < NKEYS; i++) {
+        assert(seen[i] == 1);
+    }
+    
+    htable_delete(table);
+}
+
+void test_scan_resize()
+{
+    int i, calls, res;
+    uint32_t cursor;
+    struct htable *table;
+    
+    table = htable_new(1024, 0, &htable_int32_cmpfn, NULL, NULL);
+    assert(table != NULL);
+    
+    for (i = 0; i < NKEYS; i++) {
+        keys[i] = i;
+        res = htable_add(table, sizeof(keys[i]), &keys[i], NULL);
+        assert(res == 1);
+    }
+    
+    memset(seen, 0, sizeof(seen));
+    cursor = 0;
+    calls = 0;
+    
+    do {
+        cursor = htable_scan(table, cursor, &count_seen, NULL);
+        calls++;
+        
+        /* Grow, shrink, and remove keys between calls */
+        if (calls == 100) {
+            assert(htable_resize(table, 0, 4096) == 1);
+        } else if (calls == 1000) {
+            assert(htable_shrink_to_fit(table) == 1);
+            assert(table->size == 1024);
+        } else if (calls == 1200) {
+            for (i = NKEYS - 50; i < NKEYS; i++) {
+                res = htable_remove(table, sizeof(keys[i]), &keys[i]);
+                assert(res == 1);
+            }
+            
+            assert(htable_shrink_to_fit(table) == 1);
+            assert(table->size == 1024);
+        }
+    } while (cursor != 0);
+    
+    assert(calls > 1200);
+    
+    for (i = 0; i < NKEYS - 50; i++) {
+        assert(seen[i] >= 1);
+    }
+    
+    htable_delete(table);
+}
+
+int main(int argc, char **argv)
+{
+    test_scan(1024);
+    test_scan(1000);
+    test_scan_resize();
+    
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "config.h"
+#include "hashtable.h"
+
+#define NKEYS 5000
+
+struct visit {
+    struct htable *table;
+    uint32_t i;
+    uint64_t sum;
+};
+
+void check_order(struct htable_entry *ent, void *ctx)
+{
+    struct visit *v = ctx;
+    
+    assert(ent == htable_entry_at(v->table, v->i));
+    v->sum += *(uint32_t *)ent->key;
+    v->i++;
+}
+
+void test_foreach()
+{
+    int i, res;
+    uint32_t *keys;
+    struct htable *table;
+    struct visit v;
+    
+    keys = malloc(sizeof(*keys) * NKEYS);
+    assert(keys != NULL);
+    
+    table = htable_new(8192, 0, &htable_int32_cmpfn, NULL, NULL);
+    assert(table != NULL);
+    
+    v.table = table;
+    v.i = 0;
+    v.sum = 0;
+    htable_foreach(table, &check_order, &v);
+    assert(v.i == 0);
+    
+    for (i = 0; i < NKEYS; i++) {
+        keys[i] = i;
+        res = htable_add(table, sizeof(keys[i]), &keys[i], NULL);
+        assert(res == 1);
+    }
+    
+    /* Swap-with-last reorders the entries array */
+    for (i = 0; i < NKEYS; i += 7) {
+        res = htable_remove(table, sizeof(keys[i]), &keys[i]);
+        assert(res == 1);
+    }
+    
+    htable_foreach(table, &check_order, &v);
+    assert(v.i == table->used);
+    
+    for (i = 0; i < NKEYS; i += 7) {
+        v.sum += keys[i];
+    }
+    
+    assert(v.sum == (uint64_t)NKEYS * (NKEYS - 1) / 2);
+    
+    htable_delete(table);
+    free(keys);
+}
+
+int main(int argc, char **argv)
+{
+    test_foreach();
+    
+    return 0;
+}
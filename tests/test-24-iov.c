@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "config.h"
+#include "hashtable.h"
+#include "MurmurHash3.h"
+
+void test_streaming_hash()
+{
+    int len, split1, split2;
+    uint32_t hash, streamed;
+    char buf[64];
+    MurmurHash3_x86_32_state state;
+    
+    for (len = 0; len < (int)sizeof(buf); len++) {
+        buf[len] = (char)(len * 31 + 7);
+    }
+    
+    /* Every length, split at every pair of points */
+    for (len = 0; len <= (int)sizeof(buf); len++) {
+        MurmurHash3_x86_32(buf, len, 1234, &hash);
+        
+        for (split1 = 0; split1 <= len; split1++) {
+            for (split2 = split1; split2 <= len; split2++) {
+                MurmurHash3_x86_32_init(&state, 1234);
+                MurmurHash3_x86_32_update(&state, buf, split1);
+                MurmurHash3_x86_32_update(&state, buf + split1, split2 - split1);
+                MurmurHash3_x86_32_update(&state, buf + split2, len - split2);
+                MurmurHash3_x86_32_final(&state, &streamed);
+                assert(streamed == hash);
+            }
+        }
+    }
+}
+
+void test_inline_keys()
+{
+    int i, res;
+    uint32_t tenant, user;
+    char object[64], flat[128];
+    struct htable *table;
+    struct htable_entry *ent;
+    struct htable_iovec key[3];
+    
+    table = htable_new_ex(256, 0, NULL, NULL, NULL, HT_FLAG_INLINE_KEYS);
+    assert(table != NULL);
+    
+    key[0].base = &tenant;
+    key[0].len = sizeof(tenant);
+    key[1].base = &user;
+    key[1].len = sizeof(user);
+    key[2].base = object;
+    
+    /* Short keys land inline, longer ones spill */
+    for (i = 0; i < 100; i++) {
+        tenant = i % 3;
+        user = i;
+        sprintf(object, (i % 2) ? "obj-%d" : "a-much-longer-object-name-%d", i);
+        key[2].len = strlen(object);
+        
+        res = htable_add_iov(table, key, 3, (void *)(size_t)i);
+        assert(res == 1);
+    }
+    
+    assert(table->used == 100);
+    
+    for (i = 0; i < 100; i++) {
+        tenant = i % 3;
+        user = i;
+        sprintf(object, (i % 2) ? "obj-%d" : "a-much-longer-object-name-%d", i);
+        key[2].len = strlen(object);
+        
+        ent = htable_get_iov(table, key, 3);
+        assert(ent != NULL);
+        assert(ent->data == (void *)(size_t)i);
+        
+        /* Same bytes as one buffer find the same entry */
+        memcpy(flat, &tenant, sizeof(tenant));
+        memcpy(flat + sizeof(tenant), &user, sizeof(user));
+        memcpy(flat + sizeof(tenant) + sizeof(user), object, key[2].len);
+        assert(htable_get(table, sizeof(tenant) + sizeof(user) + key[2].len, flat) == ent);
+        
+        /* A different last fragment misses */
+        object[0] = '#';
+        assert(htable_get_iov(table, key, 3) == NULL);
+    }
+    
+    /* Replace */
+    tenant = 0;
+    user = 0;
+    sprintf(object, "a-much-longer-object-name-%d", 0);
+    key[2].len = strlen(object);
+    res = htable_add_iov(table, key, 3, (void *)(size_t)1000);
+    assert(res == 1);
+    assert(table->used == 100);
+    assert(htable_get_iov(table, key, 3)->data == (void *)(size_t)1000);
+    
+    for (i = 0; i < 100; i += 2) {
+        tenant = i % 3;
+        user = i;
+        sprintf(object, "a-much-longer-object-name-%d", i);
+        key[2].len = strlen(object);
+        
+        res = htable_remove_iov(table, key, 3);
+        assert(res == 1);
+        assert(htable_get_iov(table, key, 3) == NULL);
+    }
+    
+    assert(table->used == 50);
+    
+    htable_delete(table);
+}
+
+void test_memcmp_keys()
+{
+    int res;
+    char *flat = "tenant-1/user-2/object-3";
+    struct htable *table;
+    struct htable_iovec key[3];
+    
+    table = htable_new_ex(64, 0, NULL, NULL, NULL, HT_FLAG_MEMCMP);
+    assert(table != NULL);
+    
+    res = htable_add(table, strlen(flat), flat, NULL);
+    assert(res == 1);
+    
+    key[0].base = "tenant-1/";
+    key[0].len = 9;
+    key[1].base = "user-2/";
+    key[1].len = 7;
+    key[2].base = "object-3";
+    key[2].len = 8;
+    assert(htable_get_iov(table, key, 3) != NULL);
+    
+    /* Pointer keys can't be gathered by the table */
+    assert(htable_add_iov(table, key, 3, NULL) == 0);
+    
+    assert(htable_remove_iov(table, key, 3) == 1);
+    assert(table->used == 0);
+    
+    htable_delete(table);
+}
+
+void test_rcu_keys()
+{
+    char *flat = "tenant-1/user-2/object-3";
+    struct htable *table;
+    struct htable_iovec key[2];
+    
+    table = htable_new_ex(64, 0, NULL, NULL, NULL, HT_FLAG_RCU | HT_FLAG_MEMCMP);
+    assert(table != NULL);
+    assert(htable_add(table, strlen(flat), flat, NULL) == 1);
+    
+    key[0].base = "tenant-1/user-2/";
+    key[0].len = 16;
+    key[1].base = "object-3";
+    key[1].len = 8;
+    assert(htable_get_iov(table, key, 2) != NULL);
+    
+    key[1].base = "object-4";
+    assert(htable_get_iov(table, key, 2) == NULL);
+    
+    /* The tombstone stays, and the reader probe steps over it */
+    assert(htable_remove(table, strlen(flat), flat) == 1);
+    key[1].base = "object-3";
+    assert(htable_get_iov(table, key, 2) == NULL);
+    
+    htable_delete(table);
+}
+
+int main(int argc, char **argv)
+{
+    test_streaming_hash();
+    test_inline_keys();
+    test_memcmp_keys();
+    test_rcu_keys();
+    
+    return 0;
+}
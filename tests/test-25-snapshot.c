@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "config.h"
+#include "hashtable.h"
+
+#define NKEYS 5000
+
+static uint32_t keys[NKEYS * 2];
+
+struct totals {
+    uint32_t count;
+    uint64_t sum;
+};
+
+void sum_values(struct htable_entry *ent, void *ctx)
+{
+    struct totals *t = ctx;
+    
+    t->count++;
+    t->sum += *(uint64_t *)&ent->data;
+}
+
+void dummy_freefn(struct htable_entry *ent)
+{
+}
+
+struct htable *new_counters()
+{
+    int i, res;
+    uint64_t value;
+    struct htable *table;
+    
+    table = htable_new_ex(
+                16384,
+                0,
+                &htable_int32_cmpfn,
+                NULL,
+                NULL,
+                HT_FLAG_COW | HT_VALUE_WIDTH(sizeof(uint64_t)));
+    
+    assert(table != NULL);
+    assert(table->table == NULL && table->pages != NULL);
+    
+    for (i = 0; i < NKEYS; i++) {
+        value = i;
+        res = htable_add(table, sizeof(keys[i]), &keys[i], &value);
+        assert(res == 1);
+    }
+    
+    return table;
+}
+
+void check_snapshot(struct htable_snapshot *snap)
+{
+    int i;
+    struct totals t;
+    struct htable_entry *ent;
+    
+    for (i = 0; i < NKEYS; i++) {
+        ent = htable_snapshot_get(snap, sizeof(keys[i]), &keys[i]);
+        assert(ent != NULL);
+        assert(*(uint64_t *)&ent->data == (uint64_t)i);
+    }
+    
+    for (i = NKEYS; i < NKEYS * 2; i++) {
+        assert(htable_snapshot_get(snap, sizeof(keys[i]), &keys[i]) == NULL);
+    }
+    
+    t.count = 0;
+    t.sum = 0;
+    htable_snapshot_foreach(snap, &sum_values, &t);
+    assert(t.count == NKEYS);
+    assert(t.sum == (uint64_t)NKEYS * (NKEYS - 1) / 2);
+}
+
+void test_snapshot()
+{
+    int i, res, shared;
+    uint64_t value;
+    struct htable *table;
+    struct htable_snapshot *snap;
+    
+    table = new_counters();
+    snap = htable_snapshot(table);
+    assert(snap != NULL);
+    
+    /* Every page is shared until written to */
+    for (i = 0; i < 16384 / HT_PAGE_SLOTS; i++) {
+        assert(snap->view.pages[i] == table->pages[i]);
+    }
+    
+    /* A single update copies a single page */
+    value = 1000000;
+    res = htable_update_value(table, sizeof(keys[0]), &keys[0], &value, NULL);
+    assert(res == 1);
+    
+    shared = 0;
+    for (i = 0; i < 16384 / HT_PAGE_SLOTS; i++) {
+        shared += (snap->view.pages[i] == table->pages[i]);
+    }
+    
+    assert(shared == 16384 / HT_PAGE_SLOTS - 1);
+    assert(*(uint64_t *)htable_value(table, htable_get(table, sizeof(keys[0]), &keys[0])) == 1000000);
+    check_snapshot(snap);
+    
+    /* Adds, removes and a resize don't show through either */
+    for (i = NKEYS; i < NKEYS * 2; i++) {
+        value = i;
+        res = htable_add(table, sizeof(keys[i]), &keys[i], &value);
+        assert(res == 1);
+    }
+    
+    for (i = 1; i < NKEYS; i += 2) {
+        res = htable_remove(table, sizeof(keys[i]), &keys[i]);
+        assert(res == 1);
+    }
+    
+    check_snapshot(snap);
+    
+    assert(htable_resize(table, 0, 32768) == 1);
+    check_snapshot(snap);
+    
+    for (i = 0; i < NKEYS * 2; i++) {
+        assert((htable_get(table, sizeof(keys[i]), &keys[i]) != NULL) ==
+               (i >= NKEYS || i % 2 == 0));
+    }
+    
+    /* The table can be cleared and deleted before the snapshot */
+    assert(htable_clear(table) == 1);
+    assert(table->used == 0);
+    check_snapshot(snap);
+    
+    htable_delete(table);
+    check_snapshot(snap);
+    htable_snapshot_delete(snap);
+}
+
+int is_odd(struct htable_entry *ent, void *ctx)
+{
+    return *(uint32_t *)ent->key % 2;
+}
+
+void test_multiple_snapshots()
+{
+    int i, res;
+    uint64_t value;
+    struct htable *table, *clone;
+    struct htable_snapshot *a, *b;
+    struct totals t;
+    
+    table = new_counters();
+    a = htable_snapshot(table);
+    b = htable_snapshot(table);
+    assert(a != NULL && b != NULL);
+    
+    assert(htable_remove_if(table, &is_odd, NULL) == NKEYS / 2);
+    check_snapshot(a);
+    
+    /* Dropping one snapshot leaves the other intact */
+    htable_snapshot_delete(a);
+    check_snapshot(b);
+    
+    /* Clones are deep copies, and see the table as it is */
+    clone = htable_clone(table);
+    assert(clone != NULL);
+    assert(clone->used == NKEYS / 2);
+    
+    for (i = 0; i < NKEYS; i++) {
+        assert((htable_get(clone, sizeof(keys[i]), &keys[i]) != NULL) == (i % 2 == 0));
+    }
+    
+    a = htable_snapshot(clone);
+    assert(a != NULL);
+    
+    value = 7;
+    res = htable_add(clone, sizeof(keys[0]), &keys[0], &value);
+    assert(res == 1);
+    
+    t.count = 0;
+    t.sum = 0;
+    htable_snapshot_foreach(a, &sum_values, &t);
+    assert(t.count == NKEYS / 2);
+    
+    htable_delete(clone);
+    htable_snapshot_delete(a);
+    htable_delete(table);
+    check_snapshot(b);
+    htable_snapshot_delete(b);
+}
+
+void test_refused()
+{
+    struct htable *table;
+    
+    table = htable_new_ex(64, 0, &htable_int32_cmpfn, NULL, &dummy_freefn, HT_FLAG_COW);
+    assert(table == NULL);
+    
+    table = htable_new_ex(64, 0, NULL, NULL, NULL, HT_FLAG_COW | HT_FLAG_INLINE_KEYS);
+    assert(table == NULL);
+    
+    /* Only HT_FLAG_COW tables can be snapshotted */
+    table = htable_new(64, 0, &htable_int32_cmpfn, NULL, NULL);
+    assert(table != NULL);
+    assert(htable_snapshot(table) == NULL);
+    htable_delete(table);
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+    
+    for (i = 0; i < NKEYS * 2; i++) {
+        keys[i] = i;
+    }
+    
+    test_snapshot();
+    test_multiple_snapshots();
+    test_refused();
+    
+    return 0;
+}
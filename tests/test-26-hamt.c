@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "config.h"
+#include "hashtable.h"
+#include "hashtable-hamt.h"
+#include "MurmurHash3.h"
+
+#define NKEYS 5000
+#define NPROBE 300000
+#define SEED 1234
+
+static uint32_t keys[NKEYS];
+static int freed = 0;
+
+struct probe {
+    uint32_t hash;
+    uint64_t key;
+};
+
+void int_copyfn(struct htable_entry *dst, void *key, void *data)
+{
+    dst->key = malloc(sizeof(uint32_t));
+    memcpy(dst->key, key, sizeof(uint32_t));
+    dst->data = data;
+}
+
+void int_freefn(struct htable_entry *ent)
+{
+    free(ent->key);
+    freed++;
+}
+
+void count_entries(struct htable_entry *ent, void *ctx)
+{
+    (*(uint32_t *)ctx)++;
+}
+
+int probe_cmp(const void *a, const void *b)
+{
+    const struct probe *pa = a, *pb = b;
+    
+    if (pa->hash != pb->hash) {
+        return pa->hash < pb->hash ? -1 : 1;
+    }
+    
+    return 0;
+}
+
+void test_versions()
+{
+    int i;
+    uint32_t count;
+    struct htable_hamt *versions[NKEYS + 1];
+    struct htable_entry *ent;
+    
+    versions[0] = htable_hamt_new(SEED, &htable_int32_cmpfn, NULL, NULL);
+    assert(versions[0] != NULL);
+    
+    for (i = 0; i < NKEYS; i++) {
+        keys[i] = i * 7919;
+        versions[i + 1] = htable_hamt_insert(versions[i], sizeof(uint32_t),
+                                             &keys[i], &keys[i]);
+        assert(versions[i + 1] != NULL);
+        assert(versions[i + 1]->used == (uint32_t)i + 1);
+    }
+    
+    /* Every version sees exactly the keys inserted before it */
+    for (i = 0; i <= NKEYS; i += 250) {
+        assert(versions[i]->used == (uint32_t)i);
+        
+        count = 0;
+        htable_hamt_foreach(versions[i], &count_entries, &count);
+        assert(count == (uint32_t)i);
+        
+        if (i > 0) {
+            ent = htable_hamt_get(versions[i], sizeof(uint32_t), &keys[i - 1]);
+            assert(ent != NULL && ent->data == &keys[i - 1]);
+        }
+        
+        if (i < NKEYS) {
+            assert(htable_hamt_get(versions[i], sizeof(uint32_t), &keys[i]) == NULL);
+        }
+    }
+    
+    for (i = 0; i <= NKEYS; i++) {
+        htable_hamt_delete(versions[i]);
+    }
+}
+
+void test_replace_remove()
+{
+    int i;
+    uint32_t count, missing = 0xFFFFFFFF;
+    struct htable_hamt *full, *next, *cur;
+    struct htable_entry *ent;
+    
+    freed = 0;
+    cur = htable_hamt_new(SEED, &htable_int32_cmpfn, &int_copyfn, &int_freefn);
+    assert(cur != NULL);
+    
+    for (i = 0; i < NKEYS; i++) {
+        keys[i] = i;
+        next = htable_hamt_insert(cur, sizeof(uint32_t), &keys[i], NULL);
+        assert(next != NULL);
+        htable_hamt_delete(cur);
+        cur = next;
+    }
+    
+    /* Replacing keeps the count, and releases the old entry */
+    next = htable_hamt_insert(cur, sizeof(uint32_t), &keys[10], &keys[10]);
+    assert(next != NULL && next->used == NKEYS);
+    htable_hamt_delete(cur);
+    cur = next;
+    assert(freed == 1);
+    
+    ent = htable_hamt_get(cur, sizeof(uint32_t), &keys[10]);
+    assert(ent != NULL && ent->data == &keys[10]);
+    
+    /* Removing a missing key shares the whole trie */
+    next = htable_hamt_remove(cur, sizeof(uint32_t), &missing);
+    assert(next != NULL && next->root == cur->root && next->used == NKEYS);
+    htable_hamt_delete(next);
+    
+    full = htable_hamt_retain(cur);
+    
+    for (i = 0; i < NKEYS; i += 2) {
+        next = htable_hamt_remove(cur, sizeof(uint32_t), &keys[i]);
+        assert(next != NULL);
+        htable_hamt_delete(cur);
+        cur = next;
+    }
+    
+    assert(cur->used == NKEYS / 2);
+    
+    for (i = 0; i < NKEYS; i++) {
+        ent = htable_hamt_get(cur, sizeof(uint32_t), &keys[i]);
+        assert((ent != NULL) == (i % 2 == 1));
+        assert(htable_hamt_get(full, sizeof(uint32_t), &keys[i]) != NULL);
+    }
+    
+    /* The retained version still holds every entry */
+    assert(freed == 1);
+    htable_hamt_delete(full);
+    assert(freed == 1 + NKEYS / 2);
+    
+    for (i = 1; i < NKEYS; i += 2) {
+        next = htable_hamt_remove(cur, sizeof(uint32_t), &keys[i]);
+        assert(next != NULL);
+        htable_hamt_delete(cur);
+        cur = next;
+    }
+    
+    assert(cur->used == 0 && cur->root == NULL);
+    
+    count = 0;
+    htable_hamt_foreach(cur, &count_entries, &count);
+    assert(count == 0);
+    
+    htable_hamt_delete(cur);
+    assert(freed == 1 + NKEYS);
+}
+
+void test_collisions()
+{
+    uint32_t i;
+    uint64_t pair[2], third;
+    struct probe *probes;
+    struct htable_hamt *a, *b, *c, *d;
+    struct htable_entry *ent;
+    
+    /* Find two keys with the same full 32 bit hash. Both halves of the
+       keys must vary: MurmurHash3 is a bijection on any single block. */
+    probes = malloc(sizeof(*probes) * NPROBE);
+    assert(probes != NULL);
+    
+    for (i = 0; i < NPROBE; i++) {
+        probes[i].key = ((uint64_t)i << 32) | (uint32_t)(i * 2654435761U);
+        MurmurHash3_x86_32(&probes[i].key, sizeof(uint64_t), SEED, &probes[i].hash);
+    }
+    
+    qsort(probes, NPROBE, sizeof(*probes), &probe_cmp);
+    for (i = 1; i < NPROBE; i++) {
+        if (probes[i].hash == probes[i - 1].hash) {
+            break;
+        }
+    }
+    
+    assert(i < NPROBE);
+    pair[0] = probes[i - 1].key;
+    pair[1] = probes[i].key;
+    third = probes[0].key;
+    free(probes);
+    
+    a = htable_hamt_new(SEED, &htable_int64_cmpfn, NULL, NULL);
+    b = htable_hamt_insert(a, sizeof(uint64_t), &pair[0], &pair[0]);
+    c = htable_hamt_insert(b, sizeof(uint64_t), &pair[1], &pair[1]);
+    d = htable_hamt_insert(c, sizeof(uint64_t), &third, &third);
+    assert(d != NULL && d->used == 3);
+    
+    for (i = 0; i < 2; i++) {
+        ent = htable_hamt_get(d, sizeof(uint64_t), &pair[i]);
+        assert(ent != NULL && ent->data == &pair[i]);
+    }
+    
+    assert(htable_hamt_get(b, sizeof(uint64_t), &pair[1]) == NULL);
+    
+    /* Removing one of the pair collapses the collision node */
+    htable_hamt_delete(c);
+    c = htable_hamt_remove(d, sizeof(uint64_t), &pair[0]);
+    assert(c != NULL && c->used == 2);
+    assert(htable_hamt_get(c, sizeof(uint64_t), &pair[0]) == NULL);
+    ent = htable_hamt_get(c, sizeof(uint64_t), &pair[1]);
+    assert(ent != NULL && ent->data == &pair[1]);
+    assert(htable_hamt_get(c, sizeof(uint64_t), &third) != NULL);
+    
+    assert(htable_hamt_get(d, sizeof(uint64_t), &pair[0]) != NULL);
+    
+    htable_hamt_delete(a);
+    htable_hamt_delete(b);
+    htable_hamt_delete(c);
+    htable_hamt_delete(d);
+}
+
+int main(int argc, char **argv)
+{
+    test_versions();
+    test_replace_remove();
+    test_collisions();
+    
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "config.h"
+#include "hashtable.h"
+#include "hashtable-sharded.h"
+
+#define NTHREADS 8
+#define NKEYS 20000
+
+static uint32_t keys[NTHREADS * NKEYS];
+
+struct worker {
+    struct htable_sharded *table;
+    uint32_t id;
+    uint32_t found;
+};
+
+void count_entries(struct htable_entry *ent, void *ctx)
+{
+    assert(*(uint32_t *)ent->key == *(uint32_t *)ent->data);
+    (*(uint32_t *)ctx)++;
+}
+
+void *writer(void *arg)
+{
+    uint32_t i;
+    struct worker *w = arg;
+    uint32_t *mine = &keys[w->id * NKEYS];
+    
+    for (i = 0; i < NKEYS; i++) {
+        mine[i] = w->id * NKEYS + i;
+        assert(htable_sharded_add(w->table, sizeof(uint32_t), &mine[i], &mine[i]) == 1);
+    }
+    
+    /* Drop every other key again */
+    for (i = 0; i < NKEYS; i += 2) {
+        assert(htable_sharded_remove(w->table, sizeof(uint32_t), &mine[i]) == 1);
+    }
+    
+    return NULL;
+}
+
+void *reader(void *arg)
+{
+    uint32_t i, key;
+    void *data;
+    struct worker *w = arg;
+    
+    for (i = 0; i < NTHREADS * NKEYS; i++) {
+        key = i;
+        if (htable_sharded_get(w->table, sizeof(uint32_t), &key, &data)) {
+            assert(*(uint32_t *)data == key);
+            w->found++;
+        }
+    }
+    
+    return NULL;
+}
+
+void test_concurrent(uint32_t nshards)
+{
+    uint32_t i, count;
+    void *data;
+    pthread_t threads[NTHREADS * 2];
+    struct worker workers[NTHREADS * 2];
+    struct htable_sharded *table;
+    
+    /* Start small, so shards grow while other threads use them */
+    table = htable_sharded_new(nshards, 64, 0, &htable_int32_cmpfn, NULL, NULL, 0);
+    assert(table != NULL);
+    
+    for (i = 0; i < NTHREADS * 2; i++) {
+        workers[i].table = table;
+        workers[i].id = i % NTHREADS;
+        workers[i].found = 0;
+        assert(pthread_create(&threads[i], NULL,
+                              i < NTHREADS ? &writer : &reader,
+                              &workers[i]) == 0);
+    }
+    
+    for (i = 0; i < NTHREADS * 2; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+    
+    assert(htable_sharded_used(table) == NTHREADS * NKEYS / 2);
+    
+    for (i = 0; i < NTHREADS * NKEYS; i++) {
+        if (i % 2) {
+            assert(htable_sharded_get(table, sizeof(uint32_t), &keys[i], &data) == 1);
+            assert(data == &keys[i]);
+        } else {
+            assert(htable_sharded_get(table, sizeof(uint32_t), &keys[i], NULL) == 0);
+        }
+    }
+    
+    count = 0;
+    htable_sharded_foreach(table, &count_entries, &count);
+    assert(count == NTHREADS * NKEYS / 2);
+    
+    htable_sharded_delete(table);
+}
+
+void test_new()
+{
+    struct htable_sharded *table;
+    
+    /* Rounded up to a power of two */
+    table = htable_sharded_new(5, 1024, 0, &htable_int32_cmpfn, NULL, NULL, 0);
+    assert(table != NULL);
+    assert(table->nshards == 8);
+    assert(table->shift == 29);
+    htable_sharded_delete(table);
+    
+    assert(htable_sharded_new(0, 1024, 0, &htable_int32_cmpfn, NULL, NULL, 0) == NULL);
+    assert(htable_sharded_new(4, 1024, 0, &htable_int32_cmpfn, NULL, NULL,
+                              HT_VALUE_WIDTH(8)) == NULL);
+}
+
+int main(int argc, char **argv)
+{
+    test_new();
+    test_concurrent(1);
+    test_concurrent(16);
+    
+    return 0;
+}
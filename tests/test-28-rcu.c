@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "config.h"
+#include "hashtable.h"
+#include "hashtable-rcu.h"
+
+#define NREADERS 4
+#define NKEYS 2000
+#define ROUNDS 20
+
+#define LIVE 0x600DF00D
+#define DEAD 0xDEADBEEF
+
+struct value {
+    uint32_t key;
+    uint32_t magic;
+};
+
+static uint32_t keys[NKEYS];
+static uint32_t allocated = 0;
+static uint32_t freed = 0;
+static volatile int done = 0;
+static struct htable_rcu *table;
+
+struct value *value_new(uint32_t key)
+{
+    struct value *v = malloc(sizeof(*v));
+    
+    v->key = key;
+    v->magic = LIVE;
+    __sync_add_and_fetch(&allocated, 1);
+    
+    return v;
+}
+
+void value_freefn(struct htable_entry *ent)
+{
+    struct value *v = ent->data;
+    
+    /* A reader still using it would see this, or ASan would */
+    v->magic = DEAD;
+    free(v);
+    __sync_add_and_fetch(&freed, 1);
+}
+
+void *reader(void *arg)
+{
+    uint32_t i, seen = 0;
+    struct value *v;
+    struct htable_entry *ent;
+    struct htable_rcu_reader *r;
+    
+    r = htable_rcu_reader_new(table);
+    assert(r != NULL);
+    
+    while (!__sync_fetch_and_add(&done, 0)) {
+        for (i = 0; i < NKEYS; i++) {
+            htable_rcu_enter(table, r);
+            
+            ent = htable_rcu_get(table, sizeof(uint32_t), &keys[i]);
+            if (ent != NULL) {
+                v = htable_rcu_data(ent);
+                assert(v->magic == LIVE);
+                assert(v->key == keys[i]);
+                seen++;
+            }
+            
+            htable_rcu_leave(r);
+        }
+    }
+    
+    htable_rcu_reader_delete(table, r);
+    return NULL;
+}
+
+void test_concurrent()
+{
+    uint32_t i, round;
+    pthread_t threads[NREADERS];
+    
+    /* Small, so the writer rebuilds it while readers run */
+    table = htable_rcu_new(16, 0, &htable_int32_cmpfn, NULL, &value_freefn, 0);
+    assert(table != NULL);
+    
+    for (i = 0; i < NKEYS; i++) {
+        keys[i] = i * 31;
+    }
+    
+    for (i = 0; i < NREADERS; i++) {
+        assert(pthread_create(&threads[i], NULL, &reader, NULL) == 0);
+    }
+    
+    for (round = 0; round < ROUNDS; round++) {
+        /* Add or replace everything, then remove a third */
+        for (i = 0; i < NKEYS; i++) {
+            assert(htable_rcu_add(table, sizeof(uint32_t), &keys[i], value_new(keys[i])) == 1);
+        }
+        
+        for (i = round % 3; i < NKEYS; i += 3) {
+            assert(htable_rcu_remove(table, sizeof(uint32_t), &keys[i]) == 1);
+        }
+    }
+    
+    __sync_fetch_and_add(&done, 1);
+    for (i = 0; i < NREADERS; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+    
+    /* Everything replaced or removed is freed after the grace period */
+    htable_rcu_synchronize(table);
+    assert(table->retired_used == 0);
+    assert(freed + table->table->used == allocated);
+    
+    htable_rcu_delete(table);
+    assert(freed == allocated);
+}
+
+void test_single()
+{
+    uint32_t key = 7, missing = 8;
+    struct value *old;
+    struct htable_rcu_reader *r;
+    struct htable_entry *ent;
+    
+    freed = allocated = 0;
+    table = htable_rcu_new(16, 0, &htable_int32_cmpfn, NULL, &value_freefn, 0);
+    assert(table != NULL);
+    
+    r = htable_rcu_reader_new(table);
+    assert(r != NULL);
+    
+    assert(htable_rcu_add(table, sizeof(key), &key, value_new(key)) == 1);
+    
+    /* A read section holds back reclamation of what it may see */
+    htable_rcu_enter(table, r);
+    ent = htable_rcu_get(table, sizeof(key), &key);
+    assert(ent != NULL);
+    
+    assert(htable_rcu_remove(table, sizeof(key), &key) == 1);
+    assert(htable_rcu_get(table, sizeof(key), &key) == NULL);
+    assert(htable_rcu_remove(table, sizeof(missing), &missing) == 0);
+    
+    pthread_mutex_lock(&table->lock);
+    assert(table->retired_used == 1);
+    pthread_mutex_unlock(&table->lock);
+    assert(((struct value *)htable_rcu_data(ent))->magic == LIVE);
+    assert(freed == 0);
+    
+    htable_rcu_leave(r);
+    htable_rcu_synchronize(table);
+    assert(freed == 1);
+    
+    /* A replaced entry is retired only after the new one is linked, and
+       stays readable until the grace period ends */
+    assert(htable_rcu_add(table, sizeof(key), &key, value_new(key)) == 1);
+    htable_rcu_enter(table, r);
+    ent = htable_rcu_get(table, sizeof(key), &key);
+    assert(ent != NULL);
+    old = htable_rcu_data(ent);
+    
+    assert(htable_rcu_add(table, sizeof(key), &key, value_new(key)) == 1);
+    ent = htable_rcu_get(table, sizeof(key), &key);
+    assert(ent != NULL && htable_rcu_data(ent) != old);
+    assert(table->table->used == 1);
+    
+    pthread_mutex_lock(&table->lock);
+    assert(table->retired_used == 1);
+    pthread_mutex_unlock(&table->lock);
+    assert(old->magic == LIVE);
+    assert(freed == 1);
+    
+    htable_rcu_leave(r);
+    htable_rcu_synchronize(table);
+    assert(freed == 2);
+    
+    htable_rcu_reader_delete(table, r);
+    htable_rcu_delete(table);
+    
+    /* Inline storage and callbacks the table would run aren't allowed */
+    assert(htable_rcu_new(16, 0, &htable_int32_cmpfn, NULL, NULL, HT_VALUE_WIDTH(8)) == NULL);
+    assert(htable_new_ex(16, 0, &htable_int32_cmpfn, NULL, &value_freefn, HT_FLAG_RCU) == NULL);
+}
+
+int main(int argc, char **argv)
+{
+    test_single();
+    test_concurrent();
+    
+    return 0;
+}
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "config.h"
+#include "hashtable.h"
+#include "hashtable-cas.h"
+
+#define NTHREADS 8
+#define NKEYS 50000
+
+static uint32_t keys[NKEYS];
+static struct htable_entry *found[NTHREADS][NKEYS];
+static uint32_t copies = 0;
+static uint32_t freed = 0;
+
+struct worker {
+    struct htable_cas *table;
+    uint32_t id;
+    uint32_t inserted;
+};
+
+void int_copyfn(struct htable_entry *dst, void *key, void *data)
+{
+    dst->key = malloc(sizeof(uint32_t));
+    memcpy(dst->key, key, sizeof(uint32_t));
+    dst->data = data;
+    __sync_add_and_fetch(&copies, 1);
+}
+
+void int_freefn(struct htable_entry *ent)
+{
+    free(ent->key);
+    __sync_add_and_fetch(&freed, 1);
+}
+
+void *worker(void *arg)
+{
+    uint32_t i, k;
+    int inserted;
+    struct worker *w = arg;
+    struct htable_entry *ent;
+    
+    /* Every thread inserts every key, starting at a different place */
+    for (i = 0; i < NKEYS; i++) {
+        k = (i + w->id * (NKEYS / NTHREADS)) % NKEYS;
+        
+        ent = htable_cas_find_or_insert(w->table, sizeof(uint32_t), &keys[k],
+                                        &found[w->id][k], &inserted);
+        assert(ent != NULL);
+        assert(*(uint32_t *)ent->key == keys[k]);
+        
+        found[w->id][k] = ent;
+        w->inserted += inserted;
+        
+        /* Still there while other threads move it */
+        assert(htable_cas_get(w->table, sizeof(uint32_t), &keys[k]) == ent);
+        
+        /* Other threads' entries are complete when seen */
+        ent = htable_cas_get(w->table, sizeof(uint32_t), &keys[(k * 7) % NKEYS]);
+        if (ent != NULL) {
+            assert(*(uint32_t *)ent->key == keys[(k * 7) % NKEYS]);
+            assert(ent->data != NULL);
+        }
+    }
+    
+    return NULL;
+}
+
+void test_concurrent()
+{
+    uint32_t i, t, inserted = 0;
+    pthread_t threads[NTHREADS];
+    struct worker workers[NTHREADS];
+    struct htable_cas *table;
+    
+    /* Small, so it's resized many times while threads use it */
+    table = htable_cas_new(64, 0, &htable_int32_cmpfn,
+                           &int_copyfn, &int_freefn, 0);
+    assert(table != NULL);
+    
+    for (i = 0; i < NKEYS; i++) {
+        keys[i] = i * 2654435761U;
+    }
+    
+    for (t = 0; t < NTHREADS; t++) {
+        workers[t].table = table;
+        workers[t].id = t;
+        workers[t].inserted = 0;
+        assert(pthread_create(&threads[t], NULL, &worker, &workers[t]) == 0);
+    }
+    
+    for (t = 0; t < NTHREADS; t++) {
+        assert(pthread_join(threads[t], NULL) == 0);
+        inserted += workers[t].inserted;
+    }
+    
+    /* Each key was inserted exactly once, and everybody got that entry */
+    assert(inserted == NKEYS);
+    assert(table->used == NKEYS);
+    assert(table->next == table->used + table->wasted);
+    
+    for (i = 0; i < NKEYS; i++) {
+        for (t = 1; t < NTHREADS; t++) {
+            assert(found[t][i] == found[0][i]);
+        }
+        
+        assert(htable_cas_get(table, sizeof(uint32_t), &keys[i]) == found[0][i]);
+    }
+    
+    /* Copies that lost a race were freed right away */
+    assert(freed == table->wasted);
+    
+    htable_cas_delete(table);
+    assert(freed == copies);
+}
+
+void test_grow()
+{
+    uint32_t i;
+    struct htable_cas *table;
+    struct htable_entry *first[64];
+    
+    table = htable_cas_new(64, 0, &htable_int32_cmpfn, NULL, NULL, 0);
+    assert(table != NULL);
+    assert(table->capacity == 64 * HT_MAX_LOAD / 100);
+    
+    for (i = 0; i < NKEYS; i++) {
+        keys[i] = i;
+        assert(htable_cas_add(table, sizeof(uint32_t), &keys[i], NULL) == 1);
+        
+        if (i < 64) {
+            first[i] = htable_cas_get(table, sizeof(uint32_t), &keys[i]);
+            assert(first[i] != NULL);
+        }
+    }
+    
+    assert(table->used == NKEYS);
+    assert(table->capacity >= NKEYS);
+    assert(table->array->size == 64 * (table->capacity / table->first->capacity));
+    
+    /* Entries don't move when the table grows */
+    for (i = 0; i < NKEYS; i++) {
+        assert(htable_cas_add(table, sizeof(uint32_t), &keys[i], NULL) == 1);
+        
+        if (i < 64) {
+            assert(htable_cas_get(table, sizeof(uint32_t), &keys[i]) == first[i]);
+        } else {
+            assert(htable_cas_get(table, sizeof(uint32_t), &keys[i]) != NULL);
+        }
+    }
+    
+    assert(table->used == NKEYS);
+    htable_cas_delete(table);
+    
+    assert(htable_cas_new(64, 0, NULL, NULL, NULL, 0) == NULL);
+    
+    table = htable_cas_new(64, 0, NULL, NULL, NULL, HT_FLAG_MEMCMP);
+    assert(table != NULL);
+    htable_cas_delete(table);
+}
+
+int main(int argc, char **argv)
+{
+    test_grow();
+    test_concurrent();
+    
+    return 0;
+}
@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "config.h"
+#include "hashtable.h"
+
+#define NREADERS 4
+#define NSTABLE 500
+#define NKEYS 2000
+#define ROUNDS 200
+
+/* Written as a whole by the writer, so readers must see all four equal */
+struct value {
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+    uint32_t d;
+};
+
+static uint32_t keys[NKEYS];
+static volatile int done = 0;
+static struct htable *table;
+
+void value_set(struct value *v, uint32_t n)
+{
+    v->a = n;
+    v->b = n;
+    v->c = n;
+    v->d = n;
+}
+
+void *reader(void *arg)
+{
+    uint32_t i = 0, seen = 0;
+    struct value v;
+    struct htable_iovec iov[2];
+    
+    while (!done) {
+        i = (i + 7) % NKEYS;
+        
+        if (htable_get_copy(table, sizeof(uint32_t), &keys[i], &v)) {
+            assert(v.a == v.b && v.b == v.c && v.c == v.d);
+            seen++;
+        } else {
+            /* Stable keys are never removed, so never missed */
+            assert(i >= NSTABLE);
+        }
+        
+        if (i < NSTABLE) {
+            assert(htable_get(table, sizeof(uint32_t), &keys[i]) != NULL);
+            
+            /* Fragmented keys take the same read path */
+            iov[0].base = &keys[i];
+            iov[0].len = 1;
+            iov[1].base = (char *)&keys[i] + 1;
+            iov[1].len = sizeof(uint32_t) - 1;
+            assert(htable_get_iov(table, iov, 2) != NULL);
+        }
+    }
+    
+    return (void *)(size_t)seen;
+}
+
+void test_concurrent()
+{
+    uint32_t i, r;
+    pthread_t threads[NREADERS];
+    struct value v;
+    
+    table = htable_new_ex(16, 0, NULL, NULL, NULL,
+                          HT_VALUE_WIDTH(sizeof(struct value)) |
+                          HT_FLAG_SEQLOCK | HT_FLAG_MEMCMP);
+    assert(table != NULL);
+    
+    for (i = 0; i < NKEYS; i++) {
+        keys[i] = i;
+    }
+    
+    for (i = 0; i < NSTABLE; i++) {
+        value_set(&v, 0);
+        assert(htable_add_loop(table, sizeof(uint32_t), &keys[i], &v, 16));
+    }
+    
+    for (i = 0; i < NREADERS; i++) {
+        assert(pthread_create(&threads[i], NULL, &reader, NULL) == 0);
+    }
+    
+    for (r = 1; r <= ROUNDS; r++) {
+        value_set(&v, r);
+        
+        for (i = 0; i < NSTABLE; i++) {
+            assert(htable_update_value(table, sizeof(uint32_t), &keys[i], &v, NULL));
+        }
+        
+        /* Churn the other keys, growing and shrinking the table */
+        for (i = NSTABLE; i < NKEYS; i++) {
+            if ((i + r) % 2) {
+                htable_add_loop(table, sizeof(uint32_t), &keys[i], &v, 16);
+            } else {
+                htable_remove(table, sizeof(uint32_t), &keys[i]);
+            }
+        }
+        
+        if (r % 10 == 0) {
+            assert(htable_shrink_to_fit(table));
+        }
+        
+        if (r % 25 == 0) {
+            assert(htable_resize(table, 0, table->size * 2));
+        }
+    }
+    
+    done = 1;
+    for (i = 0; i < NREADERS; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+    
+    /* Writers are done and readers gone, old slot arrays can go */
+    assert(table->retired != NULL);
+    htable_reclaim(table);
+    assert(table->retired == NULL);
+    assert(table->seq % 2 == 0 && table->writing == 0);
+    
+    for (i = 0; i < NSTABLE; i++) {
+        assert(htable_get_copy(table, sizeof(uint32_t), &keys[i], &v));
+        assert(v.a == ROUNDS && v.d == ROUNDS);
+    }
+    
+    htable_delete(table);
+}
+
+void noop_freefn(struct htable_entry *ent)
+{
+}
+
+void test_single()
+{
+    uint32_t seq, key = 1, other = 2;
+    void *data;
+    struct value v, *p;
+    struct htable_entry *ent;
+    
+    /* Flags readers can't work with */
+    assert(htable_new_ex(16, 0, &htable_int32_cmpfn, NULL, &noop_freefn,
+                         HT_FLAG_SEQLOCK) == NULL);
+    assert(htable_new_ex(16, 0, NULL, NULL, NULL,
+                         HT_FLAG_SEQLOCK | HT_FLAG_INLINE_KEYS) == NULL);
+    assert(htable_new_ex(16, 0, &htable_int32_cmpfn, NULL, NULL,
+                         HT_FLAG_SEQLOCK | HT_FLAG_RCU) == NULL);
+    
+    table = htable_new_ex(16, 0, &htable_int32_cmpfn, NULL, NULL,
+                          HT_VALUE_WIDTH(sizeof(struct value)) | HT_FLAG_SEQLOCK);
+    assert(table != NULL);
+    
+    /* Every write leaves seq even, and moved on */
+    seq = table->seq;
+    value_set(&v, 5);
+    assert(htable_add(table, sizeof(uint32_t), &key, &v));
+    assert(table->seq == seq + 2);
+    
+    /* Sections nest */
+    htable_write_begin(table);
+    htable_write_begin(table);
+    assert(table->seq % 2 == 1);
+    htable_write_end(table);
+    assert(table->seq % 2 == 1);
+    htable_write_end(table);
+    assert(table->seq % 2 == 0);
+    
+    /* A reused tombstone starts with a zeroed value */
+    assert(htable_remove(table, sizeof(uint32_t), &key));
+    assert(htable_get_copy(table, sizeof(uint32_t), &key, &v) == 0);
+    assert(htable_emplace(table, sizeof(uint32_t), &key, &ent) == HT_EMPLACE_NEW);
+    p = htable_value(table, ent);
+    assert(p->a == 0 && p->d == 0);
+    
+    /* Resizing keeps the old slots, until reclaimed */
+    assert(htable_resize(table, 0, 64));
+    assert(table->retired != NULL);
+    assert(htable_get(table, sizeof(uint32_t), &key) != NULL);
+    htable_reclaim(table);
+    assert(table->retired == NULL);
+    htable_delete(table);
+    
+    /* htable_get_copy() works on any table */
+    table = htable_new(16, 0, &htable_int32_cmpfn, NULL, NULL);
+    assert(htable_add(table, sizeof(uint32_t), &key, &other));
+    data = NULL;
+    assert(htable_get_copy(table, sizeof(uint32_t), &key, &data));
+    assert(data == &other);
+    assert(htable_get_copy(table, sizeof(uint32_t), &other, &data) == 0);
+    assert(table->seq == 0);
+    htable_delete(table);
+    
+    table = htable_set_new(16, 0, &htable_int32_cmpfn, NULL, NULL);
+    assert(htable_add(table, sizeof(uint32_t), &key, NULL));
+    assert(htable_get_copy(table, sizeof(uint32_t), &key, NULL));
+    htable_delete(table);
+}
+
+int main(int argc, char **argv)
+{
+    test_single();
+    test_concurrent();
+    
+    return 0;
+}
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "config.h"
+#include "hashtable.h"
+
+#define NKEYS 20000
+
+static uint32_t keys[NKEYS];
+static char names[NKEYS][16];
+
+/* Same slot for every entry, and same entry contents */
+void assert_same(struct htable *a, struct htable *b)
+{
+    uint32_t i;
+    struct htable_entry *x, *y;
+    
+    assert(a->size == b->size);
+    assert(a->used == b->used);
+    assert(a->deleted == 0 && b->deleted == 0);
+    assert(memcmp(a->entries, b->entries, sizeof(uint32_t) * a->used) == 0);
+    
+    for (i = 0; i < a->used; i++) {
+        x = htable_entry_at(a, i);
+        y = htable_entry_at(b, i);
+        assert(x->key_size == y->key_size);
+        assert(memcmp(x->key, y->key, x->key_size) == 0);
+        assert(x->data == y->data);
+    }
+}
+
+/* Resize clones of table serially and on 2 to 8 threads */
+void check_resize(struct htable *table, uint32_t new_size)
+{
+    uint32_t t, i;
+    struct htable *serial, *parallel;
+    struct htable_entry *ent;
+    
+    serial = htable_clone(table);
+    assert(serial != NULL);
+    assert(htable_resize(serial, 0, new_size));
+    assert(serial->size == new_size);
+    
+    for (t = 0; t <= 8; t++) {
+        parallel = htable_clone(table);
+        assert(parallel != NULL);
+        assert(htable_resize_parallel(parallel, 0, new_size, t));
+        assert_same(serial, parallel);
+        
+        for (i = 0; i < parallel->used; i++) {
+            ent = htable_entry_at(parallel, i);
+            assert(htable_get(parallel, ent->key_size, ent->key) == ent);
+        }
+        
+        htable_delete(parallel);
+    }
+    
+    htable_delete(serial);
+}
+
+void fill(struct htable *table, int strings)
+{
+    uint32_t i;
+    
+    for (i = 0; i < NKEYS; i++) {
+        if (strings) {
+            assert(htable_add_loop(table, strlen(names[i]), names[i], &keys[i], 16));
+        } else {
+            assert(htable_add_loop(table, sizeof(uint32_t), &keys[i], &keys[i], 16));
+        }
+    }
+    
+    /* Leave tombstones, and move entries around in dense order */
+    for (i = 0; i < NKEYS; i += 3) {
+        if (strings) {
+            assert(htable_remove(table, strlen(names[i]), names[i]));
+        } else {
+            assert(htable_remove(table, sizeof(uint32_t), &keys[i]));
+        }
+    }
+}
+
+/* Power of two at or above n, so probing reaches every slot */
+uint32_t pow2(uint32_t n)
+{
+    uint32_t size = 16;
+    
+    while (size < n) {
+        size *= 2;
+    }
+    
+    return size;
+}
+
+void test_resize()
+{
+    struct htable *table;
+    
+    table = htable_new(16, 0, &htable_int32_cmpfn, NULL, NULL);
+    assert(table != NULL);
+    fill(table, 0);
+    
+    /* Grow, shrink to a crowded table, and compact in place */
+    check_resize(table, table->size * 4);
+    check_resize(table, pow2(table->used));
+    check_resize(table, table->size);
+    
+    /* Too small fails either way, leaving the table as it was */
+    assert(htable_resize_parallel(table, 0, table->used - 1, 4) == 0);
+    assert(htable_resize(table, 0, table->used - 1) == 0);
+    assert(table->deleted > 0);
+    assert(htable_get(table, sizeof(uint32_t), &keys[1]) != NULL);
+    
+    /* load_thresh works as for htable_resize() */
+    assert(htable_resize_parallel(table, 100, table->size * 2, 4));
+    assert(table->deleted > 0);
+    
+    htable_delete(table);
+}
+
+void test_layouts()
+{
+    struct htable *table;
+    
+    /* Inline keys are re-pointed at their new slot */
+    table = htable_new_ex(16, 0, NULL, NULL, NULL,
+                          HT_FLAG_INLINE_KEYS | HT_FLAG_MEMCMP);
+    assert(table != NULL);
+    fill(table, 1);
+    check_resize(table, table->size * 2);
+    check_resize(table, pow2(table->used));
+    htable_delete(table);
+    
+    /* Slots spread over pages */
+    table = htable_new_ex(16, 0, &htable_int32_cmpfn, NULL, NULL,
+                          HT_FLAG_COW | HT_VALUE_WIDTH(sizeof(uint32_t)));
+    assert(table != NULL);
+    fill(table, 0);
+    check_resize(table, table->size * 2);
+    check_resize(table, pow2(table->used));
+    htable_delete(table);
+    
+    /* Fewer entries than threads */
+    table = htable_new(16, 0, &htable_int32_cmpfn, NULL, NULL);
+    assert(htable_add(table, sizeof(uint32_t), &keys[0], NULL));
+    assert(htable_add(table, sizeof(uint32_t), &keys[1], NULL));
+    check_resize(table, 64);
+    assert(htable_remove(table, sizeof(uint32_t), &keys[0]));
+    assert(htable_remove(table, sizeof(uint32_t), &keys[1]));
+    check_resize(table, 16);
+    htable_delete(table);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t i;
+    
+    for (i = 0; i < NKEYS; i++) {
+        keys[i] = i * 2654435761U;
+        sprintf(names[i], "key-%u", (unsigned)i);
+    }
+    
+    test_resize();
+    test_layouts();
+    
+    return 0;
+}
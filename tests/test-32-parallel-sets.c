@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "config.h"
+#include "hashtable.h"
+
+#define NKEYS 30000
+
+static uint32_t keys[NKEYS * 2];
+
+void assert_same(struct htable_collection *x, struct htable_collection *y)
+{
+    assert(x != NULL && y != NULL);
+    assert(x->used == y->used);
+    assert(memcmp(x->list, y->list, sizeof(*x->list) * (x->used + 1)) == 0);
+    assert(x->list[x->used] == NULL);
+}
+
+void test_sets()
+{
+    uint32_t i, t;
+    struct htable *a, *b;
+    struct htable_collection *intersect, *difference, *list;
+    
+    a = htable_new(16, 0, &htable_int32_cmpfn, NULL, NULL);
+    b = htable_new(16, 0, &htable_int32_cmpfn, NULL, NULL);
+    assert(a != NULL && b != NULL);
+    
+    /* a has keys [0, NKEYS), b every third of them, and as many others */
+    for (i = 0; i < NKEYS; i++) {
+        assert(htable_add_loop(a, sizeof(uint32_t), &keys[i], NULL, 16));
+        
+        if (i % 3 == 0) {
+            assert(htable_add_loop(b, sizeof(uint32_t), &keys[i], NULL, 16));
+            assert(htable_add_loop(b, sizeof(uint32_t), &keys[NKEYS + i], NULL, 16));
+        }
+    }
+    
+    intersect = htable_intersect(a, b);
+    difference = htable_difference(a, b);
+    assert(intersect->used == (NKEYS + 2) / 3);
+    assert(difference->used == NKEYS - intersect->used);
+    
+    /* Entries of b and a, in a's order */
+    for (i = 0; i < intersect->used; i++) {
+        assert(*(uint32_t *)intersect->list[i]->key == keys[i * 3]);
+        assert(htable_get(b, sizeof(uint32_t), &keys[i * 3]) == intersect->list[i]);
+    }
+    
+    for (i = 0; i < difference->used; i++) {
+        assert(htable_get(a, sizeof(uint32_t), difference->list[i]->key) == difference->list[i]);
+        assert(htable_get(b, sizeof(uint32_t), difference->list[i]->key) == NULL);
+    }
+    
+    /* Same lists on any number of threads */
+    for (t = 0; t <= 8; t++) {
+        list = htable_intersect_parallel(a, b, t, 0);
+        assert_same(intersect, list);
+        htable_collection_delete(list);
+        
+        /* a is the smaller one here, so nothing changes */
+        list = htable_intersect_parallel(b, a, t, HT_SET_SMALLER);
+        assert(list->used == intersect->used);
+        for (i = 0; i < list->used; i++) {
+            assert(htable_get(a, sizeof(uint32_t), &keys[i * 3]) == list->list[i]);
+        }
+        
+        htable_collection_delete(list);
+        
+        list = htable_difference_parallel(a, b, t);
+        assert_same(difference, list);
+        htable_collection_delete(list);
+    }
+    
+    htable_collection_delete(intersect);
+    htable_collection_delete(difference);
+    
+    /* Going over the smaller table gives b's entries in b's order */
+    intersect = htable_intersect(b, a);
+    for (t = 1; t <= 4; t++) {
+        list = htable_intersect_parallel(a, b, t, HT_SET_SMALLER);
+        assert(list->used == intersect->used);
+        for (i = 0; i < list->used; i++) {
+            assert(list->list[i] == htable_entry_at(b, i * 2));
+        }
+        
+        htable_collection_delete(list);
+    }
+    
+    htable_collection_delete(intersect);
+    htable_delete(a);
+    htable_delete(b);
+}
+
+void test_small()
+{
+    uint32_t t;
+    struct htable *a, *b;
+    struct htable_collection *list;
+    
+    a = htable_new(16, 0, &htable_int32_cmpfn, NULL, NULL);
+    b = htable_new(16, 0, &htable_int32_cmpfn, NULL, NULL);
+    
+    /* Empty tables, and fewer entries than threads */
+    for (t = 0; t < 3; t++) {
+        list = htable_intersect_parallel(a, b, 8, HT_SET_SMALLER);
+        assert(list != NULL && list->used == t && list->list[t] == NULL);
+        htable_collection_delete(list);
+        
+        list = htable_difference_parallel(a, b, 8);
+        assert(list != NULL && list->used == 0 && list->list[0] == NULL);
+        htable_collection_delete(list);
+        
+        assert(htable_add(a, sizeof(uint32_t), &keys[t], NULL));
+        assert(htable_add(b, sizeof(uint32_t), &keys[t], NULL));
+    }
+    
+    htable_delete(a);
+    htable_delete(b);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t i;
+    
+    for (i = 0; i < NKEYS * 2; i++) {
+        keys[i] = i;
+    }
+    
+    test_sets();
+    test_small();
+    
+    return 0;
+}
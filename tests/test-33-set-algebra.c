@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "config.h"
+#include "hashtable.h"
+
+#define NKEYS 4000
+
+static uint32_t keys[NKEYS * 2];
+static uint64_t values[NKEYS * 2];
+
+/* Table of keys [begin, end), with their index as data */
+struct htable *range(uint32_t seed, uint32_t flags, uint32_t begin, uint32_t end)
+{
+    uint32_t i;
+    struct htable *table;
+    
+    table = htable_new_ex(16, seed, &htable_int32_cmpfn, NULL, NULL, flags);
+    assert(table != NULL);
+    
+    for (i = begin; i < end; i++) {
+        assert(htable_add_loop(table, sizeof(uint32_t), &keys[i], &values[i], 16));
+    }
+    
+    return table;
+}
+
+void test_union()
+{
+    uint32_t i, seed;
+    struct htable *a, *b;
+    struct htable_entry *ent;
+    
+    for (seed = 0; seed < 2; seed++) {
+        a = range(0, 0, 0, NKEYS);
+        b = range(seed * 1234, 0, NKEYS / 2, NKEYS + NKEYS / 2);
+        
+        /* Tombstones in dst are reused or dropped */
+        for (i = 0; i < NKEYS / 4; i++) {
+            assert(htable_remove(a, sizeof(uint32_t), &keys[i]));
+        }
+        
+        assert(htable_union_into(a, b));
+        assert(a->used == NKEYS + NKEYS / 4);
+        assert((uint64_t)a->used * 100 <= (uint64_t)a->size * HT_MAX_LOAD);
+        
+        for (i = NKEYS / 4; i < NKEYS + NKEYS / 2; i++) {
+            ent = htable_get(a, sizeof(uint32_t), &keys[i]);
+            assert(ent != NULL && ent->data == &values[i]);
+        }
+        
+        /* Added in src's order, after what dst had */
+        ent = htable_entry_at(a, NKEYS - NKEYS / 4);
+        assert(*(uint32_t *)ent->key == keys[NKEYS]);
+        
+        /* Nothing left to add */
+        assert(htable_union_into(a, b));
+        assert(a->used == NKEYS + NKEYS / 4);
+        assert(htable_union_into(a, a));
+        
+        htable_delete(a);
+        htable_delete(b);
+    }
+}
+
+void test_union_layouts()
+{
+    uint32_t i;
+    char name[16];
+    struct htable *a, *b, *set;
+    struct htable_entry *ent;
+    
+    /* Inline values are copied, and need the same width on both sides */
+    a = range(0, HT_VALUE_WIDTH(sizeof(uint64_t)), 0, 10);
+    b = range(0, HT_VALUE_WIDTH(sizeof(uint64_t)), 5, 20);
+    assert(htable_union_into(a, b));
+    assert(a->used == 20);
+    ent = htable_get(a, sizeof(uint32_t), &keys[15]);
+    assert(*(uint64_t *)htable_value(a, ent) == 15);
+    htable_delete(b);
+    
+    b = range(0, 0, 5, 30);
+    assert(htable_union_into(a, b) == 0);
+    assert(htable_union_into(b, a) == 0);
+    
+    /* A set takes the keys alone */
+    set = htable_set_new(16, 0, &htable_int32_cmpfn, NULL, NULL);
+    assert(htable_union_into(set, a));
+    assert(htable_union_into(set, b));
+    assert(set->used == 30);
+    htable_delete(set);
+    htable_delete(a);
+    htable_delete(b);
+    
+    /* Inline keys are copied into dst's own slots */
+    a = htable_new_ex(16, 0, NULL, NULL, NULL, HT_FLAG_INLINE_KEYS | HT_FLAG_MEMCMP);
+    b = htable_new_ex(16, 0, NULL, NULL, NULL, HT_FLAG_INLINE_KEYS | HT_FLAG_MEMCMP);
+    for (i = 0; i < 100; i++) {
+        sprintf(name, "key-%u", (unsigned)i);
+        assert(htable_add_loop(i < 50 ? a : b, strlen(name), name, NULL, 16));
+    }
+    
+    assert(htable_union_into(a, b));
+    htable_delete(b);
+    assert(a->used == 100);
+    assert(htable_get(a, 6, "key-99") != NULL);
+    
+    b = htable_new(16, 0, &htable_cstring_cmpfn, NULL, NULL);
+    assert(htable_union_into(b, a) == 0);
+    htable_delete(b);
+    htable_delete(a);
+}
+
+void test_compare()
+{
+    uint32_t seed;
+    struct htable *a, *b, *c;
+    struct htable_collection *list;
+    
+    for (seed = 0; seed < 2; seed++) {
+        a = range(0, 0, 0, NKEYS);
+        b = range(seed * 99, 0, NKEYS / 2, NKEYS + NKEYS / 2);
+        c = range(seed * 7, 0, 0, NKEYS / 2);
+        
+        assert(htable_intersect_count(a, b) == NKEYS / 2);
+        assert(htable_intersect_count(b, a) == NKEYS / 2);
+        assert(htable_intersect_count(b, c) == 0);
+        
+        assert(htable_is_subset(c, a));
+        assert(!htable_is_subset(a, c));
+        assert(!htable_is_subset(c, b));
+        assert(htable_is_subset(a, a));
+        
+        assert(!htable_equal(a, b));
+        assert(!htable_equal(a, c));
+        assert(htable_union_into(c, b));
+        assert(htable_equal(a, c) == 0);
+        assert(htable_is_subset(a, c));
+        
+        /* a's half of b, then b's half of a */
+        list = htable_symmetric_difference(a, b);
+        assert(list->used == NKEYS && list->list[NKEYS] == NULL);
+        assert(*(uint32_t *)list->list[0]->key == keys[0]);
+        assert(list->list[0] == htable_entry_at(a, 0));
+        assert(list->list[NKEYS / 2] == htable_get(b, sizeof(uint32_t), &keys[NKEYS]));
+        htable_collection_delete(list);
+        
+        htable_delete(c);
+        c = range(seed * 7, 0, 0, NKEYS);
+        assert(htable_equal(a, c) && htable_equal(c, a));
+        
+        list = htable_symmetric_difference(a, c);
+        assert(list->used == 0 && list->list[0] == NULL);
+        htable_collection_delete(list);
+        
+        htable_delete(a);
+        htable_delete(b);
+        htable_delete(c);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t i;
+    
+    for (i = 0; i < NKEYS * 2; i++) {
+        keys[i] = i;
+        values[i] = i;
+    }
+    
+    test_union();
+    test_union_layouts();
+    test_compare();
+    
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "config.h"
+#include "hashtable.h"
+
+#define NKEYS 5000
+
+static uint32_t keys[NKEYS * 2];
+
+struct visit {
+    struct htable_collection *expect;
+    uint32_t seen;
+    uint32_t stop_at;
+};
+
+/* Entries must come in the order the collection lists them */
+int check_visit(struct htable_entry *ent, void *ctx)
+{
+    struct visit *v = ctx;
+    
+    assert(v->seen < v->expect->used);
+    assert(v->expect->list[v->seen] == ent);
+    v->seen++;
+    
+    return v->seen == v->stop_at;
+}
+
+void check_each(struct htable *a, struct htable *b, int difference)
+{
+    struct visit v;
+    uint32_t n;
+    
+    v.expect = difference ? htable_difference(a, b) : htable_intersect(a, b);
+    assert(v.expect != NULL);
+    
+    /* Whole walk */
+    v.seen = 0;
+    v.stop_at = 0;
+    n = difference ? htable_difference_each(a, b, &check_visit, &v) :
+                     htable_intersect_each(a, b, &check_visit, &v);
+    assert(n == v.expect->used && v.seen == n);
+    
+    /* Stopped early */
+    if (v.expect->used > 10) {
+        v.seen = 0;
+        v.stop_at = 10;
+        n = difference ? htable_difference_each(a, b, &check_visit, &v) :
+                         htable_intersect_each(a, b, &check_visit, &v);
+        assert(n == 10 && v.seen == 10);
+    }
+    
+    htable_collection_delete(v.expect);
+}
+
+void check_next(struct htable *a, struct htable *b, int difference, uint32_t max)
+{
+    uint32_t i, n, seen = 0, cursor = 0;
+    struct htable_entry *list[64];
+    struct htable_collection *expect;
+    
+    expect = difference ? htable_difference(a, b) : htable_intersect(a, b);
+    assert(expect != NULL);
+    
+    for (;;) {
+        n = difference ? htable_difference_next(a, b, &cursor, list, max) :
+                         htable_intersect_next(a, b, &cursor, list, max);
+        if (n == 0) {
+            break;
+        }
+        
+        assert(n <= max);
+        for (i = 0; i < n; i++) {
+            assert(list[i] == expect->list[seen + i]);
+        }
+        
+        seen += n;
+    }
+    
+    assert(seen == expect->used);
+    assert(cursor == a->used);
+    
+    /* Stays done */
+    assert(htable_intersect_next(a, b, &cursor, list, max) == 0);
+    
+    htable_collection_delete(expect);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t i, max;
+    struct htable *a, *b, *empty;
+    
+    a = htable_new(16, 0, &htable_int32_cmpfn, NULL, NULL);
+    b = htable_new(16, 0, &htable_int32_cmpfn, NULL, NULL);
+    empty = htable_new(16, 0, &htable_int32_cmpfn, NULL, NULL);
+    
+    /* a has [0, NKEYS), b every other one of them, and as many others */
+    for (i = 0; i < NKEYS * 2; i++) {
+        keys[i] = i;
+        
+        if (i < NKEYS) {
+            assert(htable_add_loop(a, sizeof(uint32_t), &keys[i], NULL, 16));
+        }
+        
+        if (i % 2 == 0) {
+            assert(htable_add_loop(b, sizeof(uint32_t), &keys[i], NULL, 16));
+        }
+    }
+    
+    check_each(a, b, 0);
+    check_each(a, b, 1);
+    check_each(b, a, 0);
+    check_each(a, empty, 0);
+    check_each(a, empty, 1);
+    check_each(empty, a, 1);
+    
+    for (max = 1; max <= 64; max *= 4) {
+        check_next(a, b, 0, max);
+        check_next(a, b, 1, max);
+        check_next(a, empty, 0, max);
+        check_next(a, empty, 1, max);
+    }
+    
+    /* No room, nothing written */
+    i = 0;
+    assert(htable_intersect_next(a, b, &i, NULL, 0) == 0);
+    assert(i == 0);
+    
+    htable_delete(a);
+    htable_delete(b);
+    htable_delete(empty);
+    
+    return 0;
+}
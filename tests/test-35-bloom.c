@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "config.h"
+#include "hashtable.h"
+
+#define NKEYS 20000
+
+static uint32_t keys[NKEYS * 2];
+
+/* Look up keys [NKEYS, 2 * NKEYS), none of which are in table */
+void lookup_absent(struct htable *table)
+{
+    uint32_t i;
+    
+    for (i = NKEYS; i < NKEYS * 2; i++) {
+        assert(htable_get(table, sizeof(uint32_t), &keys[i]) == NULL);
+    }
+}
+
+void test_filter()
+{
+    uint32_t i, nblocks;
+    uint64_t checks;
+    double observed;
+    struct htable *table;
+    struct htable_bloom *bloom;
+    
+    table = htable_new(32768, 0, &htable_int32_cmpfn, NULL, NULL);
+    assert(table != NULL);
+    
+    for (i = 0; i < NKEYS / 2; i++) {
+        assert(htable_add(table, sizeof(uint32_t), &keys[i], NULL));
+    }
+    
+    assert(htable_bloom_attach(table, 0.01));
+    bloom = table->bloom;
+    assert(bloom != NULL && bloom->k == 7);
+    assert((uintptr_t)bloom->blocks % HT_BLOOM_BLOCK == 0);
+    
+    /* Keys added before and after attaching are all found */
+    for (i = NKEYS / 2; i < NKEYS; i++) {
+        assert(htable_add(table, sizeof(uint32_t), &keys[i], NULL));
+    }
+    
+    for (i = 0; i < NKEYS; i++) {
+        assert(htable_get(table, sizeof(uint32_t), &keys[i]) != NULL);
+    }
+    
+    assert(bloom->checks == NKEYS);
+    assert(bloom->skipped == 0 && bloom->false_positives == 0);
+    
+    /* Most misses never probe */
+    lookup_absent(table);
+    assert(bloom->checks == NKEYS * 2);
+    assert(bloom->skipped + bloom->false_positives == NKEYS);
+    observed = (double)bloom->false_positives / NKEYS;
+    assert(observed < 0.02);
+    
+    /* Removed keys pass until the table is rebuilt */
+    for (i = 0; i < NKEYS - NKEYS / 10; i++) {
+        assert(htable_remove(table, sizeof(uint32_t), &keys[i]));
+    }
+    
+    nblocks = bloom->nblocks;
+    checks = bloom->checks;
+    assert(htable_shrink_to_fit(table));
+    assert(table->bloom != bloom);
+    bloom = table->bloom;
+    assert(bloom->nblocks < nblocks);
+    assert(bloom->checks == checks);
+    
+    for (i = 0; i < NKEYS; i++) {
+        assert((htable_get(table, sizeof(uint32_t), &keys[i]) != NULL) ==
+               (i >= NKEYS - NKEYS / 10));
+    }
+    
+    assert(bloom->skipped + bloom->false_positives == NKEYS + NKEYS - NKEYS / 10);
+    
+    /* Grows with the table */
+    nblocks = bloom->nblocks;
+    assert(htable_resize(table, 0, 65536));
+    assert(table->bloom->nblocks > nblocks);
+    assert(htable_get(table, sizeof(uint32_t), &keys[NKEYS - 1]) != NULL);
+    
+    /* Cleared along with the table */
+    htable_clear(table);
+    checks = table->bloom->skipped;
+    for (i = 0; i < NKEYS; i++) {
+        assert(htable_get(table, sizeof(uint32_t), &keys[i]) == NULL);
+    }
+    
+    assert(table->bloom->skipped == checks + NKEYS);
+    
+    htable_bloom_detach(table);
+    assert(table->bloom == NULL);
+    lookup_absent(table);
+    htable_delete(table);
+}
+
+void test_tables()
+{
+    uint32_t i;
+    struct htable *a, *b, *clone;
+    struct htable_collection *plain, *filtered;
+    struct htable_snapshot *snap;
+    
+    a = htable_new(16, 0, &htable_int32_cmpfn, NULL, NULL);
+    b = htable_new_ex(16, 0, &htable_int32_cmpfn, NULL, NULL, HT_FLAG_COW);
+    for (i = 0; i < NKEYS; i++) {
+        assert(htable_add_loop(a, sizeof(uint32_t), &keys[i], NULL, 16));
+        assert(htable_add_loop(b, sizeof(uint32_t), &keys[i * 2], NULL, 16));
+    }
+    
+    /* Same results with the filter in front of b */
+    plain = htable_intersect(a, b);
+    assert(htable_bloom_attach(b, 0.05));
+    filtered = htable_intersect(a, b);
+    assert(plain->used == NKEYS / 2 && filtered->used == plain->used);
+    assert(memcmp(plain->list, filtered->list, sizeof(*plain->list) * plain->used) == 0);
+    assert(b->bloom->checks == NKEYS);
+    htable_collection_delete(plain);
+    htable_collection_delete(filtered);
+    
+    filtered = htable_difference(a, b);
+    assert(filtered->used == NKEYS / 2);
+    assert(htable_intersect_count(a, b) == NKEYS / 2);
+    htable_collection_delete(filtered);
+    
+    /* Clones get a filter of their own, snapshots go without */
+    clone = htable_clone(b);
+    assert(clone != NULL && clone->bloom != NULL && clone->bloom != b->bloom);
+    assert(clone->bloom->checks == 0);
+    assert(htable_get(clone, sizeof(uint32_t), &keys[2]) != NULL);
+    assert(htable_get(clone, sizeof(uint32_t), &keys[1]) == NULL);
+    htable_delete(clone);
+    
+    snap = htable_snapshot(b);
+    assert(snap != NULL && snap->view.bloom == NULL);
+    assert(htable_snapshot_get(snap, sizeof(uint32_t), &keys[2]) != NULL);
+    assert(htable_resize(b, 0, b->size * 2));
+    assert(htable_snapshot_get(snap, sizeof(uint32_t), &keys[4]) != NULL);
+    htable_snapshot_delete(snap);
+    
+    /* Replaced, with fresh statistics */
+    assert(htable_bloom_attach(b, 0.001));
+    assert(b->bloom->checks == 0 && b->bloom->k == 10);
+    
+    assert(htable_bloom_attach(b, 0) == 0);
+    assert(htable_bloom_attach(b, 1) == 0);
+    htable_delete(a);
+    htable_delete(b);
+    
+    a = htable_new_ex(16, 0, &htable_int32_cmpfn, NULL, NULL, HT_FLAG_RCU);
+    assert(htable_bloom_attach(a, 0.01) == 0);
+    htable_delete(a);
+    
+    a = htable_new_ex(16, 0, &htable_int32_cmpfn, NULL, NULL, HT_FLAG_SEQLOCK);
+    assert(htable_bloom_attach(a, 0.01) == 0);
+    htable_delete(a);
+}
+
+void test_iov()
+{
+    uint32_t i;
+    struct htable *table;
+    struct htable_iovec iov[2];
+    
+    table = htable_new_ex(NKEYS * 2, 0, NULL, NULL, NULL, HT_FLAG_MEMCMP);
+    assert(table != NULL);
+    
+    for (i = 0; i < NKEYS; i++) {
+        assert(htable_add(table, sizeof(uint32_t), &keys[i], NULL));
+    }
+    
+    assert(htable_bloom_attach(table, 0.01));
+    
+    /* Fragmented keys go through the filter, and are counted */
+    for (i = 0; i < NKEYS * 2; i++) {
+        iov[0].base = &keys[i];
+        iov[0].len = 2;
+        iov[1].base = (char *)&keys[i] + 2;
+        iov[1].len = sizeof(uint32_t) - 2;
+        assert((htable_get_iov(table, iov, 2) != NULL) == (i < NKEYS));
+    }
+    
+    assert(table->bloom->checks == NKEYS * 2);
+    assert(table->bloom->skipped > 0);
+    assert(table->bloom->skipped + table->bloom->false_positives == NKEYS);
+    
+    htable_delete(table);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t i;
+    
+    for (i = 0; i < NKEYS * 2; i++) {
+        keys[i] = i;
+    }
+    
+    test_filter();
+    test_tables();
+    test_iov();
+    
+    return 0;
+}